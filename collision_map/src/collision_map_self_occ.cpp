@@ -35,9 +35,12 @@
 /** \author Ioan Sucan */
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <std_srvs/Empty.h>
 #include <sensor_msgs/PointCloud.h>
+#include <geometry_msgs/Point.h>
 #include <arm_navigation_msgs/CollisionMap.h>
+#include <arm_navigation_msgs/CollisionMapDelta.h>
 #include <tf/transform_listener.h>
 #include <tf/message_filter.h>
 #include <message_filters/subscriber.h>
@@ -49,6 +52,17 @@
 #include <set>
 #include <iterator>
 #include <cstdlib>
+#include <cmath>
+#include <stdint.h>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <arm_navigation_msgs/MakeStaticCollisionMapAction.h>
 #include <actionlib/server/simple_action_server.h>
 
@@ -84,7 +98,10 @@ class CollisionMapperOcc
 {
 public:
   
-  CollisionMapperOcc(void): root_handle_(""), making_static_collision_map_(false), disregard_first_message_(false)
+  CollisionMapperOcc(void): root_handle_(""), static_map_snapshot_count_(0), static_map_written_sequence_(0),
+                            making_static_collision_map_(false), disregard_first_message_(false),
+                            delta_sequence_(0), deltas_since_keyframe_(0), force_keyframe_(true),
+                            publish_pending_(false)
   {
     static_map_goal_ = NULL;
     
@@ -120,6 +137,26 @@ public:
     priv.param<bool>("publish_occlusion", publishOcclusion_, false);
     priv.param<bool>("publish_static_over_dynamic_map", publish_over_dynamic_map_, false);
 
+    // delta updates: only the cells that changed since the last union, with a
+    // complete keyframe every keyframe_interval deltas so late joiners and
+    // receivers that dropped a message can resynchronize
+    priv.param<bool>("publish_full_map", publishFullMap_, true);
+    priv.param<bool>("publish_delta", publishDelta_, false);
+    priv.param<int>("keyframe_interval", keyframeInterval_, 20);
+    if(keyframeInterval_ < 1) {
+      ROS_WARN("keyframe_interval must be at least 1; using 1");
+      keyframeInterval_ = 1;
+    }
+
+    // upper bound on how often the union is published; clouds arriving in
+    // between are merged into the next publication.  0 publishes on every cloud
+    priv.param<double>("max_publish_rate", maxPublishRate_, 0.0);
+
+    // keep the buffered maps on a grid in the fixed frame so they stay valid
+    // while the base moves; the window around the robot is cut out of them
+    // and re-binned into the robot frame only when publishing
+    priv.param<bool>("store_in_fixed_frame", storeInFixedFrame_, false);
+
 
     // compute some useful values
     bi_.real_minX = -bi_.dimensionX + bi_.originX;
@@ -135,6 +172,9 @@ public:
     cmapPublisher_ = root_handle_.advertise<arm_navigation_msgs::CollisionMap>("collision_map_occ", 1, true);
     cmapUpdPublisher_ = root_handle_.advertise<arm_navigation_msgs::CollisionMap>("collision_map_occ_update", 1);
     static_map_publisher_ = root_handle_.advertise<arm_navigation_msgs::CollisionMap>("collision_map_occ_static", 1);
+    if(publishDelta_) {
+      cmapDeltaPublisher_ = root_handle_.advertise<arm_navigation_msgs::CollisionMapDelta>("collision_map_occ_delta", 16);
+    }
         
     if(!priv.hasParam("cloud_sources")) {
       ROS_WARN("No links specified for self filtering.");
@@ -199,8 +239,13 @@ public:
             ROS_WARN_STREAM("Already have a cloud defined with name " << cps.cloud_name_);
           } else {
             cloud_source_map_[cps.cloud_name_] = cps;
-            mn_cloud_tf_sub_vector_.push_back(new message_filters::Subscriber<sensor_msgs::PointCloud>(root_handle_, cps.cloud_name_, 1));
-            mn_cloud_tf_fil_vector_.push_back(new tf::MessageFilter<sensor_msgs::PointCloud>(*(mn_cloud_tf_sub_vector_.back()), tf_, "", 1));
+            // every source gets its own queue and thread so that a slow sensor
+            // does not hold up the transform and voxelization of the others
+            SensorPipeline* pipeline = new SensorPipeline();
+            pipeline->handle_.setCallbackQueue(&pipeline->queue_);
+            sensor_pipelines_.push_back(pipeline);
+            mn_cloud_tf_sub_vector_.push_back(new message_filters::Subscriber<sensor_msgs::PointCloud>(pipeline->handle_, cps.cloud_name_, 1));
+            mn_cloud_tf_fil_vector_.push_back(new tf::MessageFilter<sensor_msgs::PointCloud>(*(mn_cloud_tf_sub_vector_.back()), tf_, "", 1, pipeline->handle_));
             mn_cloud_tf_fil_vector_.back()->registerCallback(boost::bind(&CollisionMapperOcc::cloudCallback, this, _1, cps.cloud_name_));
             // if (publishOcclusion_) {
             //   std::string name = std::string("collision_map_occ_occlusion_")+cps.cloud_name_;
@@ -229,12 +274,40 @@ public:
     //mnCloudIncremental_->setTargetFrame(frames);
     resetService_ = priv.advertiseService("reset", &CollisionMapperOcc::reset, this);
 
+    // static maps are written to this file whenever one is built and mounted
+    // from it at startup; the save/load services re-read the parameter so
+    // the file can be switched (e.g. per workcell) at run time
+    priv.param<std::string>("static_map_file", static_map_file_, std::string());
+    saveStaticMapsService_ = priv.advertiseService("save_static_maps", &CollisionMapperOcc::saveStaticMapsCallback, this);
+    loadStaticMapsService_ = priv.advertiseService("load_static_maps", &CollisionMapperOcc::loadStaticMapsCallback, this);
+    if(!static_map_file_.empty() && access(static_map_file_.c_str(), R_OK) == 0) {
+      boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+      if(loadStaticMaps(static_map_file_)) {
+        publishMapUnion(robotFrame_, ros::Time::now());
+      }
+    }
+
     action_server_.reset(new actionlib::SimpleActionServer<arm_navigation_msgs::MakeStaticCollisionMapAction>(root_handle_, "make_static_collision_map", 
                                                                                                                     boost::bind(&CollisionMapperOcc::makeStaticCollisionMap, this, _1)));
+
+    if(maxPublishRate_ > 0.0) {
+      publish_timer_ = root_handle_.createWallTimer(ros::WallDuration(1.0/maxPublishRate_), &CollisionMapperOcc::publishTimerCallback, this);
+    }
+
+    for(unsigned int i = 0; i < sensor_pipelines_.size(); i++) {
+      sensor_pipelines_[i]->spinner_.reset(new ros::AsyncSpinner(1, &sensor_pipelines_[i]->queue_));
+      sensor_pipelines_[i]->spinner_->start();
+    }
   }
   
   ~CollisionMapperOcc(void)
   {
+    publish_timer_.stop();
+    for(unsigned int i = 0; i < sensor_pipelines_.size(); i++) {
+      if(sensor_pipelines_[i]->spinner_) {
+        sensor_pipelines_[i]->spinner_->stop();
+      }
+    }
 
     for(std::map<std::string, std::list<StampedCMap*> >::iterator it = currentMaps_.begin(); it != currentMaps_.end(); it++)
     {
@@ -256,6 +329,9 @@ public:
     for(unsigned int i = 0; i < mn_cloud_tf_fil_vector_.size(); i++) {
       delete mn_cloud_tf_fil_vector_[i];
     }
+    for(unsigned int i = 0; i < sensor_pipelines_.size(); i++) {
+      delete sensor_pipelines_[i];
+    }
     //delete self_filter_;
     if(static_map_goal_) delete static_map_goal_;
     //delete mnCloudIncremental_;
@@ -298,6 +374,13 @@ private:
     
   typedef std::set<CollisionPoint, CollisionPointOrder> CMap;
 
+  struct SensorPipeline
+  {
+    ros::CallbackQueue queue_;
+    ros::NodeHandle handle_;
+    boost::shared_ptr<ros::AsyncSpinner> spinner_;
+  };
+
   struct StampedCMap
   {
     std::string frame_id;
@@ -343,7 +426,7 @@ private:
 
 
     CMap obstacles;
-    constructCollisionMap(out, obstacles);
+    constructCollisionMap(out, 1, tf::Transform::getIdentity(), obstacles);
 
     CMap diff;
     //set_difference(obstacles.begin(), obstacles.end(), currentMap_.begin(), currentMap_.end(),
@@ -354,19 +437,6 @@ private:
       publishCollisionMap(diff, out.header.frame_id, out.header.stamp, cmapUpdPublisher_);
   }
 
-  void subsampleCloudPoints(const sensor_msgs::PointCloud &msg, sensor_msgs::PointCloud& myMsg, int subsampleNum) {
-    myMsg.points.clear();
-    myMsg.header = msg.header;
-    
-    //myMsg.channels.clear();        
-    for(int i = 0; i < (int)msg.points.size(); i += subsampleNum) {
-      myMsg.points.push_back(msg.points[i]);
-      //if((*msg).channels.size() < i) {
-      //  myMsg.channels.push_back((*msg).channels[i]);
-      //}
-    }
-  }
-
   void updateBuffer(std::list<StampedCMap*> &buffer, const unsigned int buffer_size, const ros::Duration buffer_duration, const std::string sensor_frame)
   {
     if(buffer_size > 1)
@@ -374,7 +444,7 @@ private:
       while(buffer.size() > buffer_size)
       {
         ROS_DEBUG_STREAM("Deleting old map in frame " << sensor_frame << " total buffer size: " << buffer.size());
-        delete buffer.back();
+        discardMap(buffer.back());
         buffer.pop_back();
       }
     }
@@ -386,7 +456,7 @@ private:
       while(buffer.back()->stamp < min_time)
       {
         ROS_DEBUG_STREAM("Deleting old map in frame " << sensor_frame << " which is too old by: " << min_time - buffer.back()->stamp << " seconds" );
-        delete buffer.back();
+        discardMap(buffer.back());
         buffer.pop_back();
       }
     }
@@ -397,36 +467,114 @@ private:
       ROS_DEBUG_STREAM("Keeping only most recent map in frame " << sensor_frame );
       while(buffer.size() > 1)
       {
-        delete buffer.back();
+        discardMap(buffer.back());
         buffer.pop_back();
       }
     }
 
   }
 
-  void composeMapUnion(std::map<std::string, std::list<StampedCMap*> > &maps, CMap &uni)
+  // The union of all maps in currentMaps_ is kept up to date incrementally: every
+  // voxel carries the number of buffered maps that contain it, and only voxels
+  // whose count moves between zero and one change the union.  Any change to a
+  // map held in currentMaps_ must go through addToUnion/removeFromUnion.
+
+  void addToUnion(const CMap &map)
   {
-    //composing the union of all the sensor maps
-    for(std::map<std::string, std::list<StampedCMap*> >::iterator it = maps.begin(); it != maps.end(); it++)
+    for(CMap::const_iterator it = map.begin(); it != map.end(); ++it)
     {
-      int processed = 0;
-      for(std::list<StampedCMap*>::iterator itbuff = it->second.begin(); itbuff != it->second.end(); itbuff++)
+      unsigned int &count = unionCounts_[*it];
+      if(count++ == 0)
+      {
+        union_.insert(*it);
+        if(publishDelta_ && !storeInFixedFrame_ && unionRemoved_.erase(*it) == 0)
+          unionAdded_.insert(*it);
+      }
+    }
+  }
+
+  void removeFromUnion(const CMap &map)
+  {
+    for(CMap::const_iterator it = map.begin(); it != map.end(); ++it)
+    {
+      std::map<CollisionPoint, unsigned int, CollisionPointOrder>::iterator cit = unionCounts_.find(*it);
+      if(cit == unionCounts_.end())
+      {
+        ROS_ERROR("Removing a voxel that is not part of the collision map union");
+        continue;
+      }
+      if(--cit->second == 0)
       {
-        set_union(uni.begin(), uni.end(), (*itbuff)->cmap.begin(), (*itbuff)->cmap.end(), std::inserter(uni, uni.begin()), CollisionPointOrder());
-        processed++;
+        unionCounts_.erase(cit);
+        union_.erase(*it);
+        if(publishDelta_ && !storeInFixedFrame_ && unionAdded_.erase(*it) == 0)
+          unionRemoved_.insert(*it);
       }
+    }
+  }
+
+  /** Make static_map the newest static map of a source, which replaces its dynamic maps if so configured.
+      A static map of the source that was loaded from a file is dropped */
+  void addStaticMap(const std::string &topic_name, const CloudInfo &settings, StampedCMap *static_map)
+  {
+    if(mappedStaticMaps_.erase(topic_name) > 0) {
+      force_keyframe_ = true;
+    }
+    currentMaps_[topic_name+"_static"].push_front(static_map);
+    addToUnion(static_map->cmap);
+
+    updateBuffer(currentMaps_[topic_name+"_static"], settings.static_buffer_size_, settings.static_buffer_duration_, topic_name+"_static");
+
+    if(settings.dynamic_until_static_publish_) {
+      discardDynamicMaps(topic_name);
+    }
+  }
 
-      ROS_DEBUG_STREAM("The buffer for sensor frame " << it->first << " had " << processed << " maps");
+  /** Make a static map loaded from a file the only static map of a source, which replaces its dynamic maps if so configured */
+  void addMappedStaticMap(const std::string &topic_name, const CloudInfo &settings, const MappedStaticMap &static_map)
+  {
+    std::list<StampedCMap*> &static_list = currentMaps_[topic_name+"_static"];
+    for(std::list<StampedCMap*>::iterator it = static_list.begin(); it != static_list.end(); it++) {
+      discardMap(*it);
     }
+    currentMaps_.erase(topic_name+"_static");
+    mappedStaticMaps_[topic_name] = static_map;
+    // the cells of mapped maps are not tracked by the union deltas
+    force_keyframe_ = true;
 
+    if(settings.dynamic_until_static_publish_) {
+      discardDynamicMaps(topic_name);
+    }
+  }
+
+  /** Stop publishing the dynamic maps of a source once it has a static map */
+  void discardDynamicMaps(const std::string &topic_name)
+  {
+    std::list<StampedCMap*>& dyn_list = currentMaps_[topic_name+"_dynamic"];
+    for(std::list<StampedCMap*>::iterator it = dyn_list.begin(); it != dyn_list.end(); it++) {
+      discardMap(*it);
+    }
+    currentMaps_.erase(topic_name+"_dynamic");
+  }
+
+  /** Delete a map that is being dropped from currentMaps_ */
+  void discardMap(StampedCMap *map)
+  {
+    removeFromUnion(map->cmap);
+    delete map;
   }
     
+  /** Runs on the source's own pipeline thread; only merging the result into the buffers takes mapProcessing_ */
   void cloudCallback(const sensor_msgs::PointCloudConstPtr &cloud, const std::string topic_name)
   {
-    CloudInfo settings =  cloud_source_map_[topic_name];
-
-    if(!making_static_collision_map_ &&  !settings.dynamic_publish_ && (!settings.dynamic_until_static_publish_ || static_map_published_[topic_name])) {
-      return;
+    CloudInfo settings;
+    {
+      boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+      settings = cloud_source_map_[topic_name];
+      
+      if(!making_static_collision_map_ &&  !settings.dynamic_publish_ && (!settings.dynamic_until_static_publish_ || static_map_published_[topic_name])) {
+        return;
+      }
     }
 
     //sensor_msgs::PointCloud sf_out;
@@ -435,26 +583,44 @@ private:
     
     ros::WallTime tm = ros::WallTime::now();
 
-    sensor_msgs::PointCloud subCloud;
-
     ROS_DEBUG("Got pointcloud that is %f seconds old", (ros::Time::now() - cloud->header.stamp).toSec());
     ROS_DEBUG("Received %u data points.",(unsigned int)(*cloud).points.size ());
-    subsampleCloudPoints(*cloud, subCloud, settings.point_subsample_);
-    ROS_DEBUG("After subsampling we have %u data points.",(unsigned int)subCloud.points.size ());
 
+    CMap obstacles;
 
-    boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+    // the map is bounded in the robot frame (around the robot); subsampling and
+    // the transforms happen while binning the points
+    tf::StampedTransform robot_from_cloud, fixed_from_cloud;
+    try {
+      tf_.lookupTransform(robotFrame_, cloud->header.frame_id, cloud->header.stamp, robot_from_cloud);
+      if(storeInFixedFrame_) {
+        tf_.lookupTransform(fixedFrame_, cloud->header.frame_id, cloud->header.stamp, fixed_from_cloud);
+      }
+    } catch(tf::TransformException& ex) {
+      ROS_WARN_STREAM("Unable to transform cloud from " << topic_name << " into " << robotFrame_ << ": " << ex.what());
+      return;
+    }
+    std_msgs::Header header = cloud->header;
+    header.frame_id = robotFrame_;
+    const std::string &map_frame = storeInFixedFrame_ ? fixedFrame_ : robotFrame_;
 
-    CMap obstacles;
+    if(storeInFixedFrame_) {
+      constructFixedFrameCollisionMap(*cloud, settings.point_subsample_, robot_from_cloud, fixed_from_cloud, obstacles);
+    } else {
+      constructCollisionMap(*cloud, settings.point_subsample_, robot_from_cloud, obstacles);
+    }
 
-    sensor_msgs::PointCloud transCloud;
-    
-    tf_.transformPointCloud(robotFrame_, subCloud, transCloud);
-	
-    // transform the pointcloud to the robot frame
-    // since we need the points in this frame (around the robot)
-    // to compute the collision map
-    constructCollisionMap(transCloud, obstacles);
+    // the static maps are written to disk after the lock is released
+    StaticMapSnapshot static_snapshot;
+    bool save_static_snapshot = false;
+
+    boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+
+    // a static map may have been completed while this cloud was being processed
+    settings = cloud_source_map_[topic_name];
+    if(!making_static_collision_map_ &&  !settings.dynamic_publish_ && (!settings.dynamic_until_static_publish_ || static_map_published_[topic_name])) {
+      return;
+    }
 
     if(making_static_collision_map_ && topic_name == static_map_goal_->cloud_source) {
       if(disregard_first_message_) {
@@ -467,15 +633,22 @@ private:
           static_map = tempMaps_[map_name];
         } else {
           static_map = new StampedCMap();
-	  static_map->frame_id = transCloud.header.frame_id;
-	  static_map->stamp = transCloud.header.stamp;
+	  static_map->frame_id = map_frame;
+	  static_map->stamp = header.stamp;
           tempMaps_[map_name] = static_map;
         } 
-        updateMap(&static_map->cmap, obstacles, transCloud.header.frame_id, transCloud.header.stamp, settings.sensor_frame_, settings.cloud_name_);
+        updateMap(&static_map->cmap, obstacles, header.frame_id, header.stamp, settings.sensor_frame_, settings.cloud_name_);
         if(++cloud_count_ == static_map_goal_->number_of_clouds) {
 
 	    ROS_DEBUG("Publishing static map");
-	    publishCollisionMap(static_map->cmap, transCloud.header.frame_id, transCloud.header.stamp, static_map_publisher_);
+	    if(storeInFixedFrame_) {
+	      CMap window;
+	      if(extractWindow(static_map->cmap, header.stamp, window)) {
+	        publishCollisionMap(window, header.frame_id, header.stamp, static_map_publisher_);
+	      }
+	    } else {
+	      publishCollisionMap(static_map->cmap, header.frame_id, header.stamp, static_map_publisher_);
+	    }
 
 	  if(!settings.static_publish_)
   	  {
@@ -484,23 +657,14 @@ private:
 	  else
    	  {
 	    ROS_DEBUG("Saving static map for inclusion in future dynamic maps");
-	    currentMaps_[topic_name+"_static"].push_front(static_map);
+	    addStaticMap(topic_name, settings, static_map);
 
-	    updateBuffer(currentMaps_[topic_name+"_static"], settings.static_buffer_size_, settings.static_buffer_duration_, topic_name+"_static");
+            publishMapUnion(header.frame_id, header.stamp);
 
-            if(settings.dynamic_until_static_publish_) {
-              //now if we are supposed to stop publishing dynamic maps get ride of the dynamic map for this topic
-              std::list<StampedCMap*>& dyn_list = currentMaps_[topic_name+"_dynamic"];
-              for(std::list<StampedCMap*>::iterator it = dyn_list.begin(); it != dyn_list.end(); it++) {
-                delete (*it);
-              }
-              currentMaps_.erase(topic_name+"_dynamic");
+            if(!static_map_file_.empty()) {
+              snapshotStaticMaps(static_map_file_, static_snapshot);
+              save_static_snapshot = true;
             }
-
-            CMap uni;
-            composeMapUnion(currentMaps_, uni);
-
-            publishCollisionMap(uni, transCloud.header.frame_id, transCloud.header.stamp, cmapPublisher_);
 	  }
           
 	  tempMaps_.erase(map_name);
@@ -515,34 +679,35 @@ private:
 
       StampedCMap* current_map;
 
-      // try to transform the previous map(s) (if it exists) to the new frame
+      // a single buffered map is updated in place; in the robot frame its
+      // old cells are not moved with the base (only store_in_fixed_frame
+      // keeps buffers consistent under base motion)
       if(settings.dynamic_buffer_size_ == 1 && currentMaps_.find(topic_name+"_dynamic") != currentMaps_.end()) {
         current_map = currentMaps_[topic_name+"_dynamic"].front();
-//      if (!current_map->cmap.empty()) 
-//      {
-//	if (!transformMap(current_map->cmap, current_map->header, transCloud.header))  // Need to transform entire buffer, not just current_map!
-//  	{
-//        current_map->cmap.clear();
-//  	} 
-//      current_map->header = transCloud.header;
-//      }
+        current_map->stamp = header.stamp;
       } else {
         current_map = new StampedCMap();
-        current_map->frame_id = transCloud.header.frame_id;
-	current_map->stamp = transCloud.header.stamp;
+        current_map->frame_id = map_frame;
+	current_map->stamp = header.stamp;
         currentMaps_[topic_name+"_dynamic"].push_front(current_map);
       }
 
-      // update map
-      updateMap(&current_map->cmap, obstacles, transCloud.header.frame_id, transCloud.header.stamp, settings.sensor_frame_, settings.cloud_name_);
+      // update map, and the union with just the cells that changed
+      CMap added, removed;
+      updateMap(&current_map->cmap, obstacles, header.frame_id, header.stamp, settings.sensor_frame_, settings.cloud_name_,
+                &added, &removed);
+      addToUnion(added);
+      removeFromUnion(removed);
       updateBuffer(currentMaps_[topic_name+"_dynamic"], settings.dynamic_buffer_size_, settings.dynamic_buffer_duration_, topic_name+"_dynamic");
 
-      CMap uni;
-      composeMapUnion(currentMaps_, uni);
-
-      publishCollisionMap(uni, transCloud.header.frame_id, transCloud.header.stamp, cmapPublisher_);
+      schedulePublish(header.frame_id, header.stamp);
 
     } 
+    lock.unlock();
+
+    if(save_static_snapshot) {
+      writeStaticMaps(static_snapshot);
+    }
 
     double sec = (ros::WallTime::now() - tm).toSec();
     ROS_DEBUG("Updated collision map took %g seconds",sec);
@@ -551,23 +716,46 @@ private:
 
 
 
+  /** Replace currentMap with obstacles.  If given, added and removed receive the cells that
+      are new to the map and the cells that are no longer in it */
   void updateMap(CMap* currentMap, CMap &obstacles, 
 		 std::string &frame_id,
 		 ros::Time &stamp,
 		 std::string to_frame_id, 
-		 std::string cloud_name)
+		 std::string cloud_name,
+                 CMap* added = NULL,
+                 CMap* removed = NULL)
   {
     if (currentMap->empty())
     {
       *currentMap = obstacles;
+      if (added)
+        *added = obstacles;
     }
     else
     {
       CMap diff;
 	    
-      // find the points from the old map that are no longer visible
-      set_difference(currentMap->begin(), currentMap->end(), obstacles.begin(), obstacles.end(),
-                     std::inserter(diff, diff.begin()), CollisionPointOrder());
+      // find the points from the old map that are no longer visible, and
+      // the ones that are new, in one pass over both sorted maps
+      CollisionPointOrder order;
+      CMap::const_iterator old_it = currentMap->begin(), new_it = obstacles.begin();
+      while (old_it != currentMap->end() || new_it != obstacles.end())
+      {
+        if (new_it == obstacles.end() || (old_it != currentMap->end() && order(*old_it, *new_it)))
+          diff.insert(diff.end(), *old_it++);
+        else if (old_it == currentMap->end() || order(*new_it, *old_it))
+        {
+          if (added)
+            added->insert(added->end(), *new_it);
+          ++new_it;
+        }
+        else
+        {
+          ++old_it;
+          ++new_it;
+        }
+      }
 	    
       // the current map will at least contain the new info
       *currentMap = obstacles;
@@ -625,7 +813,9 @@ private:
       //   }
 		
       // }
-	    
+
+      if (removed)
+        removed->swap(diff);
     }
   }
     
@@ -649,11 +839,15 @@ private:
 
     currentMaps_.clear();
     tempMaps_.clear();
+    mappedStaticMaps_.clear();
+    unionCounts_.clear();
+    union_.clear();
+    unionAdded_.clear();
+    unionRemoved_.clear();
+    publish_pending_ = false;
 
-    CMap uni;
-    composeMapUnion(currentMaps_, uni);
-
-    publishCollisionMap(uni, robotFrame_, ros::Time::now(), cmapPublisher_);
+    force_keyframe_ = true;
+    publishMapUnion(robotFrame_, ros::Time::now());
 
     return true;
   }
@@ -701,56 +895,182 @@ private:
     ROS_DEBUG_STREAM("Old frame displaced by " << disp << " and angle " << angle << " to get new frame");
 
    
-    // copy data to temporary location
-    const int n = map.size();
-    std::vector<CollisionPoint> pts(n);
-    std::copy(map.begin(), map.end(), pts.begin());
+    // re-bin the cell corners through the same kernel as incoming clouds,
+    // keeping them in double precision as the serial loop did
+    std::vector<geometry_msgs::Point> pts(map.size());
+    unsigned int i = 0;
+    for (CMap::const_iterator it = map.begin() ; it != map.end() ; ++it, ++i)
+    {
+      pts[i].x = ((double)it->x - 0.5) * bi_.resolution + bi_.originX;
+      pts[i].y = ((double)it->y - 0.5) * bi_.resolution + bi_.originY;
+      pts[i].z = ((double)it->z - 0.5) * bi_.resolution + bi_.originZ;
+    }
     map.clear();
+    voxelizePoints<double>(pts, 1, transf, transf, tf::Vector3(bi_.originX, bi_.originY, bi_.originZ), false, map);
 	
-    //#pragma omp parallel for
-    for (int i = 0 ; i < n ; ++i)
-    {
-      tf::Vector3 p(((double)pts[i].x - 0.5) * bi_.resolution + bi_.originX,
-                  ((double)pts[i].y - 0.5) * bi_.resolution + bi_.originY,
-                  ((double)pts[i].z - 0.5) * bi_.resolution + bi_.originZ);
-      p = transf * p;
-      if (p.x() > bi_.real_minX && p.x() < bi_.real_maxX && p.y() > bi_.real_minY && p.y() < bi_.real_maxY && p.z() > bi_.real_minZ && p.z() < bi_.real_maxZ)
-      {
-        CollisionPoint c((int)(0.5 + (p.x() - bi_.originX) / bi_.resolution),
-                         (int)(0.5 + (p.y() - bi_.originY) / bi_.resolution),
-                         (int)(0.5 + (p.z() - bi_.originZ) / bi_.resolution));
-        //#pragma omp critical
-        {
-          map.insert(c);
-        }
-		
+    return true;
+
+  }
+
+  /** Construct an axis-aligned collision map in the robot frame from every subsample-th point of a
+      cloud, given the transform from the cloud frame to the robot frame */
+  void constructCollisionMap(const sensor_msgs::PointCloud &cloud, int subsample, const tf::Transform &robot_from_cloud, CMap &map)
+  {
+    voxelizePoints<float>(cloud.points, subsample < 1 ? 1 : subsample, robot_from_cloud, robot_from_cloud,
+                   tf::Vector3(bi_.originX, bi_.originY, bi_.originZ), false, map);
+  }
+
+  /** Same as constructCollisionMap, but the cells are on a grid anchored at the origin of the fixed frame.
+      Points are still only kept if they are within the map bounds around the robot. */
+  void constructFixedFrameCollisionMap(const sensor_msgs::PointCloud &cloud, int subsample, const tf::Transform &robot_from_cloud,
+                                       const tf::Transform &fixed_from_cloud, CMap &map)
+  {
+    voxelizePoints<float>(cloud.points, subsample < 1 ? 1 : subsample, robot_from_cloud, fixed_from_cloud,
+                   tf::Vector3(0.0, 0.0, 0.0), true, map);
+  }
+
+  /** Cut the cells of a fixed frame map that lie within the map bounds around the robot at the
+      given time and re-bin them onto the robot frame grid */
+  template <typename Cells>
+  bool extractWindow(const Cells &fixed_map, const ros::Time &stamp, CMap &window)
+  {
+    tf::StampedTransform robot_from_fixed;
+    try {
+      tf_.lookupTransform(robotFrame_, fixedFrame_, stamp, robot_from_fixed);
+    } catch(tf::TransformException& ex) {
+      try {
+        tf_.lookupTransform(robotFrame_, fixedFrame_, ros::Time(0), robot_from_fixed);
+      } catch(tf::TransformException& ex) {
+        ROS_WARN_STREAM("Unable to place the map around the robot: " << ex.what());
+        return false;
       }
     }
-	
+
+    std::vector<geometry_msgs::Point32> centers(fixed_map.size());
+    unsigned int i = 0;
+    for (typename Cells::const_iterator it = fixed_map.begin() ; it != fixed_map.end() ; ++it, ++i)
+    {
+      centers[i].x = it->x * bi_.resolution;
+      centers[i].y = it->y * bi_.resolution;
+      centers[i].z = it->z * bi_.resolution;
+    }
+    voxelizePoints<float>(centers, 1, robot_from_fixed, robot_from_fixed,
+                   tf::Vector3(bi_.originX, bi_.originY, bi_.originZ), false, window);
     return true;
+  }
 
+  // voxel keys pack the three cell indices into one integer whose ordering
+  // matches CollisionPointOrder, so sorted keys can be appended to a CMap
+  static const int VOXEL_KEY_BITS = 21;
+  static const int VOXEL_KEY_OFFSET = 1 << (VOXEL_KEY_BITS - 1);
+
+  static inline uint64_t packVoxelKey(int x, int y, int z)
+  {
+    const uint64_t mask = (1ULL << VOXEL_KEY_BITS) - 1;
+    return ((uint64_t)(x + VOXEL_KEY_OFFSET) & mask) << (2 * VOXEL_KEY_BITS) |
+           ((uint64_t)(y + VOXEL_KEY_OFFSET) & mask) << VOXEL_KEY_BITS |
+           ((uint64_t)(z + VOXEL_KEY_OFFSET) & mask);
   }
 
-  /** Construct an axis-aligned collision map from a point cloud assumed to be in the robot frame */
-  void constructCollisionMap(const sensor_msgs::PointCloud &cloud, CMap &map)
+  static inline CollisionPoint unpackVoxelKey(uint64_t key)
   {
-    const unsigned int n = cloud.points.size();
-    CollisionPoint c;
-	
-    for (unsigned int i = 0 ; i < n ; ++i)
+    const uint64_t mask = (1ULL << VOXEL_KEY_BITS) - 1;
+    return CollisionPoint((int)((key >> (2 * VOXEL_KEY_BITS)) & mask) - VOXEL_KEY_OFFSET,
+                          (int)((key >> VOXEL_KEY_BITS) & mask) - VOXEL_KEY_OFFSET,
+                          (int)(key & mask) - VOXEL_KEY_OFFSET);
+  }
+
+  /** Transform every stride-th point by robot_from_points and test it against the map bounds, and bin
+      the points within bounds into map on the grid given by key_from_points and key_origin (cells are
+      rounded down when floor_cells is set, otherwise truncated like the robot frame grid always was).
+      Transformed coordinates are kept as Coordinate: float for clouds, as tf would have transformed
+      them, and double for map cells being re-binned.  The points are split into one contiguous
+      block per thread; each block is keyed without branches (points outside
+      the bounds get a key that sorts last), then sorted and made unique on its own thread.  The
+      sorted blocks are appended to the map with insertion hints. */
+  template <typename Coordinate, typename PointT>
+  void voxelizePoints(const std::vector<PointT> &points, unsigned int stride,
+                      const tf::Transform &robot_from_points, const tf::Transform &key_from_points,
+                      const tf::Vector3 &key_origin, bool floor_cells, CMap &map) const
+  {
+    const uint64_t outside = ~0ULL;
+    const unsigned int n = (points.size() + stride - 1) / stride;
+    if (n == 0)
+      return;
+
+    const tf::Matrix3x3 &basis = robot_from_points.getBasis();
+    const double r00 = basis[0][0], r01 = basis[0][1], r02 = basis[0][2];
+    const double r10 = basis[1][0], r11 = basis[1][1], r12 = basis[1][2];
+    const double r20 = basis[2][0], r21 = basis[2][1], r22 = basis[2][2];
+    const double tx = robot_from_points.getOrigin().x(), ty = robot_from_points.getOrigin().y(), tz = robot_from_points.getOrigin().z();
+    const tf::Matrix3x3 &kbasis = key_from_points.getBasis();
+    const double k00 = kbasis[0][0], k01 = kbasis[0][1], k02 = kbasis[0][2];
+    const double k10 = kbasis[1][0], k11 = kbasis[1][1], k12 = kbasis[1][2];
+    const double k20 = kbasis[2][0], k21 = kbasis[2][1], k22 = kbasis[2][2];
+    const double kx = key_from_points.getOrigin().x(), ky = key_from_points.getOrigin().y(), kz = key_from_points.getOrigin().z();
+    const double minX = bi_.real_minX, maxX = bi_.real_maxX;
+    const double minY = bi_.real_minY, maxY = bi_.real_maxY;
+    const double minZ = bi_.real_minZ, maxZ = bi_.real_maxZ;
+    const double ox = key_origin.x(), oy = key_origin.y(), oz = key_origin.z();
+    const double res = bi_.resolution;
+    const PointT *pts = &points[0];
+
+    int blocks = 1;
+#ifdef _OPENMP
+    // every sensor pipeline voxelizes on its own spinner thread at the same time, so each
+    // one gets an even share of the threads instead of a team of its own per core
+    const int threads = std::max(1, omp_get_max_threads() / std::max(1, (int)sensor_pipelines_.size()));
+    blocks = std::max(1, std::min(threads, (int)(n / 4096) + 1));
+#endif
+    std::vector<uint64_t> keys(n);
+    std::vector<unsigned int> block_end(blocks);
+
+#pragma omp parallel for schedule(static, 1) num_threads(blocks)
+    for (int b = 0 ; b < blocks ; ++b)
     {
-      const geometry_msgs::Point32 &p = cloud.points[i];
-      if (p.x > bi_.real_minX && p.x < bi_.real_maxX && p.y > bi_.real_minY && p.y < bi_.real_maxY && p.z > bi_.real_minZ && p.z < bi_.real_maxZ)
+      const unsigned int begin = (unsigned int)((uint64_t)n * b / blocks);
+      const unsigned int end = (unsigned int)((uint64_t)n * (b + 1) / blocks);
+      uint64_t *k = &keys[0];
+      for (unsigned int i = begin ; i < end ; ++i)
       {
-        c.x = (int)(0.5 + (p.x - bi_.originX) / bi_.resolution);
-        c.y = (int)(0.5 + (p.y - bi_.originY) / bi_.resolution);
-        c.z = (int)(0.5 + (p.z - bi_.originZ) / bi_.resolution);
-        map.insert(c);
+        const PointT &p = pts[i * stride];
+        const Coordinate x = r00 * p.x + r01 * p.y + r02 * p.z + tx;
+        const Coordinate y = r10 * p.x + r11 * p.y + r12 * p.z + ty;
+        const Coordinate z = r20 * p.x + r21 * p.y + r22 * p.z + tz;
+        // false for NaN as well as for points outside the bounds
+        const bool inside = x > minX && x < maxX && y > minY && y < maxY && z > minZ && z < maxZ;
+        // the key frame is the robot frame unless the map is kept in the fixed frame
+        const Coordinate gx = k00 * p.x + k01 * p.y + k02 * p.z + kx;
+        const Coordinate gy = k10 * p.x + k11 * p.y + k12 * p.z + ky;
+        const Coordinate gz = k20 * p.x + k21 * p.y + k22 * p.z + kz;
+        // points outside get cell 0 before the int conversions, which are undefined for
+        // NaN and out of range values; their key is replaced below anyway
+        const double cx = inside ? 0.5 + (gx - ox) / res : 0.0;
+        const double cy = inside ? 0.5 + (gy - oy) / res : 0.0;
+        const double cz = inside ? 0.5 + (gz - oz) / res : 0.0;
+        const uint64_t key = floor_cells ?
+          packVoxelKey((int)floor(cx), (int)floor(cy), (int)floor(cz)) :
+          packVoxelKey((int)cx, (int)cy, (int)cz);
+        k[i] = inside ? key : outside;
       }
+      std::sort(keys.begin() + begin, keys.begin() + end);
+      unsigned int last = std::unique(keys.begin() + begin, keys.begin() + end) - keys.begin();
+      if (last > begin && keys[last - 1] == outside)
+        --last;
+      block_end[b] = last;
+    }
+
+    for (int b = 0 ; b < blocks ; ++b)
+    {
+      const unsigned int begin = (unsigned int)((uint64_t)n * b / blocks);
+      CMap::iterator hint = map.begin();
+      for (unsigned int i = begin ; i < block_end[b] ; ++i)
+        hint = map.insert(hint, unpackVoxelKey(keys[i]));
     }
   }
     
-  void publishCollisionMap(const CMap &map, 
+  template <typename Cells>
+  void publishCollisionMap(const Cells &map, 
                            const std::string &frame_id,
                            const ros::Time &stamp,
                            ros::Publisher &pub) const
@@ -760,16 +1080,10 @@ private:
     cmap.header.stamp = stamp;
     const unsigned int ms = map.size();
 	
-    for (CMap::const_iterator it = map.begin() ; it != map.end() ; ++it)
+    for (typename Cells::const_iterator it = map.begin() ; it != map.end() ; ++it)
     {
-      const CollisionPoint &cp = *it;
       arm_navigation_msgs::OrientedBoundingBox box;
-      box.extents.x = box.extents.y = box.extents.z = bi_.resolution;
-      box.axis.x = box.axis.y = 0.0; box.axis.z = 1.0;
-      box.angle = 0.0;
-      box.center.x = cp.x * bi_.resolution + bi_.originX;
-      box.center.y = cp.y * bi_.resolution + bi_.originY;
-      box.center.z = cp.z * bi_.resolution + bi_.originZ;
+      fillBox(*it, box);
       cmap.boxes.push_back(box);
     } 
     pub.publish(cmap);
@@ -777,6 +1091,575 @@ private:
     ROS_DEBUG("Published collision map with %u boxes", ms);
   }
 
+  void fillBox(const CollisionPoint &cp, arm_navigation_msgs::OrientedBoundingBox &box) const
+  {
+    box.extents.x = box.extents.y = box.extents.z = bi_.resolution;
+    box.axis.x = box.axis.y = 0.0; box.axis.z = 1.0;
+    box.angle = 0.0;
+    box.center.x = cp.x * bi_.resolution + bi_.originX;
+    box.center.y = cp.y * bi_.resolution + bi_.originY;
+    box.center.z = cp.z * bi_.resolution + bi_.originZ;
+  }
+
+  /** Publish the union right away, or leave it to the publish timer if publishing is rate limited */
+  void schedulePublish(const std::string &frame_id,
+                       const ros::Time &stamp)
+  {
+    if(maxPublishRate_ <= 0.0) {
+      publishMapUnion(frame_id, stamp);
+      return;
+    }
+    publish_pending_ = true;
+    pending_frame_id_ = frame_id;
+    pending_stamp_ = stamp;
+  }
+
+  void publishTimerCallback(const ros::WallTimerEvent &event)
+  {
+    boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+    if(!publish_pending_) {
+      return;
+    }
+    publishMapUnion(pending_frame_id_, pending_stamp_);
+    publish_pending_ = false;
+  }
+
+  /** Publish the union of all maps as a full map and/or as the delta accumulated since the last publication */
+  void publishMapUnion(const std::string &frame_id,
+                       const ros::Time &stamp)
+  {
+    // static maps loaded from a file are not part of union_; their cells are
+    // merged in from the file mapping when the whole map has to be published
+    const bool has_mapped = !mappedStaticMaps_.empty();
+    const bool keyframe_due = force_keyframe_ || frame_id != lastPublishedFrame_ || deltas_since_keyframe_ + 1 >= keyframeInterval_;
+    std::vector<CollisionPoint> merged;
+    if(has_mapped && (storeInFixedFrame_ || publishFullMap_ || (publishDelta_ && keyframe_due))) {
+      mergeMappedStaticMaps(union_, merged);
+    }
+
+    CMap window;
+    if(storeInFixedFrame_) {
+      if(!(has_mapped ? extractWindow(merged, stamp, window) : extractWindow(union_, stamp, window))) {
+        return;
+      }
+    }
+
+    if(publishFullMap_) {
+      if(storeInFixedFrame_) {
+        publishCollisionMap(window, frame_id, stamp, cmapPublisher_);
+      } else if(has_mapped) {
+        publishCollisionMap(merged, frame_id, stamp, cmapPublisher_);
+      } else {
+        publishCollisionMap(union_, frame_id, stamp, cmapPublisher_);
+      }
+    }
+    if(!publishDelta_) {
+      return;
+    }
+    
+    arm_navigation_msgs::CollisionMapDelta delta;
+    delta.header.frame_id = frame_id;
+    delta.header.stamp = stamp;
+    delta.sequence = delta_sequence_++;
+    delta.resolution = bi_.resolution;
+    delta.origin.x = bi_.originX;
+    delta.origin.y = bi_.originY;
+    delta.origin.z = bi_.originZ;
+
+    // cells are indexed relative to the robot frame, so a union in another
+    // frame cannot be diffed against the last one
+    if(frame_id != lastPublishedFrame_ || ++deltas_since_keyframe_ >= keyframeInterval_) {
+      force_keyframe_ = true;
+    }
+
+    if(force_keyframe_) {
+      delta.keyframe = true;
+      if(storeInFixedFrame_) {
+        fillDeltaCells(window, delta.added, delta.added_indices);
+      } else if(has_mapped) {
+        fillDeltaCells(merged, delta.added, delta.added_indices);
+      } else {
+        fillDeltaCells(union_, delta.added, delta.added_indices);
+      }
+      force_keyframe_ = false;
+      deltas_since_keyframe_ = 0;
+    } else {
+      delta.keyframe = false;
+      const CMap *added = &unionAdded_;
+      const CMap *removed = &unionRemoved_;
+      // the window moves with the robot, so it has to be diffed against the
+      // previous one rather than tracked through the fixed frame union
+      CMap window_added, window_removed;
+      if(storeInFixedFrame_) {
+        std::set_difference(window.begin(), window.end(), lastPublishedWindow_.begin(), lastPublishedWindow_.end(),
+                            std::inserter(window_added, window_added.begin()), CollisionPointOrder());
+        std::set_difference(lastPublishedWindow_.begin(), lastPublishedWindow_.end(), window.begin(), window.end(),
+                            std::inserter(window_removed, window_removed.begin()), CollisionPointOrder());
+        added = &window_added;
+        removed = &window_removed;
+      } else if(has_mapped) {
+        // cells of the mapped static maps were in the last keyframe and stay in the union
+        for(CMap::const_iterator it = unionAdded_.begin(); it != unionAdded_.end(); ++it) {
+          if(!mappedStaticMapsContain(*it)) {
+            window_added.insert(window_added.end(), *it);
+          }
+        }
+        for(CMap::const_iterator it = unionRemoved_.begin(); it != unionRemoved_.end(); ++it) {
+          if(!mappedStaticMapsContain(*it)) {
+            window_removed.insert(window_removed.end(), *it);
+          }
+        }
+        added = &window_added;
+        removed = &window_removed;
+      }
+      fillDeltaCells(*added, delta.added, delta.added_indices);
+      fillDeltaIndices(*removed, delta.removed_indices);
+    }
+    unionAdded_.clear();
+    unionRemoved_.clear();
+    lastPublishedWindow_.swap(window);
+    lastPublishedFrame_ = frame_id;
+    cmapDeltaPublisher_.publish(delta);
+
+    ROS_DEBUG("Published collision map delta %u (%s) with %u added and %u removed boxes", delta.sequence,
+              delta.keyframe ? "keyframe" : "incremental", (unsigned int)delta.added.size(), (unsigned int)delta.removed_indices.size() / 3);
+  }
+
+  /** Store the boxes of the cells of map in boxes and their indices as x, y, z triples in indices */
+  template <typename Cells>
+  void fillDeltaCells(const Cells &map, std::vector<arm_navigation_msgs::OrientedBoundingBox> &boxes, std::vector<int32_t> &indices) const
+  {
+    boxes.resize(map.size());
+    unsigned int i = 0;
+    for(typename Cells::const_iterator it = map.begin(); it != map.end(); ++it, ++i) {
+      fillBox(*it, boxes[i]);
+    }
+    fillDeltaIndices(map, indices);
+  }
+
+  template <typename Cells>
+  void fillDeltaIndices(const Cells &map, std::vector<int32_t> &indices) const
+  {
+    indices.resize(3 * map.size());
+    unsigned int i = 0;
+    for(typename Cells::const_iterator it = map.begin(); it != map.end(); ++it, i += 3) {
+      indices[i] = it->x;
+      indices[i + 1] = it->y;
+      indices[i + 2] = it->z;
+    }
+  }
+
+  // Static map files are a header, then for every map an entry header followed
+  // by its runs.  A run is a sequence of cells that are consecutive along z,
+  // which is how CMap orders them.  All records have a fixed size and native
+  // byte order, so a file can be mapped and walked in place.
+  static const unsigned int STATIC_MAP_FILE_VERSION = 1;
+  static const unsigned int STATIC_MAP_NAME_LENGTH = 128;
+
+  struct StaticMapFileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t map_count;
+    double resolution;
+    double origin[3];
+    uint32_t fixed_frame_grid;
+    uint32_t reserved;
+  };
+
+  struct StaticMapEntryHeader
+  {
+    char name[STATIC_MAP_NAME_LENGTH];
+    char frame_id[STATIC_MAP_NAME_LENGTH];
+    int32_t stamp_sec;
+    int32_t stamp_nsec;
+    uint32_t run_count;
+    uint32_t reserved;
+  };
+
+  struct StaticMapRun
+  {
+    int32_t x, y, z;
+    uint32_t length;
+  };
+
+  static const char* staticMapFileMagic(void)
+  {
+    return "CMAPSTAT";
+  }
+
+  /** Orders a cell against the first cell of a run */
+  struct StaticMapRunOrder
+  {
+    bool operator()(const CollisionPoint &a, const StaticMapRun &b) const
+    {
+      return CollisionPointOrder()(a, CollisionPoint(b.x, b.y, b.z));
+    }
+  };
+
+  /** Unmaps a static map file once no loaded map refers to it */
+  struct StaticMapFileUnmapper
+  {
+    StaticMapFileUnmapper(size_t size) : size_(size) {}
+    void operator()(void *data) const
+    {
+      munmap(data, size_);
+    }
+    size_t size_;
+  };
+
+  /** A static map loaded from a file.  Its runs are used in place in the file mapping, which they keep
+      alive; files are only ever replaced by renaming, so a mapped file is never truncated */
+  struct MappedStaticMap
+  {
+    boost::shared_ptr<void> file;
+    std::string frame_id;
+    ros::Time stamp;
+    const StaticMapRun *runs;
+    unsigned int run_count;
+    size_t cell_count;
+  };
+
+  /** Whether any static map loaded from a file contains cp; the runs of a map are sorted, so this is a binary search */
+  bool mappedStaticMapsContain(const CollisionPoint &cp) const
+  {
+    for(std::map<std::string, MappedStaticMap>::const_iterator it = mappedStaticMaps_.begin(); it != mappedStaticMaps_.end(); ++it) {
+      const MappedStaticMap &m = it->second;
+      // the last run that starts at or before cp
+      const StaticMapRun *run = std::upper_bound(m.runs, m.runs + m.run_count, cp, StaticMapRunOrder());
+      if(run == m.runs) {
+        continue;
+      }
+      --run;
+      if(run->x == cp.x && run->y == cp.y && (int64_t)cp.z < (int64_t)run->z + run->length) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Merge the cells of map and of all static maps loaded from a file into the sorted cells of merged */
+  void mergeMappedStaticMaps(const CMap &map, std::vector<CollisionPoint> &merged) const
+  {
+    merged.assign(map.begin(), map.end());
+    std::vector<CollisionPoint> cells, result;
+    for(std::map<std::string, MappedStaticMap>::const_iterator it = mappedStaticMaps_.begin(); it != mappedStaticMaps_.end(); ++it) {
+      const MappedStaticMap &m = it->second;
+      cells.clear();
+      cells.reserve(m.cell_count);
+      for(unsigned int r = 0; r < m.run_count; r++) {
+        for(unsigned int k = 0; k < m.runs[r].length; k++) {
+          cells.push_back(CollisionPoint(m.runs[r].x, m.runs[r].y, m.runs[r].z + k));
+        }
+      }
+      result.clear();
+      result.reserve(merged.size() + cells.size());
+      std::set_union(merged.begin(), merged.end(), cells.begin(), cells.end(), std::back_inserter(result), CollisionPointOrder());
+      merged.swap(result);
+    }
+  }
+
+  /** The newest static map of every source, encoded as runs, and the file it is to be written to */
+  struct StaticMapSnapshot
+  {
+    std::string filename;
+    unsigned int sequence;
+    StaticMapFileHeader header;
+    std::vector<StaticMapEntryHeader> entries;
+    std::vector<std::vector<StaticMapRun> > runs;
+  };
+
+  /** Encode the newest static map of every source for writing to filename; the caller holds mapProcessing_ */
+  void snapshotStaticMaps(const std::string &filename, StaticMapSnapshot &snapshot)
+  {
+    snapshot.filename = filename;
+    snapshot.sequence = ++static_map_snapshot_count_;
+    StaticMapFileHeader &header = snapshot.header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, staticMapFileMagic(), sizeof(header.magic));
+    header.version = STATIC_MAP_FILE_VERSION;
+    header.resolution = bi_.resolution;
+    header.origin[0] = bi_.originX;
+    header.origin[1] = bi_.originY;
+    header.origin[2] = bi_.originZ;
+    header.fixed_frame_grid = storeInFixedFrame_ ? 1 : 0;
+
+    snapshot.entries.clear();
+    snapshot.runs.clear();
+    // a source has either static maps in currentMaps_ or one loaded from a file
+    for(std::map<std::string, MappedStaticMap>::const_iterator it = mappedStaticMaps_.begin(); it != mappedStaticMaps_.end(); it++) {
+      const std::string name = it->first + "_static";
+      if(name.size() >= STATIC_MAP_NAME_LENGTH || it->second.frame_id.size() >= STATIC_MAP_NAME_LENGTH) {
+        ROS_WARN_STREAM("Name or frame of static map " << name << " is too long to be saved");
+        continue;
+      }
+      snapshot.runs.push_back(std::vector<StaticMapRun>(it->second.runs, it->second.runs + it->second.run_count));
+
+      StaticMapEntryHeader entry;
+      memset(&entry, 0, sizeof(entry));
+      strncpy(entry.name, name.c_str(), STATIC_MAP_NAME_LENGTH - 1);
+      strncpy(entry.frame_id, it->second.frame_id.c_str(), STATIC_MAP_NAME_LENGTH - 1);
+      entry.stamp_sec = it->second.stamp.sec;
+      entry.stamp_nsec = it->second.stamp.nsec;
+      entry.run_count = it->second.run_count;
+      snapshot.entries.push_back(entry);
+    }
+    for(std::map<std::string, std::list<StampedCMap*> >::iterator it = currentMaps_.begin(); it != currentMaps_.end(); it++) {
+      const std::string suffix = "_static";
+      if(it->first.size() <= suffix.size() || it->first.compare(it->first.size() - suffix.size(), suffix.size(), suffix) != 0 || it->second.empty()) {
+        continue;
+      }
+      const StampedCMap *static_map = it->second.front();
+      if(it->first.size() >= STATIC_MAP_NAME_LENGTH || static_map->frame_id.size() >= STATIC_MAP_NAME_LENGTH) {
+        ROS_WARN_STREAM("Name or frame of static map " << it->first << " is too long to be saved");
+        continue;
+      }
+
+      snapshot.runs.resize(snapshot.runs.size() + 1);
+      std::vector<StaticMapRun> &runs = snapshot.runs.back();
+      for(CMap::const_iterator cit = static_map->cmap.begin(); cit != static_map->cmap.end(); ++cit) {
+        if(!runs.empty()) {
+          StaticMapRun &last = runs.back();
+          if(last.x == cit->x && last.y == cit->y && last.z + (int)last.length == cit->z) {
+            last.length++;
+            continue;
+          }
+        }
+        StaticMapRun run;
+        run.x = cit->x;
+        run.y = cit->y;
+        run.z = cit->z;
+        run.length = 1;
+        runs.push_back(run);
+      }
+
+      StaticMapEntryHeader entry;
+      memset(&entry, 0, sizeof(entry));
+      strncpy(entry.name, it->first.c_str(), STATIC_MAP_NAME_LENGTH - 1);
+      strncpy(entry.frame_id, static_map->frame_id.c_str(), STATIC_MAP_NAME_LENGTH - 1);
+      entry.stamp_sec = static_map->stamp.sec;
+      entry.stamp_nsec = static_map->stamp.nsec;
+      entry.run_count = runs.size();
+      snapshot.entries.push_back(entry);
+      ROS_DEBUG_STREAM("Encoded static map " << it->first << " with " << static_map->cmap.size() << " cells in " << runs.size() << " runs");
+    }
+    header.map_count = snapshot.entries.size();
+  }
+
+  /** Write a snapshot to its file, replacing the file atomically.  Runs without mapProcessing_, so
+      writers are ordered by staticMapFile_ and a snapshot older than the last one written is dropped */
+  bool writeStaticMaps(const StaticMapSnapshot &snapshot)
+  {
+    boost::mutex::scoped_lock lock(staticMapFile_);
+    if(snapshot.filename == static_map_written_file_ && snapshot.sequence < static_map_written_sequence_) {
+      ROS_DEBUG_STREAM("Not writing static maps to " << snapshot.filename << ", a newer snapshot was already written");
+      return true;
+    }
+
+    // a unique name, so concurrent writers never share a partially written file
+    std::string tmp_filename = snapshot.filename + ".XXXXXX";
+    std::vector<char> tmp_buffer(tmp_filename.begin(), tmp_filename.end());
+    tmp_buffer.push_back('\0');
+    int fd = mkstemp(&tmp_buffer[0]);
+    tmp_filename = &tmp_buffer[0];
+    FILE *file = fd < 0 ? NULL : fdopen(fd, "wb");
+    if(file == NULL) {
+      ROS_ERROR_STREAM("Unable to open " << tmp_filename << " for writing the static maps");
+      if(fd >= 0) {
+        close(fd);
+        unlink(tmp_filename.c_str());
+      }
+      return false;
+    }
+    // mkstemp creates the file readable by its owner only
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    bool ok = fwrite(&snapshot.header, sizeof(snapshot.header), 1, file) == 1;
+    for(unsigned int i = 0; ok && i < snapshot.entries.size(); i++) {
+      const std::vector<StaticMapRun> &runs = snapshot.runs[i];
+      ok = fwrite(&snapshot.entries[i], sizeof(StaticMapEntryHeader), 1, file) == 1;
+      if(ok && !runs.empty()) {
+        ok = fwrite(&runs[0], sizeof(StaticMapRun), runs.size(), file) == runs.size();
+      }
+    }
+    if(fclose(file) != 0) {
+      ok = false;
+    }
+    if(!ok || rename(tmp_filename.c_str(), snapshot.filename.c_str()) != 0) {
+      ROS_ERROR_STREAM("Unable to write the static maps to " << snapshot.filename);
+      unlink(tmp_filename.c_str());
+      return false;
+    }
+    static_map_written_file_ = snapshot.filename;
+    static_map_written_sequence_ = snapshot.sequence;
+    ROS_INFO_STREAM("Saved " << snapshot.entries.size() << " static maps to " << snapshot.filename);
+    return true;
+  }
+
+  /** Largest absolute cell index along each axis of the grid the maps are kept on */
+  void gridCellLimits(int64_t limits[3]) const
+  {
+    if(storeInFixedFrame_) {
+      // fixed frame cells are only bounded by what voxelizePoints can key
+      limits[0] = limits[1] = limits[2] = VOXEL_KEY_OFFSET - 1;
+    } else {
+      limits[0] = (int64_t)ceil(bi_.dimensionX / bi_.resolution) + 1;
+      limits[1] = (int64_t)ceil(bi_.dimensionY / bi_.resolution) + 1;
+      limits[2] = (int64_t)ceil(bi_.dimensionZ / bi_.resolution) + 1;
+    }
+  }
+
+  /** Replace the static maps of the sources found in filename with the maps stored there.  The maps
+      are used in place in the file mapping rather than being expanded into CMaps */
+  bool loadStaticMaps(const std::string &filename)
+  {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+      ROS_ERROR_STREAM("Unable to open static map file " << filename);
+      return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(StaticMapFileHeader)) {
+      ROS_ERROR_STREAM("Static map file " << filename << " is too short");
+      close(fd);
+      return false;
+    }
+    const size_t size = st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+      ROS_ERROR_STREAM("Unable to map static map file " << filename);
+      return false;
+    }
+    boost::shared_ptr<void> file(data, StaticMapFileUnmapper(size));
+
+    const char *bytes = static_cast<const char*>(data);
+    const StaticMapFileHeader *header = reinterpret_cast<const StaticMapFileHeader*>(bytes);
+    bool ok = true;
+    if(memcmp(header->magic, staticMapFileMagic(), sizeof(header->magic)) != 0 || header->version != STATIC_MAP_FILE_VERSION) {
+      ROS_ERROR_STREAM(filename << " is not a static map file of a known version");
+      ok = false;
+    } else if(fabs(header->resolution - bi_.resolution) > 1e-9 ||
+              fabs(header->origin[0] - bi_.originX) > 1e-9 ||
+              fabs(header->origin[1] - bi_.originY) > 1e-9 ||
+              fabs(header->origin[2] - bi_.originZ) > 1e-9 ||
+              (header->fixed_frame_grid != 0) != storeInFixedFrame_) {
+      ROS_ERROR_STREAM("Static maps in " << filename << " were saved with a different resolution, origin or grid frame");
+      ok = false;
+    }
+
+    // check everything before touching the current maps
+    std::vector<std::pair<std::string, MappedStaticMap> > loaded;
+    size_t offset = sizeof(StaticMapFileHeader);
+    const std::string &map_frame = storeInFixedFrame_ ? fixedFrame_ : robotFrame_;
+    int64_t limits[3];
+    gridCellLimits(limits);
+    for(unsigned int i = 0; ok && i < header->map_count; i++) {
+      if(offset + sizeof(StaticMapEntryHeader) > size) {
+        ok = false;
+        break;
+      }
+      const StaticMapEntryHeader *entry = reinterpret_cast<const StaticMapEntryHeader*>(bytes + offset);
+      offset += sizeof(StaticMapEntryHeader);
+      if(offset + (size_t)entry->run_count * sizeof(StaticMapRun) > size) {
+        ok = false;
+        break;
+      }
+      const StaticMapRun *runs = reinterpret_cast<const StaticMapRun*>(bytes + offset);
+      offset += (size_t)entry->run_count * sizeof(StaticMapRun);
+
+      // every run has to lie on the grid, and the runs have to be sorted and disjoint
+      // so that they can be searched and merged in place
+      size_t cell_count = 0;
+      for(unsigned int r = 0; ok && r < entry->run_count; r++) {
+        const int64_t z_end = (int64_t)runs[r].z + runs[r].length - 1;
+        ok = runs[r].length > 0 &&
+          runs[r].x >= -limits[0] && runs[r].x <= limits[0] &&
+          runs[r].y >= -limits[1] && runs[r].y <= limits[1] &&
+          runs[r].z >= -limits[2] && z_end <= limits[2];
+        if(ok && r > 0) {
+          const StaticMapRun &prev = runs[r - 1];
+          ok = CollisionPointOrder()(CollisionPoint(prev.x, prev.y, prev.z + prev.length - 1),
+                                     CollisionPoint(runs[r].x, runs[r].y, runs[r].z));
+        }
+        cell_count += runs[r].length;
+      }
+      if(!ok) {
+        ROS_ERROR_STREAM("Static map file " << filename << " has unsorted cells or cells outside of the map grid");
+        break;
+      }
+
+      std::string name(entry->name, strnlen(entry->name, STATIC_MAP_NAME_LENGTH));
+      std::string frame_id(entry->frame_id, strnlen(entry->frame_id, STATIC_MAP_NAME_LENGTH));
+      if(frame_id != map_frame) {
+        ROS_WARN_STREAM("Skipping static map " << name << " stored in frame " << frame_id << " instead of " << map_frame);
+        continue;
+      }
+      MappedStaticMap static_map;
+      static_map.file = file;
+      static_map.frame_id = frame_id;
+      static_map.stamp = ros::Time(entry->stamp_sec, entry->stamp_nsec);
+      static_map.runs = runs;
+      static_map.run_count = entry->run_count;
+      static_map.cell_count = cell_count;
+      loaded.push_back(std::make_pair(name, static_map));
+    }
+
+    if(!ok) {
+      ROS_ERROR_STREAM("Static map file " << filename << " is corrupt");
+      return false;
+    }
+
+    for(unsigned int i = 0; i < loaded.size(); i++) {
+      const std::string topic_name = loaded[i].first.substr(0, loaded[i].first.size() - std::string("_static").size());
+      std::map<std::string, CloudInfo>::iterator source = cloud_source_map_.find(topic_name);
+      if(source == cloud_source_map_.end() || loaded[i].first != topic_name + "_static") {
+        ROS_WARN_STREAM("Static map " << loaded[i].first << " does not belong to a configured cloud source");
+        continue;
+      }
+      if(!source->second.static_publish_) {
+        ROS_INFO_STREAM("Not loading static map " << loaded[i].first << ", its source does not publish static maps in the union");
+        continue;
+      }
+      addMappedStaticMap(topic_name, source->second, loaded[i].second);
+      static_map_published_[topic_name] = true;
+      ROS_INFO_STREAM("Loaded static map " << loaded[i].first << " with " << loaded[i].second.cell_count << " cells");
+    }
+    return true;
+  }
+
+  bool saveStaticMapsCallback(std_srvs::Empty::Request &req, std_srvs::Empty::Response &res)
+  {
+    ros::NodeHandle priv("~");
+    StaticMapSnapshot snapshot;
+    {
+      boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+      priv.param<std::string>("static_map_file", static_map_file_, static_map_file_);
+      if(static_map_file_.empty()) {
+        ROS_WARN("No static_map_file set; not saving static maps");
+        return false;
+      }
+      snapshotStaticMaps(static_map_file_, snapshot);
+    }
+    return writeStaticMaps(snapshot);
+  }
+
+  bool loadStaticMapsCallback(std_srvs::Empty::Request &req, std_srvs::Empty::Response &res)
+  {
+    ros::NodeHandle priv("~");
+    boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+    priv.param<std::string>("static_map_file", static_map_file_, static_map_file_);
+    if(static_map_file_.empty()) {
+      ROS_WARN("No static_map_file set; not loading static maps");
+      return false;
+    }
+    if(!loadStaticMaps(static_map_file_)) {
+      return false;
+    }
+    publishMapUnion(robotFrame_, ros::Time::now());
+    return true;
+  }
+
   void makeStaticCollisionMap(const arm_navigation_msgs::MakeStaticCollisionMapGoalConstPtr& goal) {
     
     if(cloud_source_map_.find(goal->cloud_source) == cloud_source_map_.end())
@@ -794,14 +1677,18 @@ private:
       return;
     }
 
-    static_map_goal_ = new arm_navigation_msgs::MakeStaticCollisionMapGoal(*goal);
-    cloud_count_ = 0;
-    making_static_collision_map_ = true;
-    disregard_first_message_ = true;
+    {
+      boost::recursive_mutex::scoped_lock lock(mapProcessing_);
+      static_map_goal_ = new arm_navigation_msgs::MakeStaticCollisionMapGoal(*goal);
+      cloud_count_ = 0;
+      making_static_collision_map_ = true;
+      disregard_first_message_ = true;
+    }
 
     ros::Rate r(10);
     while(making_static_collision_map_) {
       if(action_server_->isPreemptRequested()) {
+        boost::recursive_mutex::scoped_lock lock(mapProcessing_);
         making_static_collision_map_ = false;
 	// Clean up tempMaps before breaking
 	std::string map_name = static_map_goal_->cloud_source + "_static_temp";
@@ -816,6 +1703,7 @@ private:
       r.sleep();
     }
 
+    boost::recursive_mutex::scoped_lock lock(mapProcessing_);
     if(publish_over_dynamic_map_)
     {
      // loop through cloud_source_map, set dynamic publish to false on all sources to preserve behavior of older collision_map_self_occ
@@ -828,6 +1716,8 @@ private:
     }
 
     delete static_map_goal_;
+    static_map_goal_ = NULL;
+    lock.unlock();
     if(action_server_->isPreemptRequested()) {
       action_server_->setPreempted();
     } else {
@@ -847,8 +1737,16 @@ private:
   ros::Publisher                                cmapPublisher_;
   ros::Publisher                                cmapUpdPublisher_;
   ros::Publisher static_map_publisher_;           
+  ros::Publisher                                cmapDeltaPublisher_;
   std::map<std::string, ros::Publisher>         occPublisherMap_;
   ros::ServiceServer                            resetService_;
+  ros::ServiceServer                            saveStaticMapsService_;
+  ros::ServiceServer                            loadStaticMapsService_;
+  std::string                                   static_map_file_;
+  unsigned int                                  static_map_snapshot_count_;
+  boost::mutex                                  staticMapFile_;  //orders writers of the static map file
+  std::string                                   static_map_written_file_;
+  unsigned int                                  static_map_written_sequence_;
   bool                                          publishOcclusion_;
     
   arm_navigation_msgs::MakeStaticCollisionMapGoal *static_map_goal_;
@@ -857,9 +1755,31 @@ private:
   bool disregard_first_message_;
   int cloud_count_;
 
+  bool                                          publishFullMap_;
+  bool                                          publishDelta_;
+  int                                           keyframeInterval_;
+  unsigned int                                  delta_sequence_;
+  int                                           deltas_since_keyframe_;
+  bool                                          force_keyframe_;
+  std::string                                   lastPublishedFrame_;
+  bool                                          storeInFixedFrame_;
+  CMap                                          lastPublishedWindow_;  //robot frame cells last published when storing in the fixed frame
+
+  double                                        maxPublishRate_;
+  ros::WallTimer                                publish_timer_;
+  bool                                          publish_pending_;
+  std::string                                   pending_frame_id_;
+  ros::Time                                     pending_stamp_;
+  std::vector<SensorPipeline*>                  sensor_pipelines_;
+
 
   std::map<std::string, std::list<StampedCMap*> >                  currentMaps_;  //indexed by frame_ids
   std::map<std::string, StampedCMap*>                  			tempMaps_;  //indexed by frame_ids_static_save
+
+  std::map<std::string, MappedStaticMap>                           mappedStaticMaps_;  //static maps loaded from a file, indexed by source; not part of union_
+  std::map<CollisionPoint, unsigned int, CollisionPointOrder>       unionCounts_;  //number of maps in currentMaps_ containing each voxel
+  CMap                                                              union_;  //voxels with a non-zero count
+  CMap                                                              unionAdded_, unionRemoved_;  //changes to union_ since the last delta
     
   BoxInfo                                       bi_;
   std::string                                   fixedFrame_;
@@ -285,6 +285,11 @@ protected:
                    Geom *g, void *data, dNearCallback *nearCallback) const;
   };
 
+  /** \brief Padded geoms of one shape, keyed by padding. Variants are
+      created the first time a padding is requested and kept afterwards; only
+      the one in use is in the environment space */
+  typedef std::map<double, dGeomID> PaddedGeomVariants;
+
   struct AttGeom
   {
     AttGeom(ODEStorage& s) : storage(s){
@@ -296,15 +301,19 @@ protected:
         dGeomDestroy(geom[i]);
         storage.remove(geom[i]);
       }
-      for(unsigned int i = 0; i < padded_geom.size(); i++) {
-        dGeomDestroy(padded_geom[i]);
-        storage.remove(padded_geom[i]);
+      for(unsigned int i = 0; i < padded_variants.size(); i++) {
+        for(PaddedGeomVariants::iterator it = padded_variants[i].begin(); it != padded_variants[i].end(); it++) {
+          dGeomDestroy(it->second);
+          storage.remove(it->second);
+        }
       }
     }
 
     ODEStorage& storage;
     std::vector<dGeomID> geom;
     std::vector<dGeomID> padded_geom;
+    std::vector<PaddedGeomVariants> padded_variants;
+    /** \brief Kept alive by the attached body version held by the owning LinkGeom */
     const planning_models::KinematicModel::AttachedBodyModel *att;
     unsigned int index;
   };
@@ -318,8 +327,10 @@ protected:
       for(unsigned int i = 0; i < geom.size(); i++) {
         dGeomDestroy(geom[i]);
       }
-      for(unsigned int i = 0; i < padded_geom.size(); i++) {
-        dGeomDestroy(padded_geom[i]);
+      for(unsigned int i = 0; i < padded_variants.size(); i++) {
+        for(PaddedGeomVariants::iterator it = padded_variants[i].begin(); it != padded_variants[i].end(); it++) {
+          dGeomDestroy(it->second);
+        }
       }
       deleteAttachedBodies();
     }
@@ -330,18 +341,29 @@ protected:
         delete att_bodies[i];
       }
       att_bodies.clear();
+      attached_body_models.reset();
     }
 
     ODEStorage& storage;
     std::vector<dGeomID> geom;
     std::vector<dGeomID> padded_geom;
+    std::vector<PaddedGeomVariants> padded_variants;
     std::vector<AttGeom*> att_bodies;
+    /** \brief The attached body version att_bodies were built from; holding it keeps their bodies alive */
+    planning_models::KinematicModel::AttachedBodyModelSetConstPtr attached_body_models;
     const planning_models::KinematicModel::LinkModel *link;
     unsigned int index;
+    //index of the link in the kinematic model, and therefore in the link state vector
+    unsigned int link_state_index;
   };
 	
   struct ModelInfo
   {
+    ModelInfo() : env_space(NULL), self_space(NULL), bound_state_model(NULL), 
+                  bound_state_indexed(false), link_poses_valid(false)
+    {
+    }
+
     ~ModelInfo() {
       storage.clear();
     }
@@ -350,6 +372,15 @@ protected:
     dSpaceID env_space;
     dSpaceID self_space;
     ODEStorage storage;
+
+    //the model of the last state used to update the geoms, and whether its
+    //link states can be accessed through link_state_index
+    const planning_models::KinematicModel* bound_state_model;
+    bool bound_state_indexed;
+
+    //the last pose set for each entry in link_geom
+    std::vector<tf::Transform> link_poses;
+    bool link_poses_valid;
   };
 	
   struct CollisionNamespace
@@ -448,10 +479,17 @@ protected:
   dGeomID createODEGeom(dSpaceID space, ODEStorage &storage, const shapes::Shape *shape, double scale, double padding);
   dGeomID createODEGeom(dSpaceID space, ODEStorage &storage, const shapes::StaticShape *shape);
   void updateGeom(dGeomID geom, const tf::Transform &pose) const;	
+  void updateGeoms(dGeomID geom, dGeomID padded_geom, const tf::Transform &pose) const;
+  /** \brief The attached body geoms of a link for the attached body called name, looked for at hint first */
+  AttGeom* findAttachedGeom(LinkGeom* lg, const std::string& name, unsigned int hint) const;
 
   void addAttachedBody(LinkGeom* lg, const planning_models::KinematicModel::AttachedBodyModel* attm,
                        double padd);
 
+  /** \brief Puts the variant with the given padding in the environment space in place of current, creating it if needed */
+  dGeomID swapPaddedGeom(PaddedGeomVariants& variants, dGeomID current, const shapes::Shape* shape,
+                         double padding, const std::string& name, BodyType type);
+
   std::map<std::string, bool> attached_bodies_in_collision_matrix_;
 
   void setAttachedBodiesLinkPadding();
@@ -44,14 +44,27 @@
 #include <map>
 
 #include <boost/thread.hpp>
+#include <boost/detail/atomic_count.hpp>
 static int          ODEInitCount = 0;
+//only incremented under ODEInitCountLock, but read without it by queries
+static boost::detail::atomic_count ODEInitGeneration(0);
 static boost::mutex ODEInitCountLock;
 
-static std::map<boost::thread::id, int> ODEThreadMap;
-static boost::mutex                     ODEThreadMapLock;
-
 //all the threading stuff is necessary to check collision from different threads
 
+//each thread records the ODE initialization it allocated its data for, so
+//collision queries can check it without taking a lock
+static void cleanupODEThreadData(long* generation)
+{
+  ODEInitCountLock.lock();
+  if (ODEInitCount > 0 && *generation == ODEInitGeneration)
+    dCleanupODEAllDataForThread();
+  ODEInitCountLock.unlock();
+  delete generation;
+}
+
+static boost::thread_specific_ptr<long> ODEThreadGeneration(cleanupODEThreadData);
+
 static const int MAX_ODE_CONTACTS = 128;
 static const int TEST_FOR_ALLOWED_NUM = 1;
 
@@ -62,6 +75,7 @@ collision_space::EnvironmentModelODE::EnvironmentModelODE(void) : EnvironmentMod
   ODEInitCountLock.lock();
   if (ODEInitCount == 0)
   {
+    ++ODEInitGeneration;
     int res = dInitODE2(0);
     ROS_DEBUG_STREAM("Calling ODE Init res " << res);
   }
@@ -83,13 +97,8 @@ collision_space::EnvironmentModelODE::~EnvironmentModelODE(void)
   freeMemory();
   ODEInitCountLock.lock();
   ODEInitCount--;
-  boost::thread::id id = boost::this_thread::get_id();
-  ODEThreadMapLock.lock();
-  ODEThreadMap.erase(id);
-  ODEThreadMapLock.unlock();
   if (ODEInitCount == 0)
   {
-    ODEThreadMap.clear();
     ROS_DEBUG("Closing ODE");
     dCloseODE();
   }
@@ -114,16 +123,21 @@ void collision_space::EnvironmentModelODE::freeMemory(void)
 
 void collision_space::EnvironmentModelODE::checkThreadInit(void) const
 {
-  boost::thread::id id = boost::this_thread::get_id();
-  ODEThreadMapLock.lock();
-  if (ODEThreadMap.find(id) == ODEThreadMap.end())
+  //the generation is read atomically, so this needs no lock even if another
+  //thread is re-initializing ODE at the same time
+  long current = ODEInitGeneration;
+  long* generation = ODEThreadGeneration.get();
+  if (generation != NULL && *generation == current)
+    return;
+  if (generation == NULL)
   {
-    ODEThreadMap[id] = 1;
-    ROS_DEBUG("Initializing new thread (%d total)", (int)ODEThreadMap.size());
-    int res = dAllocateODEDataForThread(dAllocateMaskAll);
-    ROS_DEBUG_STREAM("Init says " << res);
-  } 
-  ODEThreadMapLock.unlock();
+    generation = new long;
+    ODEThreadGeneration.reset(generation);
+  }
+  *generation = current;
+  ROS_DEBUG("Initializing new thread");
+  int res = dAllocateODEDataForThread(dAllocateMaskAll);
+  ROS_DEBUG_STREAM("Init says " << res);
 }
 
 void collision_space::EnvironmentModelODE::setRobotModel(const planning_models::KinematicModel* model, 
@@ -187,6 +201,7 @@ void collision_space::EnvironmentModelODE::createODERobotModel()
 	
     LinkGeom *lg = new LinkGeom(model_geom_.storage);
     lg->link = link;
+    lg->link_state_index = i;
     if(!default_collision_matrix_.getEntryIndex(link->getName(), lg->index)) {
       ROS_WARN_STREAM("Link " << link->getName() << " not in provided collision matrix");
     } 
@@ -204,8 +219,11 @@ void collision_space::EnvironmentModelODE::createODERobotModel()
     dGeomID padd_g = createODEGeom(model_geom_.env_space, model_geom_.storage, link->getLinkShape(), robot_scale_, padd);
     assert(padd_g);
     lg->padded_geom.push_back(padd_g);
+    lg->padded_variants.push_back(PaddedGeomVariants());
+    lg->padded_variants.back()[padd] = padd_g;
     geom_lookup_map_[padd_g] = std::pair<std::string, BodyType>(link->getName(), LINK);
-    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = link->getAttachedBodyModels();
+    lg->attached_body_models = link->getAttachedBodyModelSet();
+    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->attached_body_models->models;
     for (unsigned int j = 0 ; j < attached_bodies.size() ; ++j) {
       padd = default_robot_padding_;
       if(default_link_padding_map_.find(attached_bodies[j]->getName()) != default_link_padding_map_.end()) {
@@ -217,6 +235,8 @@ void collision_space::EnvironmentModelODE::createODERobotModel()
     }
     model_geom_.link_geom.push_back(lg);
   } 
+  model_geom_.bound_state_model = NULL;
+  model_geom_.link_poses_valid = false;
 }
 
 dGeomID collision_space::EnvironmentModelODE::createODEGeom(dSpaceID space, ODEStorage &storage, const shapes::StaticShape *shape)
@@ -339,6 +359,18 @@ void collision_space::EnvironmentModelODE::updateGeom(dGeomID geom,  const tf::T
   dGeomSetQuaternion(geom, q);
 }
 
+void collision_space::EnvironmentModelODE::updateGeoms(dGeomID geom, dGeomID padded_geom, const tf::Transform &pose) const
+{
+  const tf::Vector3& pos = pose.getOrigin();
+  tf::Quaternion quat = pose.getRotation();
+  dQuaternion q; 
+  q[0] = quat.getW(); q[1] = quat.getX(); q[2] = quat.getY(); q[3] = quat.getZ();
+  dGeomSetPosition(geom, pos.getX(), pos.getY(), pos.getZ());
+  dGeomSetQuaternion(geom, q);
+  dGeomSetPosition(padded_geom, pos.getX(), pos.getY(), pos.getZ());
+  dGeomSetQuaternion(padded_geom, q);
+}
+
 void collision_space::EnvironmentModelODE::updateAttachedBodies()
 {
   updateAttachedBodies(default_link_padding_map_);
@@ -363,14 +395,18 @@ void collision_space::EnvironmentModelODE::updateAttachedBodies(const std::map<s
       for(unsigned int k = 0; k < lg->att_bodies[j]->geom.size(); k++) {
         geom_lookup_map_.erase(lg->att_bodies[j]->geom[k]);
       }
-      for(unsigned int k = 0; k < lg->att_bodies[j]->padded_geom.size(); k++) {
-        geom_lookup_map_.erase(lg->att_bodies[j]->padded_geom[k]);
+      for(unsigned int k = 0; k < lg->att_bodies[j]->padded_variants.size(); k++) {
+        const PaddedGeomVariants& variants = lg->att_bodies[j]->padded_variants[k];
+        for(PaddedGeomVariants::const_iterator it = variants.begin(); it != variants.end(); it++) {
+          geom_lookup_map_.erase(it->second);
+        }
       }
     }
     lg->deleteAttachedBodies();
 
     /* create new set of attached bodies */
-    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->link->getAttachedBodyModels();
+    lg->attached_body_models = lg->link->getAttachedBodyModelSet();
+    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->attached_body_models->models;
     for (unsigned int j = 0 ; j < attached_bodies.size(); ++j) {
       double padd = default_robot_padding_;
       if(link_padding_map.find(attached_bodies[j]->getName()) != link_padding_map.end()) {
@@ -382,6 +418,7 @@ void collision_space::EnvironmentModelODE::updateAttachedBodies(const std::map<s
       addAttachedBody(lg, attached_bodies[j], padd);
     }
   }
+  model_geom_.link_poses_valid = false;
 }
 
 void collision_space::EnvironmentModelODE::addAttachedBody(LinkGeom* lg, 
@@ -417,16 +454,46 @@ void collision_space::EnvironmentModelODE::addAttachedBody(LinkGeom* lg,
     dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attm->getShapes()[i], robot_scale_, padd);
     assert(padd_ga);
     attg->padded_geom.push_back(padd_ga);
+    attg->padded_variants.push_back(PaddedGeomVariants());
+    attg->padded_variants.back()[padd] = padd_ga;
     geom_lookup_map_[padd_ga] = std::pair<std::string, BodyType>(attm->getName(), ATTACHED);    
   }
   lg->att_bodies.push_back(attg);
 }
 
+dGeomID collision_space::EnvironmentModelODE::swapPaddedGeom(PaddedGeomVariants& variants, dGeomID current,
+                                                             const shapes::Shape* shape, double padding,
+                                                             const std::string& name, BodyType type)
+{
+  dGeomID g;
+  PaddedGeomVariants::iterator it = variants.find(padding);
+  if(it != variants.end()) {
+    g = it->second;
+    if(g == current) {
+      return current;
+    }
+  } else {
+    g = createODEGeom(0, model_geom_.storage, shape, robot_scale_, padding);
+    assert(g);
+    variants[padding] = g;
+    geom_lookup_map_[g] = std::pair<std::string, BodyType>(name, type);
+  }
+  //the variant takes over the pose of the one it replaces
+  const dReal *pos = dGeomGetPosition(current);
+  dQuaternion q;
+  dGeomGetQuaternion(current, q);
+  dGeomSetPosition(g, pos[0], pos[1], pos[2]);
+  dGeomSetQuaternion(g, q);
+  dSpaceRemove(model_geom_.env_space, current);
+  dSpaceAdd(model_geom_.env_space, g);
+  return g;
+}
+
 void collision_space::EnvironmentModelODE::setAttachedBodiesLinkPadding() {
   for (unsigned int i = 0 ; i < model_geom_.link_geom.size() ; ++i) {
     LinkGeom *lg = model_geom_.link_geom[i];
     
-    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->link->getAttachedBodyModels();
+    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->attached_body_models->models;
     for (unsigned int j = 0 ; j < attached_bodies.size(); ++j) {
       double new_padd = -1.0;
       if(altered_link_padding_map_.find(attached_bodies[j]->getName()) != altered_link_padding_map_.end()) {
@@ -435,14 +502,11 @@ void collision_space::EnvironmentModelODE::setAttachedBodiesLinkPadding() {
         new_padd = altered_link_padding_map_.find("attached")->second;
       }
       if(new_padd != -1.0) {
+        AttGeom* attg = lg->att_bodies[j];
         for(unsigned int k = 0; k < attached_bodies[j]->getShapes().size(); k++) {
-          geom_lookup_map_.erase(lg->att_bodies[j]->padded_geom[k]);
-          dGeomDestroy(lg->att_bodies[j]->padded_geom[k]);
-          model_geom_.storage.remove(lg->att_bodies[j]->padded_geom[k]);
-          dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attached_bodies[j]->getShapes()[k], robot_scale_, new_padd);
-          assert(padd_ga);
-          lg->att_bodies[j]->padded_geom[k] = padd_ga;
-          geom_lookup_map_[padd_ga] = std::pair<std::string, BodyType>(attached_bodies[j]->getName(), ATTACHED);
+          attg->padded_geom[k] = swapPaddedGeom(attg->padded_variants[k], attg->padded_geom[k], 
+                                                attached_bodies[j]->getShapes()[k], new_padd,
+                                                attached_bodies[j]->getName(), ATTACHED);
         }
       }
     }
@@ -453,7 +517,7 @@ void collision_space::EnvironmentModelODE::revertAttachedBodiesLinkPadding() {
   for (unsigned int i = 0 ; i < model_geom_.link_geom.size() ; ++i) {
     LinkGeom *lg = model_geom_.link_geom[i];
     
-    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->link->getAttachedBodyModels();
+    const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->attached_body_models->models;
     for (unsigned int j = 0 ; j < attached_bodies.size(); ++j) {
       double new_padd = -1.0;
       if(altered_link_padding_map_.find(attached_bodies[j]->getName()) != altered_link_padding_map_.end()) {
@@ -462,14 +526,11 @@ void collision_space::EnvironmentModelODE::revertAttachedBodiesLinkPadding() {
         new_padd = default_link_padding_map_.find("attached")->second;
       }
       if(new_padd != -1.0) {
+        AttGeom* attg = lg->att_bodies[j];
         for(unsigned int k = 0; k < attached_bodies[j]->getShapes().size(); k++) {
-          geom_lookup_map_.erase(lg->att_bodies[j]->padded_geom[k]);
-          dGeomDestroy(lg->att_bodies[j]->padded_geom[k]);
-          model_geom_.storage.remove(lg->att_bodies[j]->padded_geom[k]);
-          dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attached_bodies[j]->getShapes()[k], robot_scale_, new_padd);
-          assert(padd_ga);
-          lg->att_bodies[j]->padded_geom[k] = padd_ga;
-          geom_lookup_map_[padd_ga] = std::pair<std::string, BodyType>(attached_bodies[j]->getName(), ATTACHED);
+          attg->padded_geom[k] = swapPaddedGeom(attg->padded_variants[k], attg->padded_geom[k], 
+                                                attached_bodies[j]->getShapes()[k], new_padd,
+                                                attached_bodies[j]->getName(), ATTACHED);
         }
       }
     }
@@ -479,23 +540,76 @@ void collision_space::EnvironmentModelODE::revertAttachedBodiesLinkPadding() {
 void collision_space::EnvironmentModelODE::updateRobotModel(const planning_models::KinematicState* state)
 { 
   const unsigned int n = model_geom_.link_geom.size();
-    
+  const std::vector<planning_models::KinematicState::LinkState*>& link_states = state->getLinkStateVector();
+
+  //states of our model or of a copy of it share its link order; anything
+  //else falls back to looking links up by name
+  if(state->getKinematicModel() != model_geom_.bound_state_model) {
+    model_geom_.bound_state_model = state->getKinematicModel();
+    model_geom_.bound_state_indexed = true;
+    for (unsigned int i = 0 ; i < n ; ++i) {
+      unsigned int index = model_geom_.link_geom[i]->link_state_index;
+      if(index >= link_states.size() || link_states[index]->getName() != model_geom_.link_geom[i]->link->getName()) {
+        ROS_DEBUG_STREAM("Link states of state model do not match collision model, looking up links by name");
+        model_geom_.bound_state_indexed = false;
+        break;
+      }
+    }
+    model_geom_.link_poses_valid = false;
+  }
+  if(model_geom_.link_poses.size() != n) {
+    model_geom_.link_poses.resize(n);
+    model_geom_.link_poses_valid = false;
+  }
+
   for (unsigned int i = 0 ; i < n ; ++i) {
-    const planning_models::KinematicState::LinkState* link_state = state->getLinkState(model_geom_.link_geom[i]->link->getName());
+    LinkGeom* lg = model_geom_.link_geom[i];
+    const planning_models::KinematicState::LinkState* link_state;
+    if(model_geom_.bound_state_indexed) {
+      link_state = link_states[lg->link_state_index];
+    } else {
+      link_state = state->getLinkState(lg->link->getName());
+    }
     if(link_state == NULL) {
-      ROS_WARN_STREAM("No link state for link " << model_geom_.link_geom[i]->link->getName());
+      ROS_WARN_STREAM("No link state for link " << lg->link->getName());
       continue;
     }
-    updateGeom(model_geom_.link_geom[i]->geom[0], link_state->getGlobalCollisionBodyTransform());
-    updateGeom(model_geom_.link_geom[i]->padded_geom[0], link_state->getGlobalCollisionBodyTransform());
+    //links that did not move since the last update keep their geoms as they are
+    const tf::Transform& pose = link_state->getGlobalCollisionBodyTransform();
+    if(model_geom_.link_poses_valid && model_geom_.link_poses[i] == pose) {
+      continue;
+    }
+    model_geom_.link_poses[i] = pose;
+    updateGeoms(lg->geom[0], lg->padded_geom[0], pose);
     const std::vector<planning_models::KinematicState::AttachedBodyState*>& attached_bodies = link_state->getAttachedBodyStateVector();
     for (unsigned int j = 0 ; j < attached_bodies.size(); ++j) {
-      for(unsigned int k = 0; k < attached_bodies[j]->getGlobalCollisionBodyTransforms().size(); k++) {
-        updateGeom(model_geom_.link_geom[i]->att_bodies[j]->geom[k], attached_bodies[j]->getGlobalCollisionBodyTransforms()[k]);
-        updateGeom(model_geom_.link_geom[i]->att_bodies[j]->padded_geom[k], attached_bodies[j]->getGlobalCollisionBodyTransforms()[k]);
+      //the state may predate an attach or detach that the geoms already reflect, or the other way around
+      AttGeom* attg = findAttachedGeom(lg, attached_bodies[j]->getName(), j);
+      if(attg == NULL) {
+        continue;
+      }
+      const std::vector<tf::Transform>& attached_poses = attached_bodies[j]->getGlobalCollisionBodyTransforms();
+      for(unsigned int k = 0; k < attached_poses.size() && k < attg->geom.size(); k++) {
+        updateGeoms(attg->geom[k], attg->padded_geom[k], attached_poses[k]);
       }
     }
   }    
+  model_geom_.link_poses_valid = true;
+}
+
+collision_space::EnvironmentModelODE::AttGeom* collision_space::EnvironmentModelODE::findAttachedGeom(LinkGeom* lg, 
+                                                                                                     const std::string& name,
+                                                                                                     unsigned int hint) const
+{
+  if(hint < lg->att_bodies.size() && lg->att_bodies[hint]->att->getName() == name) {
+    return lg->att_bodies[hint];
+  }
+  for(unsigned int i = 0; i < lg->att_bodies.size(); i++) {
+    if(lg->att_bodies[i]->att->getName() == name) {
+      return lg->att_bodies[i];
+    }
+  }
+  return NULL;
 }
 
 void collision_space::EnvironmentModelODE::setAlteredLinkPadding(const std::map<std::string, double>& new_link_padding) {
@@ -517,17 +631,8 @@ void collision_space::EnvironmentModelODE::setAlteredLinkPadding(const std::map<
       ROS_DEBUG_STREAM("Setting padding for link " << lg->link->getName() << " from " 
                        << default_link_padding_map_[lg->link->getName()] 
                        << " to " << new_padding);
-      //otherwise we clear out the data associated with the old one
-      for (unsigned int j = 0 ; j < lg->padded_geom.size() ; ++j) {
-        geom_lookup_map_.erase(lg->padded_geom[j]);
-        dGeomDestroy(lg->padded_geom[j]);
-        model_geom_.storage.remove(lg->padded_geom[j]);
-      }
-      lg->padded_geom.clear();
-      dGeomID g = createODEGeom(model_geom_.env_space, model_geom_.storage, link->getLinkShape(), robot_scale_, new_padding);
-      assert(g);
-      lg->padded_geom.push_back(g);
-      geom_lookup_map_[g] = std::pair<std::string, BodyType>(link->getName(), LINK);
+      lg->padded_geom[0] = swapPaddedGeom(lg->padded_variants[0], lg->padded_geom[0], link->getLinkShape(),
+                                          new_padding, link->getName(), LINK);
     }
   }
   //this does all the work
@@ -546,20 +651,10 @@ void collision_space::EnvironmentModelODE::revertAlteredLinkPadding() {
         ROS_WARN_STREAM("Can't get kinematic model for link " << link->getName() << " to revert to old padding");
         continue;
       }
-      //otherwise we clear out the data associated with the old one
-      for (unsigned int j = 0 ; j < lg->padded_geom.size() ; ++j) {
-        geom_lookup_map_.erase(lg->padded_geom[j]);
-        dGeomDestroy(lg->padded_geom[j]);
-        model_geom_.storage.remove(lg->padded_geom[j]);
-      }
       ROS_DEBUG_STREAM("Reverting padding for link " << lg->link->getName() << " from " << altered_link_padding_map_[lg->link->getName()]
                       << " to " << old_padding);
-      lg->padded_geom.clear();
-      dGeomID g = createODEGeom(model_geom_.env_space, model_geom_.storage, link->getLinkShape(), robot_scale_, old_padding);
-      assert(g);
-      dGeomSetData(g, reinterpret_cast<void*>(lg));
-      lg->padded_geom.push_back(g);
-      geom_lookup_map_[g] = std::pair<std::string, BodyType>(link->getName(), LINK);
+      lg->padded_geom[0] = swapPaddedGeom(lg->padded_variants[0], lg->padded_geom[0], link->getLinkShape(),
+                                          old_padding, link->getName(), LINK);
     }
   }
   revertAttachedBodiesLinkPadding();
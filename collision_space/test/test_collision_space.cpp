@@ -561,6 +561,59 @@ TEST_F(TestCollisionSpace, TestAllowedContacts)
   coll_space_->clearAllowedContacts();
 }
 
+TEST_F(TestCollisionSpace, TestAlteredPadding)
+{
+  std::vector<std::string> links;
+  kinematic_model_->getLinkModelNames(links);
+  std::map<std::string, double> link_padding_map;
+  
+  collision_space::EnvironmentModel::AllowedCollisionMatrix acm(links, false);
+  coll_space_->setRobotModel(kinematic_model_, acm, link_padding_map);  
+
+  planning_models::KinematicState state(kinematic_model_);
+  state.setKinematicStateToDefault();
+  coll_space_->updateRobotModel(&state);
+
+  shapes::Sphere* sphere1 = new shapes::Sphere();
+  sphere1->radius = .1;
+
+  tf::Transform pose;
+  pose.setIdentity();
+  pose.setOrigin(tf::Vector3(.6,0,.1));
+
+  std::vector<tf::Transform> poses;
+  poses.push_back(pose);
+
+  std::vector<shapes::Shape*> shape_vector;
+  shape_vector.push_back(sphere1);
+
+  coll_space_->addObjects("obj1", shape_vector, poses);
+  ASSERT_FALSE(coll_space_->isEnvironmentCollision());
+
+  std::map<std::string, double> altered_padding;
+  altered_padding["base_link"] = .5;
+
+  //the padded variants are created once and swapped afterwards
+  for(unsigned int i = 0; i < 3; i++) {
+    coll_space_->setAlteredLinkPadding(altered_padding);
+    ASSERT_TRUE(coll_space_->isEnvironmentCollision());
+    
+    coll_space_->revertAlteredLinkPadding();
+    ASSERT_FALSE(coll_space_->isEnvironmentCollision());
+  }
+
+  //moving the robot away while the default padding is in use should also move the padded variant
+  std::map<std::string, double> state_values;
+  state.getKinematicStateValues(state_values);
+  state_values["planar_x"] = -2.0;
+  state.setKinematicState(state_values);
+  coll_space_->updateRobotModel(&state);
+
+  coll_space_->setAlteredLinkPadding(altered_padding);
+  ASSERT_FALSE(coll_space_->isEnvironmentCollision());
+  coll_space_->revertAlteredLinkPadding();
+}
+
 TEST_F(TestCollisionSpace, TestThreading)
 {
   boost::thread thread1(boost::bind(&TestCollisionSpace::spinThread, this));
@@ -0,0 +1,73 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef JOINT_NORMALIZATION_UTILS_H_
+#define JOINT_NORMALIZATION_UTILS_H_
+
+#include <vector>
+#include <trajectory_msgs/JointTrajectory.h>
+
+namespace joint_normalization_filters
+{
+
+/**
+ * \brief Copies the positions of all trajectory points into a row-major
+ * (points x joints) matrix. Returns false if a point has the wrong number of positions.
+ */
+bool getPositionMatrix(const trajectory_msgs::JointTrajectory& trajectory,
+                       std::vector<double>& positions);
+
+/**
+ * \brief Copies a row-major (points x joints) matrix back into the positions of the trajectory points
+ */
+void setPositionMatrix(const std::vector<double>& positions,
+                       trajectory_msgs::JointTrajectory& trajectory);
+
+/**
+ * \brief Unwraps the columns of a row-major (points x joints) position matrix in place.
+ *
+ * Every column with a wrap_mask entry of 1.0 is shifted by multiples of 2*pi so
+ * that consecutive rows differ by at most pi; columns with 0.0 are left as they
+ * are. If start is given the first row is unwrapped relative to it, otherwise
+ * the first row is kept. Columns with 0.0 pass through unchanged even if they
+ * hold inf or nan. The inner loop runs over joints and picks the result with a
+ * select rather than a branch so that it can be vectorized.
+ */
+void unwrapPositionMatrix(std::vector<double>& positions,
+                          const std::vector<double>& wrap_mask,
+                          const std::vector<double>* start = NULL);
+
+}
+
+#endif /* JOINT_NORMALIZATION_UTILS_H_ */
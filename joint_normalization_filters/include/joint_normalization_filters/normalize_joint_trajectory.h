@@ -39,7 +39,7 @@
 
 #include <spline_smoother/spline_smoother.h>
 #include <spline_smoother/spline_smoother_utils.h>
-#include <angles/angles.h>
+#include <joint_normalization_filters/joint_normalization_utils.h>
 
 namespace joint_normalization_filters
 {
@@ -71,19 +71,24 @@ bool NormalizeJointTrajectory<T>::smooth(const T& data_in,
   if (!spline_smoother::checkTrajectoryConsistency(data_out))
     return false;
 
+  std::vector<double> wrap_mask(num_joints, 0.0);
+  bool has_continuous = false;
   for (int i=0; i<num_joints; ++i)
   {
     if (!data_out.request.limits[i].has_position_limits)
     {
-      for (int j=1; j<size; ++j)
-      {
-        double& cur = data_out.request.trajectory.points[j].positions[i];
-        double prev = data_out.request.trajectory.points[j-1].positions[i];
-
-        cur = prev + angles::shortest_angular_distance(prev, cur);
-      }
+      wrap_mask[i] = 1.0;
+      has_continuous = true;
     }
   }
+  if (!has_continuous || size < 2)
+    return true;
+
+  std::vector<double> positions;
+  if (!getPositionMatrix(data_out.request.trajectory, positions))
+    return false;
+  unwrapPositionMatrix(positions, wrap_mask);
+  setPositionMatrix(positions, data_out.request.trajectory);
   return true;
 }
 
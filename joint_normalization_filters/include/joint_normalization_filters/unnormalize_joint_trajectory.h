@@ -42,6 +42,7 @@
 #include <sensor_msgs/JointState.h>
 #include <spline_smoother/spline_smoother.h>
 #include <spline_smoother/spline_smoother_utils.h>
+#include <joint_normalization_filters/joint_normalization_utils.h>
 
 namespace joint_normalization_filters
 {
@@ -62,6 +63,9 @@ private:
   //! Flag that tells us if the robot model was initialized successfully
   bool robot_model_initialized_;
 
+  //! Whether each joint in the robot model is continuous, computed once at construction
+  std::map<std::string, bool> continuous_joint_map_;
+
 public:
   UnNormalizeJointTrajectory();
   virtual ~UnNormalizeJointTrajectory();
@@ -84,6 +88,11 @@ UnNormalizeJointTrajectory<T>::UnNormalizeJointTrajectory()
   {
     robot_model_.initString(full_urdf_xml);
     robot_model_initialized_ = true;
+    for (std::map<std::string, boost::shared_ptr<urdf::Joint> >::const_iterator it = robot_model_.joints_.begin();
+         it != robot_model_.joints_.end(); ++it)
+    {
+      continuous_joint_map_[it->first] = (it->second->type == urdf::Joint::CONTINUOUS);
+    }
   }
 }
 
@@ -117,11 +126,11 @@ bool UnNormalizeJointTrajectory<T>::smooth(const T& trajectory_in,
   }
 
   std::vector<double> current_values;
-  std::vector<int> wraparound;
-  trajectory_msgs::JointTrajectory input_trajectory = trajectory_in.request.trajectory;
+  std::vector<double> wrap_mask;
+  const trajectory_msgs::JointTrajectory& input_trajectory = trajectory_in.request.trajectory;
   for (size_t i=0; i<input_trajectory.joint_names.size(); i++)
   {
-    std::string name = input_trajectory.joint_names[i];
+    const std::string& name = input_trajectory.joint_names[i];
     if(joint_values.find(name) == joint_values.end()) {
       ROS_WARN_STREAM("No value set in start state for joint name " << name);
       return false;
@@ -129,34 +138,22 @@ bool UnNormalizeJointTrajectory<T>::smooth(const T& trajectory_in,
     //first waypoint is unnormalized relative to current joint states
     current_values.push_back(joint_values[name]);
     
-    boost::shared_ptr<const urdf::Joint> joint = robot_model_.getJoint(name);
-    if (joint.get() == NULL)
+    std::map<std::string, bool>::const_iterator joint_it = continuous_joint_map_.find(name);
+    if (joint_it == continuous_joint_map_.end())
     {
       ROS_ERROR("Joint name %s not found in urdf model", name.c_str());
       return false;
     }
-    if (joint->type == urdf::Joint::CONTINUOUS) wraparound.push_back(1);
-    else wraparound.push_back(0);
+    wrap_mask.push_back(joint_it->second ? 1.0 : 0.0);
   }
 
-  trajectory_msgs::JointTrajectory normalized_trajectory = input_trajectory;
-  for (size_t i=0; i<normalized_trajectory.points.size(); i++)
-  {
-    for (size_t j=0; j<normalized_trajectory.points[i].positions.size(); j++ )
-    {
-      if (!wraparound.at(j)) continue;
-      double current = current_values.at(j);
-      double traj = normalized_trajectory.points[i].positions[j];
-      while ( current - traj > M_PI ) traj += 2*M_PI;
-      while ( traj - current > M_PI ) traj -= 2*M_PI;
-      ROS_DEBUG("Normalizing joint %s from %f to %f", normalized_trajectory.joint_names.at(j).c_str(), 
-                normalized_trajectory.points[i].positions[j], traj);
-      normalized_trajectory.points[i].positions[j] = traj;
-      //all other waypoints are unnormalized relative to the previous waypoint
-      current_values.at(j) = traj;
-    }  
-  }
-  trajectory_out.request.trajectory = normalized_trajectory;
+  //the first waypoint is unnormalized relative to the current joint states,
+  //all other waypoints relative to the previous waypoint
+  std::vector<double> positions;
+  if (!getPositionMatrix(trajectory_out.request.trajectory, positions))
+    return false;
+  unwrapPositionMatrix(positions, wrap_mask, &current_values);
+  setPositionMatrix(positions, trajectory_out.request.trajectory);
   return true;
 }
 }
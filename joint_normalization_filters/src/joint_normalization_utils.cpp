@@ -0,0 +1,104 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2009, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <joint_normalization_filters/joint_normalization_utils.h>
+#include <algorithm>
+#include <cmath>
+
+namespace joint_normalization_filters
+{
+
+bool getPositionMatrix(const trajectory_msgs::JointTrajectory& trajectory,
+                       std::vector<double>& positions)
+{
+  unsigned int num_joints = trajectory.joint_names.size();
+  unsigned int num_points = trajectory.points.size();
+  positions.resize(num_joints*num_points);
+  for (unsigned int i=0; i<num_points; ++i)
+  {
+    if (trajectory.points[i].positions.size() != num_joints)
+      return false;
+    std::copy(trajectory.points[i].positions.begin(), trajectory.points[i].positions.end(),
+              positions.begin()+i*num_joints);
+  }
+  return true;
+}
+
+void setPositionMatrix(const std::vector<double>& positions,
+                       trajectory_msgs::JointTrajectory& trajectory)
+{
+  unsigned int num_joints = trajectory.joint_names.size();
+  for (unsigned int i=0; i<trajectory.points.size(); ++i)
+  {
+    trajectory.points[i].positions.assign(positions.begin()+i*num_joints,
+                                          positions.begin()+(i+1)*num_joints);
+  }
+}
+
+void unwrapPositionMatrix(std::vector<double>& positions,
+                          const std::vector<double>& wrap_mask,
+                          const std::vector<double>* start)
+{
+  const unsigned int num_joints = wrap_mask.size();
+  if (num_joints == 0 || positions.size() < num_joints)
+    return;
+  const unsigned int num_points = positions.size()/num_joints;
+  const double two_pi = 2.0*M_PI;
+  const double inv_two_pi = 1.0/two_pi;
+  const double* mask = &wrap_mask[0];
+
+  double* row = &positions[0];
+  const double* prev = start ? &(*start)[0] : NULL;
+  unsigned int first = 0;
+  if (prev == NULL)
+  {
+    prev = row;
+    row += num_joints;
+    first = 1;
+  }
+
+  for (unsigned int i=first; i<num_points; ++i)
+  {
+    for (unsigned int j=0; j<num_joints; ++j)
+    {
+      // select instead of multiplying by the mask, since 0*inf and 0*nan are nan
+      double unwrapped = row[j] - two_pi*floor((row[j] - prev[j])*inv_two_pi + 0.5);
+      row[j] = mask[j] != 0.0 ? unwrapped : row[j];
+    }
+    prev = row;
+    row += num_joints;
+  }
+}
+
+}
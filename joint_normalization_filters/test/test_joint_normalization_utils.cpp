@@ -0,0 +1,185 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <joint_normalization_filters/joint_normalization_utils.h>
+#include <cmath>
+#include <limits>
+
+using namespace joint_normalization_filters;
+
+static const double EPS = 1e-9;
+
+TEST(TestJointNormalizationUtils, ContinuousJointCrossesPi)
+{
+  std::vector<double> mask(1, 1.0);
+
+  // going up through pi
+  std::vector<double> positions;
+  positions.push_back(3.0);
+  positions.push_back(-3.0);
+  unwrapPositionMatrix(positions, mask);
+  EXPECT_NEAR(positions[0], 3.0, EPS);
+  EXPECT_NEAR(positions[1], 2.0*M_PI - 3.0, EPS);
+
+  // going down through -pi
+  positions[0] = -3.0;
+  positions[1] = 3.0;
+  unwrapPositionMatrix(positions, mask);
+  EXPECT_NEAR(positions[0], -3.0, EPS);
+  EXPECT_NEAR(positions[1], 3.0 - 2.0*M_PI, EPS);
+
+  // several turns away
+  positions[0] = 0.1;
+  positions[1] = 0.2 + 6.0*M_PI;
+  unwrapPositionMatrix(positions, mask);
+  EXPECT_NEAR(positions[1], 0.2, EPS);
+}
+
+TEST(TestJointNormalizationUtils, NonContinuousJointUntouched)
+{
+  std::vector<double> mask;
+  mask.push_back(0.0);
+  mask.push_back(1.0);
+
+  std::vector<double> positions;
+  positions.push_back(3.0);
+  positions.push_back(3.0);
+  positions.push_back(-3.0);
+  positions.push_back(-3.0);
+  unwrapPositionMatrix(positions, mask);
+  EXPECT_EQ(positions[0], 3.0);
+  EXPECT_EQ(positions[2], -3.0);
+  EXPECT_NEAR(positions[1], 3.0, EPS);
+  EXPECT_NEAR(positions[3], 2.0*M_PI - 3.0, EPS);
+}
+
+TEST(TestJointNormalizationUtils, MultiPointTrajectory)
+{
+  trajectory_msgs::JointTrajectory trajectory;
+  trajectory.joint_names.push_back("fixed_joint");
+  trajectory.joint_names.push_back("continuous_joint");
+  std::vector<double> mask;
+  mask.push_back(0.0);
+  mask.push_back(1.0);
+
+  // the continuous joint turns steadily through several wraps of its normalized value
+  const unsigned int num_points = 20;
+  const double step = 0.9;
+  trajectory.points.resize(num_points);
+  for (unsigned int i=0; i<num_points; ++i)
+  {
+    double angle = 2.5 + i*step;
+    trajectory.points[i].positions.push_back(0.1*i);
+    trajectory.points[i].positions.push_back(atan2(sin(angle), cos(angle)));
+  }
+
+  std::vector<double> positions;
+  ASSERT_TRUE(getPositionMatrix(trajectory, positions));
+  ASSERT_EQ(positions.size(), 2*num_points);
+  unwrapPositionMatrix(positions, mask);
+  setPositionMatrix(positions, trajectory);
+
+  for (unsigned int i=0; i<num_points; ++i)
+  {
+    ASSERT_EQ(trajectory.points[i].positions.size(), 2u);
+    EXPECT_NEAR(trajectory.points[i].positions[0], 0.1*i, EPS);
+    EXPECT_NEAR(trajectory.points[i].positions[1], 2.5 + i*step, EPS);
+  }
+}
+
+TEST(TestJointNormalizationUtils, UnwrapRelativeToStart)
+{
+  std::vector<double> mask;
+  mask.push_back(1.0);
+  mask.push_back(0.0);
+  std::vector<double> start;
+  start.push_back(3.0 + 2.0*M_PI);
+  start.push_back(3.0);
+
+  // without a start the first row is kept, with one it is moved next to the start
+  std::vector<double> positions;
+  positions.push_back(-3.0);
+  positions.push_back(-3.0);
+  positions.push_back(-2.5);
+  positions.push_back(-2.5);
+  unwrapPositionMatrix(positions, mask, &start);
+  EXPECT_NEAR(positions[0], 4.0*M_PI - 3.0, EPS);
+  EXPECT_NEAR(positions[2], 4.0*M_PI - 2.5, EPS);
+  EXPECT_EQ(positions[1], -3.0);
+  EXPECT_EQ(positions[3], -2.5);
+}
+
+TEST(TestJointNormalizationUtils, NonFiniteValuesInNonContinuousJoint)
+{
+  const double inf = std::numeric_limits<double>::infinity();
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  std::vector<double> mask;
+  mask.push_back(0.0);
+  mask.push_back(1.0);
+
+  // the non-continuous column has to pass through as is, and must not affect the continuous one
+  std::vector<double> positions;
+  positions.push_back(inf);
+  positions.push_back(3.0);
+  positions.push_back(nan);
+  positions.push_back(-3.0);
+  positions.push_back(-inf);
+  positions.push_back(-2.5);
+  unwrapPositionMatrix(positions, mask);
+  EXPECT_EQ(positions[0], inf);
+  EXPECT_TRUE(positions[2] != positions[2]);
+  EXPECT_EQ(positions[4], -inf);
+  EXPECT_NEAR(positions[1], 3.0, EPS);
+  EXPECT_NEAR(positions[3], 2.0*M_PI - 3.0, EPS);
+  EXPECT_NEAR(positions[5], 2.0*M_PI - 2.5, EPS);
+}
+
+TEST(TestJointNormalizationUtils, PositionMatrixRejectsBadPoints)
+{
+  trajectory_msgs::JointTrajectory trajectory;
+  trajectory.joint_names.push_back("a");
+  trajectory.joint_names.push_back("b");
+  trajectory.points.resize(2);
+  trajectory.points[0].positions.resize(2, 0.0);
+  trajectory.points[1].positions.resize(1, 0.0);
+  std::vector<double> positions;
+  EXPECT_FALSE(getPositionMatrix(trajectory, positions));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
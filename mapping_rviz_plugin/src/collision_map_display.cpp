@@ -37,6 +37,9 @@
 
 #include <boost/bind.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 #include <OGRE/OgreSceneNode.h>
 #include <OGRE/OgreSceneManager.h>
 #include <OGRE/OgreBillboardSet.h>
@@ -46,6 +49,7 @@
 #include <rviz/properties/string_property.h>
 #include <rviz/properties/bool_property.h>
 #include <rviz/properties/float_property.h>
+#include <rviz/properties/int_property.h>
 #include <rviz/properties/ros_topic_property.h>
 #include <rviz/properties/enum_property.h>
 #include <rviz/properties/color_property.h>
@@ -53,11 +57,50 @@
 namespace mapping_rviz_plugin
 {
 
+namespace
+{
+// cells are addressed by 21 bits per axis, offset so that keys are unsigned
+const int KEY_BITS = 21;
+const int64_t KEY_OFFSET = 1 << (KEY_BITS - 1);
+const int64_t KEY_MAX = (1 << KEY_BITS) - 1;
+
+// blocks are 16 cells on a side
+const int BLOCK_SHIFT = 4;
+
+const unsigned int MAX_AGGREGATION = 64;
+
+typedef std::pair<uint64_t, Ogre::Vector3> CellEntry;
+typedef std::vector<CellEntry> V_CellEntry;
+
+inline uint64_t packKey(uint64_t x, uint64_t y, uint64_t z)
+{
+  return (x << (2 * KEY_BITS)) | (y << KEY_BITS) | z;
+}
+
+inline bool cellKeyLess(const CellEntry& a, const CellEntry& b)
+{
+  return a.first < b.first;
+}
+
+inline bool cellKeyEqual(const CellEntry& a, const CellEntry& b)
+{
+  return a.first == b.first;
+}
+}
+
 CollisionMapDisplay::CollisionMapDisplay()
   : Display()
   , color_(0.1f, 1.0f, 0.0f)
   , render_operation_(collision_render_ops::CBoxes)
   , override_color_(false)
+  , point_size_(0.01f)
+  , alpha_(1.0f)
+  , aggregation_(1)
+  , max_points_(200000)
+  , block_resolution_(0.0)
+  , block_aggregation_(1)
+  , cell_dimensions_(Ogre::Vector3::ZERO)
+  , geometry_dirty_(true)
   , tf_filter_(NULL)
 {
   override_color_property_ = new rviz::BoolProperty ("Override Color", false, "", this, SLOT (changedOverrideColor() ), this);
@@ -75,6 +118,16 @@ CollisionMapDisplay::CollisionMapDisplay()
   
   point_size_property_ = new rviz::FloatProperty ("Point Size", 0.01f, "", this,
                                                   SLOT( changedPointSize() ), this);
+
+  aggregation_property_ = new rviz::IntProperty ("Aggregation", 1,
+                                                 "Number of cells along each axis merged into one rendered voxel.",
+                                                 this, SLOT( changedLevelOfDetail() ), this);
+  aggregation_property_->setMin(1);
+
+  max_points_property_ = new rviz::IntProperty ("Max Points", 200000,
+                                                "Voxels are aggregated further while the map has more cells than this. 0 disables the limit.",
+                                                this, SLOT( changedLevelOfDetail() ), this);
+  max_points_property_->setMin(0);
   
   topic_property_ = new rviz::RosTopicProperty("Topic", "", ros::message_traits::datatype<arm_navigation_msgs::CollisionMap>(), "", this,
                                                SLOT(changedTopic()), this);
@@ -90,11 +143,6 @@ void CollisionMapDisplay::onInitialize()
   std::stringstream ss;
   ss << "Collision Map" << count++;
 
-  cloud_ = new rviz::PointCloud();
-  alpha_ = 1.0f;
-  cloud_->setAlpha(alpha_);
-  scene_node_->attachObject(cloud_);
-
   tf_filter_->connectInput(sub_);
   tf_filter_->registerCallback(boost::bind(&CollisionMapDisplay::incomingMessage, this, _1));
 }
@@ -105,12 +153,71 @@ CollisionMapDisplay::~CollisionMapDisplay()
   clear();
 
   delete tf_filter_;
-  delete cloud_;
 }
 
 void CollisionMapDisplay::clear()
 {
-  cloud_->clear();
+  destroyBlocks();
+  geometry_dirty_ = true;
+}
+
+rviz::PointCloud* CollisionMapDisplay::createCloud()
+{
+  rviz::PointCloud* cloud = new rviz::PointCloud();
+  if(render_operation_ == collision_render_ops::CPoints) {
+    cloud->setRenderMode(rviz::PointCloud::RM_SPHERES);
+  } else {
+    cloud->setRenderMode(rviz::PointCloud::RM_BOXES);
+  }
+  cloud->setDimensions(cell_dimensions_.x, cell_dimensions_.y, cell_dimensions_.z);
+  cloud->setAlpha(alpha_);
+  scene_node_->attachObject(cloud);
+  return cloud;
+}
+
+void CollisionMapDisplay::destroyBlocks()
+{
+  for(M_MapBlock::iterator it = blocks_.begin(); it != blocks_.end(); it++) {
+    if(it->second.cloud) {
+      scene_node_->detachObject(it->second.cloud);
+      delete it->second.cloud;
+    }
+  }
+  blocks_.clear();
+}
+
+void CollisionMapDisplay::fillBlock(MapBlock& block, const std::vector<std::pair<uint64_t, Ogre::Vector3> >& cells)
+{
+  if(!block.cloud) {
+    block.cloud = createCloud();
+  }
+  block.cloud->clear();
+  block.keys.resize(cells.size());
+
+  std::vector<rviz::PointCloud::Point> points(cells.size());
+  Ogre::ColourValue color(color_.r_, color_.g_, color_.b_, alpha_);
+  for(unsigned int i = 0; i < cells.size(); i++) {
+    block.keys[i] = cells[i].first;
+    points[i].position = cells[i].second;
+    points[i].color = color;
+  }
+  if(!points.empty()) {
+    block.cloud->addPoints(&points.front(), points.size());
+  }
+}
+
+unsigned int CollisionMapDisplay::computeAggregation(unsigned int num_cells) const
+{
+  unsigned int aggregation = std::max(aggregation_, 1);
+  if(max_points_ <= 0) {
+    return aggregation;
+  }
+  //maps are mostly surfaces, so merging k cells per axis removes roughly k^2 of them
+  while(aggregation < MAX_AGGREGATION &&
+        num_cells / (aggregation * aggregation) > (unsigned int) max_points_) {
+    aggregation *= 2;
+  }
+  return aggregation;
 }
 
 void CollisionMapDisplay::changedTopic()
@@ -126,6 +233,7 @@ void CollisionMapDisplay::changedColor(void)
                        color_property_->getColor().greenF(),
                        color_property_->getColor().blueF());
   
+  geometry_dirty_ = true;
   processMessage(current_message_);
 }
 
@@ -133,32 +241,39 @@ void CollisionMapDisplay::changedOverrideColor(void)
 {
   override_color_ = override_color_property_->getBool();
   
+  geometry_dirty_ = true;
   processMessage(current_message_);
 }
 
 void CollisionMapDisplay::changedRenderOperation(void)
 {
   render_operation_ = render_operation_property_->getOptionInt();
-  
-  if(render_operation_ == collision_render_ops::CPoints) {
-    cloud_->setRenderMode(rviz::PointCloud::RM_SPHERES);
-  } else {
-    cloud_->setRenderMode(rviz::PointCloud::RM_BOXES);
-  }
 
+  geometry_dirty_ = true;
   processMessage(current_message_);
 }
 
 void CollisionMapDisplay::changedPointSize(void)
 {
   point_size_ = point_size_property_->getFloat();
-  cloud_->setDimensions(point_size_, point_size_, point_size_);
+
+  //cell dimensions are only worked out when the blocks are rebuilt
+  geometry_dirty_ = true;
+  processMessage(current_message_);
 }
 
 void CollisionMapDisplay::changedAlpha()
 {
   alpha_ = alpha_property_->getFloat();
-  cloud_->setAlpha(alpha_);
+  geometry_dirty_ = true;
+  processMessage(current_message_);
+}
+
+void CollisionMapDisplay::changedLevelOfDetail()
+{
+  aggregation_ = aggregation_property_->getInt();
+  max_points_ = max_points_property_->getInt();
+  geometry_dirty_ = true;
   processMessage(current_message_);
 }
 
@@ -203,14 +318,16 @@ void CollisionMapDisplay::update(float wall_dt, float ros_dt)
 
 void CollisionMapDisplay::processMessage(const arm_navigation_msgs::CollisionMap::ConstPtr& msg)
 {
-  clear();
-
   if (!msg)
   {
+    clear();
     return;
   }
 
-  if(msg->boxes.size() == 0) return;
+  if(msg->boxes.size() == 0) {
+    clear();
+    return;
+  }
 
   Ogre::Vector3 position;
   Ogre::Quaternion orientation;
@@ -222,38 +339,98 @@ void CollisionMapDisplay::processMessage(const arm_navigation_msgs::CollisionMap
   scene_node_->setPosition( position );
   scene_node_->setOrientation( orientation );
 
-  Ogre::ColourValue color;
-
   unsigned int num_boxes = msg->boxes.size();
   ROS_DEBUG("Collision map contains %d boxes.", num_boxes); 
 
-  typedef std::vector<rviz::PointCloud::Point> V_Point;
-  V_Point points;
-  points.resize(num_boxes);
-  //use first box extents
+  //use first box extents, or the point size for boxes without any
+  Ogre::Vector3 extents(msg->boxes[0].extents.x, msg->boxes[0].extents.y, msg->boxes[0].extents.z);
+  if(extents.x <= 0.0) {
+    extents = Ogre::Vector3(point_size_, point_size_, point_size_);
+  }
+  double resolution = extents.x;
+  unsigned int aggregation = computeAggregation(num_boxes);
+
+  //the block layout is only valid for one resolution and aggregation level
+  if(geometry_dirty_ || resolution != block_resolution_ || aggregation != block_aggregation_) {
+    destroyBlocks();
+    block_resolution_ = resolution;
+    block_aggregation_ = aggregation;
+    cell_dimensions_ = extents * (Ogre::Real)aggregation;
+    geometry_dirty_ = false;
+  }
 
-  cloud_->setDimensions(msg->boxes[0].extents.x,
-                        msg->boxes[0].extents.y,
-                        msg->boxes[0].extents.z);
+  double cell_size = resolution * aggregation;
+  std::map<uint64_t, V_CellEntry> incoming;
+  std::map<uint64_t, V_CellEntry>::iterator last_block = incoming.end();
+  uint64_t last_block_key = 0;
   for (uint32_t i = 0; i < num_boxes; i++)
   {
-    rviz::PointCloud::Point & current_point = points[i];
-    
-    current_point.position.x = msg->boxes[i].center.x;
-    current_point.position.y = msg->boxes[i].center.y;
-    current_point.position.z = msg->boxes[i].center.z;
-    current_point.color = Ogre::ColourValue(color_.r_, color_.g_, color_.b_, alpha_);
+    const geometry_msgs::Point32& center = msg->boxes[i].center;
+    int64_t x = (int64_t) floor(center.x / cell_size) + KEY_OFFSET;
+    int64_t y = (int64_t) floor(center.y / cell_size) + KEY_OFFSET;
+    int64_t z = (int64_t) floor(center.z / cell_size) + KEY_OFFSET;
+    if(x < 0 || y < 0 || z < 0 || x > KEY_MAX || y > KEY_MAX || z > KEY_MAX) {
+      continue;
+    }
+
+    Ogre::Vector3 cell_position;
+    if(aggregation == 1) {
+      cell_position = Ogre::Vector3(center.x, center.y, center.z);
+    } else {
+      cell_position = Ogre::Vector3((x - KEY_OFFSET + 0.5) * cell_size,
+                                    (y - KEY_OFFSET + 0.5) * cell_size,
+                                    (z - KEY_OFFSET + 0.5) * cell_size);
+    }
+
+    //consecutive cells almost always share a block
+    uint64_t block_key = packKey(x >> BLOCK_SHIFT, y >> BLOCK_SHIFT, z >> BLOCK_SHIFT);
+    if(last_block == incoming.end() || block_key != last_block_key) {
+      last_block = incoming.insert(std::make_pair(block_key, V_CellEntry())).first;
+      last_block_key = block_key;
+    }
+    last_block->second.push_back(CellEntry(packKey(x, y, z), cell_position));
   }
-  cloud_->clear();
-  
-  if (!points.empty())
-  {
-    cloud_->addPoints(&points.front(), points.size());
+
+  //blocks that are no longer present are dropped
+  for(M_MapBlock::iterator it = blocks_.begin(); it != blocks_.end();) {
+    if(incoming.find(it->first) == incoming.end()) {
+      scene_node_->detachObject(it->second.cloud);
+      delete it->second.cloud;
+      blocks_.erase(it++);
+    } else {
+      it++;
+    }
+  }
+
+  //only blocks whose cell set changed are re-uploaded
+  unsigned int num_updated = 0;
+  for(std::map<uint64_t, V_CellEntry>::iterator it = incoming.begin(); it != incoming.end(); it++) {
+    V_CellEntry& cells = it->second;
+    std::sort(cells.begin(), cells.end(), cellKeyLess);
+    cells.erase(std::unique(cells.begin(), cells.end(), cellKeyEqual), cells.end());
+
+    MapBlock& block = blocks_[it->first];
+    if(block.cloud && block.keys.size() == cells.size()) {
+      bool same = true;
+      for(unsigned int i = 0; i < cells.size(); i++) {
+        if(block.keys[i] != cells[i].first) {
+          same = false;
+          break;
+        }
+      }
+      if(same) {
+        continue;
+      }
+    }
+    fillBlock(block, cells);
+    num_updated++;
   }
+  ROS_DEBUG("Updated %u of %u collision map blocks", num_updated, (unsigned int) blocks_.size());
 }
 
 void CollisionMapDisplay::incomingMessage(const arm_navigation_msgs::CollisionMap::ConstPtr& message)
 {
+  current_message_ = message;
   processMessage(message);
 }
 
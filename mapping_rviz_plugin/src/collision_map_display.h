@@ -39,10 +39,16 @@
 #include <boost/thread/mutex.hpp>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <map>
+#include <vector>
 
 #include <arm_navigation_msgs/OrientedBoundingBox.h>
 #include <arm_navigation_msgs/CollisionMap.h>
 
+#include <OGRE/OgreVector3.h>
+
 #include <message_filters/subscriber.h>
 #include <tf/message_filter.h>
 
@@ -54,6 +60,7 @@ class RosTopicProperty;
 class BoolProperty;
 class EnumProperty;
 class FloatProperty;
+class IntProperty;
 }
 
 namespace Ogre
@@ -95,7 +102,7 @@ public:
   void changedRenderOperation();
   void changedPointSize();
   void changedAlpha();
-
+  void changedLevelOfDetail();
 
   virtual void update(float wall_dt, float ros_dt);
   virtual void reset();
@@ -107,6 +114,26 @@ protected:
   void incomingMessage(const arm_navigation_msgs::CollisionMap::ConstPtr& message);
   void processMessage(const arm_navigation_msgs::CollisionMap::ConstPtr& message);
 
+  /**
+   * \brief A spatial block of the map, rendered by its own point cloud.
+   *
+   * Cells are binned into fixed-size blocks so that an incoming map only
+   * re-uploads the vertex buffers of the blocks whose cell set changed.
+   */
+  struct MapBlock
+  {
+    MapBlock() : cloud(NULL) {}
+
+    std::vector<uint64_t> keys;
+    rviz::PointCloud* cloud;
+  };
+  typedef std::map<uint64_t, MapBlock> M_MapBlock;
+
+  rviz::PointCloud* createCloud();
+  void destroyBlocks();
+  void fillBlock(MapBlock& block, const std::vector<std::pair<uint64_t, Ogre::Vector3> >& cells);
+  unsigned int computeAggregation(unsigned int num_cells) const;
+
   // overrides from Display
   virtual void onEnable();
   virtual void onDisable();
@@ -118,9 +145,16 @@ protected:
   bool override_color_;
   float point_size_;
   float alpha_;
+  int aggregation_;
+  int max_points_;
 
   Ogre::SceneNode* scene_node_;
-  rviz::PointCloud* cloud_;
+
+  M_MapBlock blocks_;
+  double block_resolution_;
+  unsigned int block_aggregation_;
+  Ogre::Vector3 cell_dimensions_;
+  bool geometry_dirty_;
 
   arm_navigation_msgs::CollisionMap::ConstPtr current_message_;
   message_filters::Subscriber<arm_navigation_msgs::CollisionMap> sub_;
@@ -132,6 +166,8 @@ protected:
   rviz::EnumProperty* render_operation_property_;
   rviz::FloatProperty* point_size_property_;
   rviz::FloatProperty* alpha_property_;
+  rviz::IntProperty* aggregation_property_;
+  rviz::IntProperty* max_points_property_;
 };
 
 } // namespace mapping_rviz_plugin
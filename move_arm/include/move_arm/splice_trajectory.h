@@ -0,0 +1,183 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVE_ARM_SPLICE_TRAJECTORY_
+#define MOVE_ARM_SPLICE_TRAJECTORY_
+
+#include <algorithm>
+#include <vector>
+#include <trajectory_msgs/JointTrajectory.h>
+#include <spline_smoother/splines.h>
+
+namespace move_arm
+{
+
+/// Samples a trajectory at a time from start, interpolating between points
+/// with the quintic through their positions, velocities and accelerations,
+/// as the joint trajectory controller does.  Missing velocities and
+/// accelerations count as zero.  Before its first point and after its last
+/// one the trajectory rests there
+inline void sampleTrajectory(const trajectory_msgs::JointTrajectory &trajectory, double time,
+                             std::vector<double> &positions,
+                             std::vector<double> &velocities,
+                             std::vector<double> &accelerations)
+{
+  const std::vector<trajectory_msgs::JointTrajectoryPoint> &points = trajectory.points;
+  const unsigned int n = trajectory.joint_names.size();
+  positions.assign(n, 0.0);
+  velocities.assign(n, 0.0);
+  accelerations.assign(n, 0.0);
+  if(points.empty())
+    return;
+  if(points.size() == 1 || time < points.front().time_from_start.toSec() || time > points.back().time_from_start.toSec())
+  {
+    const trajectory_msgs::JointTrajectoryPoint &rest = time < points.front().time_from_start.toSec() ? points.front() : points.back();
+    for(unsigned int j = 0; j < n && j < rest.positions.size(); j++)
+      positions[j] = rest.positions[j];
+    return;
+  }
+  unsigned int i = 0;
+  while(i + 2 < points.size() && points[i + 1].time_from_start.toSec() <= time)
+    i++;
+  const trajectory_msgs::JointTrajectoryPoint &start = points[i];
+  const trajectory_msgs::JointTrajectoryPoint &end = points[i + 1];
+  double duration = (end.time_from_start - start.time_from_start).toSec();
+  double offset = time - start.time_from_start.toSec();
+  std::vector<double> coefficients;
+  for(unsigned int j = 0; j < n; j++)
+  {
+    double start_vel = j < start.velocities.size() ? start.velocities[j] : 0.0;
+    double start_acc = j < start.accelerations.size() ? start.accelerations[j] : 0.0;
+    double end_vel = j < end.velocities.size() ? end.velocities[j] : 0.0;
+    double end_acc = j < end.accelerations.size() ? end.accelerations[j] : 0.0;
+    if(duration <= 0.0)
+    {
+      positions[j] = end.positions[j];
+      continue;
+    }
+    spline_smoother::getQuinticSplineCoefficients(start.positions[j], start_vel, start_acc,
+                                                  end.positions[j], end_vel, end_acc,
+                                                  duration, coefficients);
+    spline_smoother::sampleQuinticSpline(coefficients, offset, positions[j], velocities[j], accelerations[j]);
+  }
+}
+
+/// Appends tail to prefix, where the prefix comes to rest at the point the
+/// tail starts from at rest.  Rather than stopping there, the tail is started
+/// blend_time seconds before the prefix ends, and over that overlap the
+/// spliced trajectory follows the sum of the two motions (less the point they
+/// share), so velocities and accelerations stay continuous across the splice.
+/// Sampling the overlap at the points of both pieces makes each interval of
+/// the result exactly the sum of one quintic from each.  The overlap never
+/// starts before earliest_blend_start (the part of the prefix that is already
+/// executing) or lasts longer than either piece; if none is left the tail
+/// simply follows the prefix.  blend_index is set to the first point of the
+/// result that is not a point of the prefix.  Returns false if the pieces do
+/// not fit together
+inline bool spliceTrajectories(const trajectory_msgs::JointTrajectory &prefix,
+                               const trajectory_msgs::JointTrajectory &tail,
+                               double blend_time,
+                               double earliest_blend_start,
+                               trajectory_msgs::JointTrajectory &spliced,
+                               unsigned int &blend_index)
+{
+  if(prefix.joint_names != tail.joint_names || prefix.points.empty() || tail.points.empty())
+    return false;
+  const unsigned int n = prefix.joint_names.size();
+  for(unsigned int i = 0; i < prefix.points.size(); i++)
+    if(prefix.points[i].positions.size() != n)
+      return false;
+  for(unsigned int i = 0; i < tail.points.size(); i++)
+    if(tail.points[i].positions.size() != n)
+      return false;
+
+  const double prefix_start = prefix.points.front().time_from_start.toSec();
+  const double prefix_end = prefix.points.back().time_from_start.toSec();
+  const double tail_start = tail.points.front().time_from_start.toSec();
+  const double tail_duration = tail.points.back().time_from_start.toSec() - tail_start;
+  double blend_start = std::max(prefix_end - std::min(blend_time, tail_duration),
+                                std::max(prefix_start, earliest_blend_start));
+  if(blend_start > prefix_end)
+    blend_start = prefix_end;
+  // tail times are mapped onto the prefix's clock by this shift
+  const double shift = blend_start - tail_start;
+
+  // collect the times of the result from the blend start on
+  std::vector<double> times;
+  for(unsigned int i = 0; i < prefix.points.size(); i++)
+  {
+    double t = prefix.points[i].time_from_start.toSec();
+    if(t >= blend_start)
+      times.push_back(t);
+  }
+  for(unsigned int i = 0; i < tail.points.size(); i++)
+    times.push_back(tail.points[i].time_from_start.toSec() + shift);
+  std::sort(times.begin(), times.end());
+
+  spliced.header = prefix.header;
+  spliced.joint_names = prefix.joint_names;
+  spliced.points.clear();
+  for(unsigned int i = 0; i < prefix.points.size() && prefix.points[i].time_from_start.toSec() < blend_start; i++)
+    spliced.points.push_back(prefix.points[i]);
+  blend_index = spliced.points.size();
+
+  std::vector<double> prefix_pos, prefix_vel, prefix_acc, tail_pos, tail_vel, tail_acc;
+  const std::vector<double> &shared = tail.points.front().positions;
+  for(unsigned int k = 0; k < times.size(); k++)
+  {
+    // points closer together than the time resolution of the message are one point
+    if(!spliced.points.empty() && times[k] - spliced.points.back().time_from_start.toSec() < 1e-6)
+      continue;
+    sampleTrajectory(prefix, times[k], prefix_pos, prefix_vel, prefix_acc);
+    sampleTrajectory(tail, times[k] - shift, tail_pos, tail_vel, tail_acc);
+    trajectory_msgs::JointTrajectoryPoint point;
+    point.positions.resize(n);
+    point.velocities.resize(n);
+    point.accelerations.resize(n);
+    for(unsigned int j = 0; j < n; j++)
+    {
+      point.positions[j] = prefix_pos[j] + tail_pos[j] - shared[j];
+      point.velocities[j] = prefix_vel[j] + tail_vel[j];
+      point.accelerations[j] = prefix_acc[j] + tail_acc[j];
+    }
+    point.time_from_start = ros::Duration(times[k]);
+    spliced.points.push_back(point);
+  }
+  return true;
+}
+
+}
+
+#endif
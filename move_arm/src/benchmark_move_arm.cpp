@@ -0,0 +1,814 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ros/ros.h>
+#include <actionlib/client/simple_action_client.h>
+#include <actionlib/server/simple_action_server.h>
+#include <control_msgs/FollowJointTrajectoryAction.h>
+#include <arm_navigation_msgs/MoveArmAction.h>
+#include <arm_navigation_msgs/MoveArmStatistics.h>
+#include <arm_navigation_msgs/GetMotionPlan.h>
+#include <arm_navigation_msgs/GetRobotState.h>
+#include <arm_navigation_msgs/SetPlanningSceneDiff.h>
+#include <arm_navigation_msgs/FilterJointTrajectoryWithConstraints.h>
+#include <kinematics_msgs/GetConstraintAwarePositionIK.h>
+#include <tf/transform_datatypes.h>
+#include <planning_environment/models/collision_models.h>
+#include <planning_environment/models/model_utils.h>
+#include <boost/thread/mutex.hpp>
+
+#include <dirent.h>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * End-to-end throughput benchmark for move_arm. The node stands in for everything move_arm talks to:
+ * the environment server (planning scene and robot state), inverse kinematics, the planner, the trajectory
+ * filter and a simulated FollowJointTrajectory controller that moves the robot state along the trajectories
+ * it is given. It then sends scripted goals to move_arm one after the other and reports goals per second,
+ * latency distributions for each stage, and the memory use of the move_arm process.
+ *
+ * Goals are either the joint and pose goals recorded in planning scene bags (as written by ompl_ros on
+ * planning failures), each played against its recorded scene, or, without bags, alternate between
+ * ~goal_a and ~goal_b for the joints of ~group in an empty scene, first as joint goals and then as
+ * pose goals for ~ik_link_name at those joint values.
+ *
+ * Latencies named "move_arm ..." are move_arm's own: the stage timings it publishes as statistics, and
+ * the time it spends in each state of its action feedback. Those named "stand-in ..." only time the
+ * stand-in services and controller of this node, which move_arm's stages include.
+ *
+ * Usage: benchmark_move_arm [<bag> ...]
+ * Start it before move_arm, instead of the environment server and the trajectory filter server, point
+ * move_arm's controller_action_name at ~controller_action_name and remap its arm_ik service to ~arm_ik.
+ * The stand-in planner answers on ~plan_kinematic_path, which is set as the planner service of every goal.
+ */
+
+namespace move_arm
+{
+
+typedef actionlib::SimpleActionServer<control_msgs::FollowJointTrajectoryAction> ControllerServer;
+
+class MoveArmBenchmark
+{
+public:
+
+  MoveArmBenchmark() : private_handle_("~"), collision_models_("robot_description")
+  {
+    private_handle_.param<std::string>("group", group_, "right_arm");
+    private_handle_.param<std::string>("move_arm_action", move_arm_action_, "move_right_arm");
+    private_handle_.param<std::string>("statistics_topic", statistics_topic_, "move_arm/statistics");
+    private_handle_.param<std::string>("controller_action_name", controller_action_name_, "/benchmark_controller/follow_joint_trajectory");
+    private_handle_.param<std::string>("move_arm_process_name", move_arm_process_name_, "move_arm_simple_action");
+    private_handle_.param<std::string>("motion_plan_request_topic", motion_plan_request_topic_, "motion_plan_request");
+    private_handle_.param("num_goals", num_goals_, 50);
+    private_handle_.param("warmup_goals", warmup_goals_, 2);
+    private_handle_.param("goal_timeout", goal_timeout_, 60.0);
+    private_handle_.param("plan_points", plan_points_, 20);
+    private_handle_.param("planning_delay", planning_delay_, 0.0);
+    private_handle_.param("max_joint_velocity", max_joint_velocity_, 1.0);
+    private_handle_.param("time_scale", time_scale_, 0.0);
+    private_handle_.param("goal_offset", goal_offset_, 0.5);
+    private_handle_.param<std::string>("ik_link_name", ik_link_name_, "");
+    private_handle_.param("ik_iterations", ik_iterations_, 500);
+  }
+
+  bool loadGoals(const std::vector<std::string> &bag_files)
+  {
+    const planning_models::KinematicModel::JointModelGroup* joint_model_group = collision_models_.getKinematicModel()->getModelGroup(group_);
+    if(joint_model_group == NULL)
+    {
+      ROS_ERROR("No joint group %s", group_.c_str());
+      return false;
+    }
+    const std::vector<std::string> &joint_names = joint_model_group->getJointModelNames();
+    // the group's last joint moves the link pose goals are for, unless told otherwise
+    if(ik_link_name_.empty() && !joint_model_group->getJointModels().empty())
+      ik_link_name_ = joint_model_group->getJointModels().back()->getChildLinkModel()->getName();
+
+    planning_models::KinematicState state(collision_models_.getKinematicModel());
+    state.setKinematicStateToDefault();
+    arm_navigation_msgs::PlanningScene default_scene;
+    planning_environment::convertKinematicStateToRobotState(state, ros::Time::now(), collision_models_.getWorldFrameId(),
+                                                            default_scene.robot_state);
+
+    for(unsigned int i=0; i < bag_files.size(); i++)
+    {
+      arm_navigation_msgs::PlanningScene planning_scene;
+      std::vector<arm_navigation_msgs::MotionPlanRequest> motion_plan_requests;
+      if(!collision_models_.readPlanningSceneBag(bag_files[i], planning_scene) ||
+         !collision_models_.loadMotionPlanRequestsInPlanningSceneBag(bag_files[i], motion_plan_request_topic_, motion_plan_requests))
+      {
+        ROS_WARN("Could not read a planning scene and motion plan requests from %s", bag_files[i].c_str());
+        continue;
+      }
+      for(unsigned int j=0; j < motion_plan_requests.size(); j++)
+      {
+        // the stand-in planner only interpolates to joint goals, which pose goals become through IK
+        const arm_navigation_msgs::Constraints &goal = motion_plan_requests[j].goal_constraints;
+        bool pose_goal = goal.joint_constraints.empty() && goal.position_constraints.size() == 1 && goal.orientation_constraints.size() == 1;
+        bool joint_goal = !goal.joint_constraints.empty() && goal.position_constraints.empty() && goal.orientation_constraints.empty();
+        if(motion_plan_requests[j].group_name != group_ || !(pose_goal || joint_goal))
+        {
+          ROS_INFO("Skipping a goal in %s that is neither a joint nor a pose goal for %s", bag_files[i].c_str(), group_.c_str());
+          continue;
+        }
+        goal_scenes_.push_back(scenes_.size());
+        goals_.push_back(arm_navigation_msgs::MoveArmGoal());
+        goals_.back().motion_plan_request = motion_plan_requests[j];
+        goals_.back().disable_ik = joint_goal;
+      }
+      scenes_.push_back(planning_scene);
+    }
+
+    if(bag_files.empty())
+    {
+      std::vector<double> goal_a, goal_b;
+      if(!getJointValues("goal_a", goal_a) || goal_a.size() != joint_names.size())
+        goal_a.assign(joint_names.size(), 0.0);
+      if(!getJointValues("goal_b", goal_b) || goal_b.size() != joint_names.size())
+      {
+        goal_b = goal_a;
+        for(unsigned int i=0; i < goal_b.size(); i++)
+          goal_b[i] += goal_offset_;
+      }
+      scenes_.push_back(default_scene);
+      for(int i=0; i < 2; i++)
+      {
+        goal_scenes_.push_back(scenes_.size()-1);
+        goals_.push_back(arm_navigation_msgs::MoveArmGoal());
+        arm_navigation_msgs::MotionPlanRequest &req = goals_.back().motion_plan_request;
+        const std::vector<double> &values = (i == 0) ? goal_a : goal_b;
+        req.group_name = group_;
+        req.num_planning_attempts = 1;
+        req.allowed_planning_time = ros::Duration(5.0);
+        req.goal_constraints.joint_constraints.resize(joint_names.size());
+        for(unsigned int j=0; j < joint_names.size(); j++)
+        {
+          req.goal_constraints.joint_constraints[j].joint_name = joint_names[j];
+          req.goal_constraints.joint_constraints[j].position = values[j];
+          req.goal_constraints.joint_constraints[j].tolerance_above = 0.01;
+          req.goal_constraints.joint_constraints[j].tolerance_below = 0.01;
+        }
+        goals_.back().disable_ik = true;
+      }
+      // the same goals again as poses of the IK link
+      for(int i=0; i < 2; i++)
+      {
+        const std::vector<double> &values = (i == 0) ? goal_a : goal_b;
+        state.getJointStateGroup(group_)->setKinematicState(values);
+        const planning_models::KinematicState::LinkState *link_state = state.getLinkState(ik_link_name_);
+        if(link_state == NULL)
+        {
+          ROS_WARN("No link %s for pose goals; running joint goals only", ik_link_name_.c_str());
+          break;
+        }
+        goal_scenes_.push_back(scenes_.size()-1);
+        goals_.push_back(makePoseGoal(link_state->getGlobalLinkTransform()));
+      }
+    }
+
+    std::string planner_service_name = private_handle_.resolveName("plan_kinematic_path");
+    for(unsigned int i=0; i < goals_.size(); i++)
+      goals_[i].planner_service_name = planner_service_name;
+    return !goals_.empty();
+  }
+
+  void advertise()
+  {
+    ros::NodeHandle root_handle;
+    setScene(scenes_[goal_scenes_[0]]);
+    scene_service_ = root_handle.advertiseService("/environment_server/set_planning_scene_diff", &MoveArmBenchmark::setPlanningSceneDiff, this);
+    state_service_ = root_handle.advertiseService("/environment_server/get_robot_state", &MoveArmBenchmark::getRobotState, this);
+    filter_service_ = root_handle.advertiseService("/trajectory_filter_server/filter_trajectory_with_constraints", &MoveArmBenchmark::filterTrajectory, this);
+    plan_service_ = private_handle_.advertiseService("plan_kinematic_path", &MoveArmBenchmark::plan, this);
+    ik_service_ = private_handle_.advertiseService("arm_ik", &MoveArmBenchmark::computeIK, this);
+    statistics_subscriber_ = root_handle.subscribe(statistics_topic_, 16, &MoveArmBenchmark::statisticsCallback, this);
+    controller_server_.reset(new ControllerServer(root_handle, controller_action_name_, 
+                                                  boost::bind(&MoveArmBenchmark::executeTrajectory, this, _1), false));
+    controller_server_->start();
+  }
+
+  void run()
+  {
+    actionlib::SimpleActionClient<arm_navigation_msgs::MoveArmAction> move_arm(move_arm_action_, true);
+    ROS_INFO("Waiting for move_arm action %s", move_arm_action_.c_str());
+    move_arm.waitForServer();
+
+    unsigned int succeeded = 0;
+    unsigned int scene = scenes_.size();
+    ros::WallTime start = ros::WallTime::now();
+    for(int i=0; i < warmup_goals_ + num_goals_ && ros::ok(); i++)
+    {
+      if(i == warmup_goals_)
+      {
+        boost::mutex::scoped_lock lock(samples_lock_);
+        samples_.clear();
+        start = ros::WallTime::now();
+      }
+      // the robot stays where the last goal left it until the goals move on to another scene
+      unsigned int index = i % goals_.size();
+      if(goal_scenes_[index] != scene)
+      {
+        scene = goal_scenes_[index];
+        setScene(scenes_[scene]);
+      }
+      ros::WallTime sent = ros::WallTime::now();
+      startStages(sent);
+      move_arm.sendGoal(goals_[index],
+                        actionlib::SimpleActionClient<arm_navigation_msgs::MoveArmAction>::SimpleDoneCallback(),
+                        actionlib::SimpleActionClient<arm_navigation_msgs::MoveArmAction>::SimpleActiveCallback(),
+                        boost::bind(&MoveArmBenchmark::feedbackCallback, this, _1));
+      if(!move_arm.waitForResult(ros::Duration(goal_timeout_)))
+      {
+        ROS_WARN("Goal %d timed out", i);
+        move_arm.cancelGoal();
+        continue;
+      }
+      endStages(move_arm.getState() == actionlib::SimpleClientGoalState::SUCCEEDED);
+      if(move_arm.getState() == actionlib::SimpleClientGoalState::SUCCEEDED)
+      {
+        addSample("goal", (ros::WallTime::now()-sent).toSec());
+        if(i >= warmup_goals_)
+          succeeded++;
+      }
+      else
+        ROS_WARN("Goal %d finished as %s", i, move_arm.getState().toString().c_str());
+    }
+    double elapsed = (ros::WallTime::now()-start).toSec();
+
+    // let the last statistics message arrive
+    ros::WallDuration(0.5).sleep();
+    report(succeeded, elapsed);
+  }
+
+private:
+
+  bool getJointValues(const std::string &name, std::vector<double> &values)
+  {
+    XmlRpc::XmlRpcValue list;
+    if(!private_handle_.getParam(name, list) || list.getType() != XmlRpc::XmlRpcValue::TypeArray)
+      return false;
+    values.clear();
+    for(int i=0; i < list.size(); i++)
+    {
+      if(list[i].getType() == XmlRpc::XmlRpcValue::TypeDouble)
+        values.push_back(static_cast<double>(list[i]));
+      else if(list[i].getType() == XmlRpc::XmlRpcValue::TypeInt)
+        values.push_back(static_cast<int>(list[i]));
+      else
+        return false;
+    }
+    return true;
+  }
+
+  void setScene(const arm_navigation_msgs::PlanningScene &scene)
+  {
+    boost::mutex::scoped_lock lock(state_lock_);
+    scene_ = scene;
+  }
+
+  void addSample(const std::string &stage, double seconds)
+  {
+    boost::mutex::scoped_lock lock(samples_lock_);
+    samples_[stage].push_back(seconds);
+  }
+
+  /// A goal that the IK link reaches pose, in the world frame, within the tolerances of the regression tests
+  arm_navigation_msgs::MoveArmGoal makePoseGoal(const tf::Transform &pose)
+  {
+    arm_navigation_msgs::MoveArmGoal goal;
+    arm_navigation_msgs::MotionPlanRequest &req = goal.motion_plan_request;
+    req.group_name = group_;
+    req.num_planning_attempts = 1;
+    req.allowed_planning_time = ros::Duration(5.0);
+    req.goal_constraints.position_constraints.resize(1);
+    arm_navigation_msgs::PositionConstraint &position = req.goal_constraints.position_constraints[0];
+    position.header.frame_id = collision_models_.getWorldFrameId();
+    position.link_name = ik_link_name_;
+    position.position.x = pose.getOrigin().x();
+    position.position.y = pose.getOrigin().y();
+    position.position.z = pose.getOrigin().z();
+    position.constraint_region_shape.type = arm_navigation_msgs::Shape::BOX;
+    position.constraint_region_shape.dimensions.assign(3, 0.02);
+    position.constraint_region_orientation.w = 1.0;
+    position.weight = 1.0;
+    req.goal_constraints.orientation_constraints.resize(1);
+    arm_navigation_msgs::OrientationConstraint &orientation = req.goal_constraints.orientation_constraints[0];
+    orientation.header.frame_id = collision_models_.getWorldFrameId();
+    orientation.link_name = ik_link_name_;
+    tf::quaternionTFToMsg(pose.getRotation(), orientation.orientation);
+    orientation.absolute_roll_tolerance = 0.04;
+    orientation.absolute_pitch_tolerance = 0.04;
+    orientation.absolute_yaw_tolerance = 0.04;
+    orientation.weight = 1.0;
+    goal.disable_ik = false;
+    return goal;
+  }
+
+  ///
+  /// move_arm stages, from its action feedback
+  ///
+
+  void startStages(const ros::WallTime &sent)
+  {
+    boost::mutex::scoped_lock lock(samples_lock_);
+    stage_ = "request";
+    stage_start_ = sent;
+  }
+
+  void feedbackCallback(const arm_navigation_msgs::MoveArmFeedbackConstPtr &feedback)
+  {
+    boost::mutex::scoped_lock lock(samples_lock_);
+    if(stage_.empty() || feedback->state == stage_)
+      return;
+    ros::WallTime now = ros::WallTime::now();
+    samples_["move_arm stage " + stage_].push_back((now-stage_start_).toSec());
+    stage_ = feedback->state;
+    stage_start_ = now;
+  }
+
+  /// Only the stages of goals that succeed are kept, as the stage a failure ends in is cut short
+  void endStages(bool succeeded)
+  {
+    boost::mutex::scoped_lock lock(samples_lock_);
+    if(succeeded && !stage_.empty())
+      samples_["move_arm stage " + stage_].push_back((ros::WallTime::now()-stage_start_).toSec());
+    stage_.clear();
+  }
+
+  ///
+  /// Stand-in services
+  ///
+
+  bool setPlanningSceneDiff(arm_navigation_msgs::SetPlanningSceneDiff::Request &req,
+                            arm_navigation_msgs::SetPlanningSceneDiff::Response &res)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    {
+      boost::mutex::scoped_lock lock(state_lock_);
+      res.planning_scene = scene_;
+    }
+    const arm_navigation_msgs::PlanningScene &diff = req.planning_scene_diff;
+    res.planning_scene.collision_objects.insert(res.planning_scene.collision_objects.end(),
+                                                diff.collision_objects.begin(), diff.collision_objects.end());
+    res.planning_scene.attached_collision_objects.insert(res.planning_scene.attached_collision_objects.end(),
+                                                         diff.attached_collision_objects.begin(), diff.attached_collision_objects.end());
+    res.planning_scene.allowed_contacts.insert(res.planning_scene.allowed_contacts.end(),
+                                               diff.allowed_contacts.begin(), diff.allowed_contacts.end());
+    res.planning_scene.link_padding.insert(res.planning_scene.link_padding.end(),
+                                           diff.link_padding.begin(), diff.link_padding.end());
+    addSample("stand-in scene", (ros::WallTime::now()-start).toSec());
+    return true;
+  }
+
+  bool getRobotState(arm_navigation_msgs::GetRobotState::Request &req,
+                     arm_navigation_msgs::GetRobotState::Response &res)
+  {
+    boost::mutex::scoped_lock lock(state_lock_);
+    res.robot_state = scene_.robot_state;
+    res.error_code.val = res.error_code.SUCCESS;
+    return true;
+  }
+
+  /// Straight line in joint space from the start state to the joint goal
+  bool plan(arm_navigation_msgs::GetMotionPlan::Request &req,
+            arm_navigation_msgs::GetMotionPlan::Response &res)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    if(planning_delay_ > 0.0)
+      ros::WallDuration(planning_delay_).sleep();
+    const std::vector<arm_navigation_msgs::JointConstraint> &goal = req.motion_plan_request.goal_constraints.joint_constraints;
+    const sensor_msgs::JointState &start_state = req.motion_plan_request.start_state.joint_state;
+    trajectory_msgs::JointTrajectory &trajectory = res.trajectory.joint_trajectory;
+    std::vector<double> from(goal.size(), 0.0);
+    for(unsigned int i=0; i < goal.size(); i++)
+    {
+      trajectory.joint_names.push_back(goal[i].joint_name);
+      std::vector<std::string>::const_iterator it = std::find(start_state.name.begin(), start_state.name.end(), goal[i].joint_name);
+      if(it != start_state.name.end() && (unsigned int)(it - start_state.name.begin()) < start_state.position.size())
+        from[i] = start_state.position[it - start_state.name.begin()];
+    }
+    int num_points = std::max(plan_points_, 2);
+    trajectory.points.resize(num_points);
+    for(int p=0; p < num_points; p++)
+    {
+      double t = (double)p/(num_points-1);
+      trajectory.points[p].positions.resize(goal.size());
+      for(unsigned int i=0; i < goal.size(); i++)
+        trajectory.points[p].positions[i] = from[i] + t*(goal[i].position - from[i]);
+    }
+    res.planning_time = ros::Duration((ros::WallTime::now()-start).toSec());
+    res.error_code.val = res.error_code.SUCCESS;
+    addSample("stand-in plan", (ros::WallTime::now()-start).toSec());
+    return true;
+  }
+
+  /// Damped least squares on a numerical Jacobian of the link pose, from the seed state; the
+  /// solution is not checked against the constraints, which move_arm does itself
+  bool computeIK(kinematics_msgs::GetConstraintAwarePositionIK::Request &req,
+                 kinematics_msgs::GetConstraintAwarePositionIK::Response &res)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    res.error_code.val = res.error_code.NO_IK_SOLUTION;
+    planning_models::KinematicState state(collision_models_.getKinematicModel());
+    state.setKinematicStateToDefault();
+    planning_environment::setRobotStateAndComputeTransforms(req.ik_request.robot_state, state);
+    planning_models::KinematicState::JointStateGroup *group = state.getJointStateGroup(group_);
+    const planning_models::KinematicState::LinkState *link_state = state.getLinkState(req.ik_request.ik_link_name);
+    if(group == NULL || link_state == NULL || group->getDimension() != group->getJointStateVector().size())
+    {
+      ROS_WARN("Stand-in IK only solves for single variable joints of %s, moving a link of the robot", group_.c_str());
+      addSample("stand-in ik", (ros::WallTime::now()-start).toSec());
+      return true;
+    }
+    const std::vector<planning_models::KinematicState::JointState*> &joint_states = group->getJointStateVector();
+    const unsigned int n = joint_states.size();
+
+    // the seed state gives the starting values of the group's joints
+    std::vector<double> values;
+    group->getKinematicStateValues(values);
+    const sensor_msgs::JointState &seed = req.ik_request.ik_seed_state.joint_state;
+    for(unsigned int j=0; j < n; j++)
+    {
+      std::vector<std::string>::const_iterator it = std::find(seed.name.begin(), seed.name.end(), joint_states[j]->getName());
+      if(it != seed.name.end() && (unsigned int)(it - seed.name.begin()) < seed.position.size())
+        values[j] = seed.position[it - seed.name.begin()];
+    }
+
+    tf::Transform target;
+    tf::poseMsgToTF(req.ik_request.pose_stamped.pose, target);
+    std::string frame = req.ik_request.pose_stamped.header.frame_id;
+    std::string world_frame = collision_models_.getWorldFrameId();
+    if(!frame.empty() && frame[0] == '/')
+      frame.erase(0, 1);
+    if(!world_frame.empty() && world_frame[0] == '/')
+      world_frame.erase(0, 1);
+    if(!frame.empty() && frame != world_frame)
+    {
+      const planning_models::KinematicState::LinkState *frame_state = state.getLinkState(frame);
+      if(frame_state == NULL)
+      {
+        ROS_WARN("Stand-in IK cannot solve for poses in frame %s", frame.c_str());
+        addSample("stand-in ik", (ros::WallTime::now()-start).toSec());
+        return true;
+      }
+      target = frame_state->getGlobalLinkTransform()*target;
+    }
+
+    const double step = 1e-6;
+    std::vector<double> jacobian(6*n), perturbed(6);
+    double error[6];
+    for(int iteration=0; iteration < ik_iterations_; iteration++)
+    {
+      group->setKinematicState(values);
+      getPoseError(target, link_state->getGlobalLinkTransform(), error);
+      if(error[0]*error[0]+error[1]*error[1]+error[2]*error[2] < 1e-10 &&
+         error[3]*error[3]+error[4]*error[4]+error[5]*error[5] < 1e-8)
+      {
+        res.solution.joint_state.name.resize(n);
+        for(unsigned int j=0; j < n; j++)
+          res.solution.joint_state.name[j] = joint_states[j]->getName();
+        res.solution.joint_state.position = values;
+        res.error_code.val = res.error_code.SUCCESS;
+        break;
+      }
+      // how the pose moves with each joint, from the error left after nudging it
+      for(unsigned int j=0; j < n; j++)
+      {
+        values[j] += step;
+        group->setKinematicState(values);
+        getPoseError(target, link_state->getGlobalLinkTransform(), &perturbed[0]);
+        values[j] -= step;
+        for(unsigned int k=0; k < 6; k++)
+          jacobian[k*n+j] = (error[k]-perturbed[k])/step;
+      }
+      // dq = J^T (J J^T + lambda^2 I)^-1 e
+      double system[6][7];
+      for(unsigned int r=0; r < 6; r++)
+      {
+        for(unsigned int c=0; c < 6; c++)
+        {
+          double sum = (r == c) ? 1e-4 : 0.0;
+          for(unsigned int j=0; j < n; j++)
+            sum += jacobian[r*n+j]*jacobian[c*n+j];
+          system[r][c] = sum;
+        }
+        system[r][6] = error[r];
+      }
+      double solution[6];
+      solveLinearSystem(system, solution);
+      double largest = 0.0;
+      std::vector<double> delta(n, 0.0);
+      for(unsigned int j=0; j < n; j++)
+      {
+        for(unsigned int k=0; k < 6; k++)
+          delta[j] += jacobian[k*n+j]*solution[k];
+        largest = std::max(largest, fabs(delta[j]));
+      }
+      double scale = largest > 0.2 ? 0.2/largest : 1.0;
+      for(unsigned int j=0; j < n; j++)
+      {
+        values[j] += scale*delta[j];
+        const planning_models::KinematicModel::JointModel *joint_model = joint_states[j]->getJointModel();
+        std::pair<double, double> bounds;
+        bool within_bounds = true;
+        joint_model->isValueWithinVariableBounds(joint_model->getName(), values[j], within_bounds);
+        if(!within_bounds && joint_model->getVariableBounds(joint_model->getName(), bounds))
+          values[j] = std::max(bounds.first, std::min(bounds.second, values[j]));
+      }
+    }
+    addSample("stand-in ik", (ros::WallTime::now()-start).toSec());
+    return true;
+  }
+
+  /// Position error, then orientation error as an axis scaled by the angle, of current against target
+  static void getPoseError(const tf::Transform &target, const tf::Transform &current, double *error)
+  {
+    tf::Vector3 position = target.getOrigin()-current.getOrigin();
+    tf::Quaternion rotation = target.getRotation()*current.getRotation().inverse();
+    double angle = rotation.getAngle();
+    if(angle > M_PI)
+      angle -= 2.0*M_PI;
+    tf::Vector3 axis = fabs(angle) > 1e-12 ? rotation.getAxis()*angle : tf::Vector3(0.0, 0.0, 0.0);
+    for(unsigned int k=0; k < 3; k++)
+    {
+      error[k] = position[k];
+      error[k+3] = axis[k];
+    }
+  }
+
+  /// Gaussian elimination with partial pivoting on an augmented 6x6 system
+  static void solveLinearSystem(double system[6][7], double *solution)
+  {
+    for(unsigned int c=0; c < 6; c++)
+    {
+      unsigned int pivot = c;
+      for(unsigned int r=c+1; r < 6; r++)
+        if(fabs(system[r][c]) > fabs(system[pivot][c]))
+          pivot = r;
+      for(unsigned int k=0; k < 7; k++)
+        std::swap(system[c][k], system[pivot][k]);
+      for(unsigned int r=c+1; r < 6; r++)
+      {
+        double factor = system[r][c]/system[c][c];
+        for(unsigned int k=c; k < 7; k++)
+          system[r][k] -= factor*system[c][k];
+      }
+    }
+    for(int r=5; r >= 0; r--)
+    {
+      double sum = system[r][6];
+      for(unsigned int k=r+1; k < 6; k++)
+        sum -= system[r][k]*solution[k];
+      solution[r] = sum/system[r][r];
+    }
+  }
+
+  /// Times every segment by its largest joint motion at the maximum joint velocity
+  bool filterTrajectory(arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request &req,
+                        arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Response &res)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    res.trajectory = req.trajectory;
+    std::vector<trajectory_msgs::JointTrajectoryPoint> &points = res.trajectory.points;
+    double time = 0.0;
+    for(unsigned int p=0; p < points.size(); p++)
+    {
+      if(p > 0)
+      {
+        double max_step = 0.0;
+        for(unsigned int i=0; i < points[p].positions.size() && i < points[p-1].positions.size(); i++)
+          max_step = std::max(max_step, fabs(points[p].positions[i]-points[p-1].positions[i]));
+        time += std::max(max_step/max_joint_velocity_, 0.01);
+      }
+      points[p].time_from_start = ros::Duration(time);
+      points[p].velocities.assign(points[p].positions.size(), 0.0);
+    }
+    res.error_code.val = res.error_code.SUCCESS;
+    addSample("stand-in filter", (ros::WallTime::now()-start).toSec());
+    return true;
+  }
+
+  ///
+  /// Simulated controller
+  ///
+
+  void setJointPositions(const trajectory_msgs::JointTrajectory &trajectory,
+                         const trajectory_msgs::JointTrajectoryPoint &point)
+  {
+    boost::mutex::scoped_lock lock(state_lock_);
+    sensor_msgs::JointState &joint_state = scene_.robot_state.joint_state;
+    for(unsigned int i=0; i < trajectory.joint_names.size() && i < point.positions.size(); i++)
+    {
+      std::vector<std::string>::iterator it = std::find(joint_state.name.begin(), joint_state.name.end(), trajectory.joint_names[i]);
+      if(it != joint_state.name.end() && (unsigned int)(it - joint_state.name.begin()) < joint_state.position.size())
+        joint_state.position[it - joint_state.name.begin()] = point.positions[i];
+    }
+  }
+
+  /// Follows the trajectory in time scaled by ~time_scale (0 executes instantly); a trajectory sent 
+  /// while one is executing preempts it and takes over from its own start stamp
+  void executeTrajectory(const control_msgs::FollowJointTrajectoryGoalConstPtr &goal)
+  {
+    ros::WallTime received = ros::WallTime::now();
+    const trajectory_msgs::JointTrajectory &trajectory = goal->trajectory;
+    if(trajectory.points.empty())
+    {
+      controller_server_->setSucceeded();
+      return;
+    }
+    // instant execution does not wait for the start stamp either, which move_arm sets in the future
+    ros::Time start = (trajectory.header.stamp.isZero() || time_scale_ <= 0.0) ? ros::Time::now() : trajectory.header.stamp;
+    double duration = trajectory.points.back().time_from_start.toSec()*time_scale_;
+    unsigned int reached = 0;
+    while(duration > 0.0 && ros::ok())
+    {
+      double elapsed = (ros::Time::now()-start).toSec();
+      while(reached+1 < trajectory.points.size() && trajectory.points[reached+1].time_from_start.toSec()*time_scale_ <= elapsed)
+        reached++;
+      if(elapsed >= duration)
+        break;
+      if(controller_server_->isPreemptRequested())
+      {
+        setJointPositions(trajectory, trajectory.points[reached]);
+        controller_server_->setPreempted();
+        return;
+      }
+      ros::WallDuration(0.002).sleep();
+    }
+    setJointPositions(trajectory, trajectory.points.back());
+    addSample("stand-in execute", (ros::WallTime::now()-received).toSec());
+    controller_server_->setSucceeded();
+  }
+
+  ///
+  /// Reporting
+  ///
+
+  void statisticsCallback(const arm_navigation_msgs::MoveArmStatisticsConstPtr &stats)
+  {
+    if(stats->ik_time >= 0.0)
+      addSample("move_arm ik", stats->ik_time);
+    if(stats->planning_time >= 0.0)
+      addSample("move_arm planning", stats->planning_time);
+    if(stats->smoothing_time >= 0.0)
+      addSample("move_arm smoothing", stats->smoothing_time);
+    if(stats->time_to_execution >= 0.0)
+      addSample("move_arm time to execution", stats->time_to_execution);
+    if(stats->time_to_result >= 0.0)
+      addSample("move_arm time to result", stats->time_to_result);
+  }
+
+  static double getPercentile(const std::vector<double> &values, double fraction)
+  {
+    std::vector<double> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    unsigned int index = (unsigned int) ceil(fraction*sorted.size());
+    return sorted[index > 0 ? index-1 : 0];
+  }
+
+  /// Resident and peak resident memory of a process in kB, from /proc
+  static bool getProcessMemory(const std::string &pid, long &rss, long &peak_rss)
+  {
+    std::ifstream status(("/proc/"+pid+"/status").c_str());
+    if(!status)
+      return false;
+    rss = peak_rss = -1;
+    std::string key;
+    while(status >> key)
+    {
+      if(key == "VmRSS:")
+        status >> rss;
+      else if(key == "VmHWM:")
+        status >> peak_rss;
+      status.ignore(1024, '\n');
+    }
+    return rss >= 0;
+  }
+
+  std::string findProcess(const std::string &name) const
+  {
+    DIR *proc = opendir("/proc");
+    if(proc == NULL)
+      return std::string();
+    std::string pid;
+    struct dirent *entry;
+    while(pid.empty() && (entry = readdir(proc)) != NULL)
+    {
+      std::string candidate(entry->d_name);
+      if(candidate.find_first_not_of("0123456789") != std::string::npos)
+        continue;
+      std::ifstream cmdline(("/proc/"+candidate+"/cmdline").c_str());
+      std::string command;
+      std::getline(cmdline, command, '\0');
+      if(command.size() >= name.size() && command.compare(command.size()-name.size(), name.size(), name) == 0)
+        pid = candidate;
+    }
+    closedir(proc);
+    return pid;
+  }
+
+  void report(unsigned int succeeded, double elapsed)
+  {
+    boost::mutex::scoped_lock lock(samples_lock_);
+    ROS_INFO("%u/%d goals succeeded in %f s: %f goals/s", succeeded, num_goals_, elapsed, elapsed > 0.0 ? succeeded/elapsed : 0.0);
+    for(std::map<std::string, std::vector<double> >::const_iterator it = samples_.begin(); it != samples_.end(); it++)
+    {
+      const std::vector<double> &values = it->second;
+      if(values.empty())
+        continue;
+      double sum = 0.0;
+      for(unsigned int i=0; i < values.size(); i++)
+        sum += values[i];
+      ROS_INFO("%s: n %d mean %f median %f p95 %f max %f", it->first.c_str(), (int) values.size(), sum/values.size(),
+               getPercentile(values, 0.5), getPercentile(values, 0.95), getPercentile(values, 1.0));
+    }
+    long rss, peak_rss;
+    std::string pid = findProcess(move_arm_process_name_);
+    if(!pid.empty() && getProcessMemory(pid, rss, peak_rss))
+      ROS_INFO("%s (pid %s): rss %ld kB peak %ld kB", move_arm_process_name_.c_str(), pid.c_str(), rss, peak_rss);
+    else
+      ROS_INFO("Could not find a %s process to report memory for", move_arm_process_name_.c_str());
+    if(getProcessMemory("self", rss, peak_rss))
+      ROS_INFO("benchmark: rss %ld kB peak %ld kB", rss, peak_rss);
+  }
+
+  ros::NodeHandle private_handle_;
+  planning_environment::CollisionModels collision_models_;
+
+  std::string group_, move_arm_action_, statistics_topic_, controller_action_name_;
+  std::string move_arm_process_name_, motion_plan_request_topic_;
+  std::string ik_link_name_;
+  int num_goals_, warmup_goals_, plan_points_, ik_iterations_;
+  double goal_timeout_, planning_delay_, max_joint_velocity_, time_scale_, goal_offset_;
+
+  std::vector<arm_navigation_msgs::MoveArmGoal> goals_;
+  std::vector<arm_navigation_msgs::PlanningScene> scenes_;
+  std::vector<unsigned int> goal_scenes_;
+
+  boost::mutex state_lock_;
+  arm_navigation_msgs::PlanningScene scene_;
+
+  boost::mutex samples_lock_;
+  std::map<std::string, std::vector<double> > samples_;
+  std::string stage_;
+  ros::WallTime stage_start_;
+
+  ros::ServiceServer scene_service_, state_service_, filter_service_, plan_service_, ik_service_;
+  ros::Subscriber statistics_subscriber_;
+  boost::shared_ptr<ControllerServer> controller_server_;
+};
+
+}
+
+int main(int argc, char **argv)
+{ 
+  ros::init(argc, argv, "benchmark_move_arm");
+
+  ros::AsyncSpinner spinner(2); 
+  spinner.start();
+
+  move_arm::MoveArmBenchmark benchmark;
+  std::vector<std::string> bag_files(argv+1, argv+argc);
+  if(!benchmark.loadGoals(bag_files))
+  {
+    ROS_ERROR("No goals to run");
+    return 1;
+  }
+  benchmark.advertise();
+  benchmark.run();
+  ros::shutdown();
+  return 0;
+}
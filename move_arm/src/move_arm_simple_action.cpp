@@ -69,7 +69,9 @@
 #include <visualization_msgs/MarkerArray.h>
 
 #include <planning_environment/models/collision_models.h>
+#include <planning_environment/models/collision_models_interface.h>
 #include <planning_environment/models/model_utils.h>
+#include <move_arm/splice_trajectory.h>
 #include <arm_navigation_msgs/SetPlanningSceneDiff.h>
 
 #include <arm_navigation_msgs/GetRobotState.h>
@@ -79,6 +81,8 @@
 
 #include <std_msgs/Bool.h>
 
+#include <ompl_ros_interface/ompl_ros.h>
+
 #include <valarray>
 #include <algorithm>
 #include <cstdlib>
@@ -145,9 +149,32 @@ public:
 
     private_handle_.param<bool>("publish_stats",publish_stats_, true);
 
+    // pipelined execution sends the filtered start of a plan to the controller
+    // while the rest is still being filtered, and splices the rest on later
+    private_handle_.param<bool>("pipelined_execution",pipelined_execution_, false);
+    private_handle_.param<double>("pipelined_prefix_fraction",pipelined_prefix_fraction_, 0.25);
+    private_handle_.param<int>("pipelined_min_points",pipelined_min_points_, 10);
+    // the rest is blended in over this much of the end of the prefix, starting
+    // no sooner than pipelined_blend_lead seconds ahead of the controller
+    private_handle_.param<double>("pipelined_blend_time",pipelined_blend_time_, 0.5);
+    private_handle_.param<double>("pipelined_blend_lead",pipelined_blend_lead_, 0.1);
+
+    // the planner can be hosted in this node, sharing our collision models;
+    // requests for its service are then handled by a direct call
+    private_handle_.param<bool>("in_process_planner",in_process_planner_, false);
+    private_handle_.param<std::string>("in_process_planner_namespace",in_process_planner_namespace_, "/ompl_planning");
+
     planning_scene_state_ = NULL;
+    collision_models_interface_ = NULL;
 
-    collision_models_ = new planning_environment::CollisionModels("robot_description");
+    if(in_process_planner_)
+    {
+      // not registered with the environment server: the scene is set here for each goal
+      collision_models_interface_ = new planning_environment::CollisionModelsInterface("robot_description", false);
+      collision_models_ = collision_models_interface_;
+    }
+    else
+      collision_models_ = new planning_environment::CollisionModels("robot_description");
 
     num_planning_attempts_ = 0;
     state_ = PLANNING;
@@ -176,6 +203,7 @@ public:
   virtual ~MoveArm()
   {
     revertPlanningScene();
+    planner_.reset();
     delete collision_models_;
   }
 
@@ -198,6 +226,16 @@ public:
     }
     group_joint_names_ = joint_model_group->getJointModelNames();
     group_link_names_ = joint_model_group->getGroupLinkNames();
+    if(in_process_planner_)
+    {
+      planner_.reset(new ompl_ros_interface::OmplRos(ros::NodeHandle(in_process_planner_namespace_), collision_models_interface_));
+      if(!planner_->configure())
+      {
+        ROS_ERROR("Could not configure the in-process planner in namespace %s", in_process_planner_namespace_.c_str());
+        return false;
+      }
+      ROS_INFO("Planning in-process with the planner configured in %s", in_process_planner_namespace_.c_str());
+    }
     return true;
   }
 	
@@ -259,21 +297,27 @@ private:
         req.motion_plan_request.goal_constraints.joint_constraints.push_back(jc);
         joint_values[jc.joint_name] = jc.position;
       }
-      arm_navigation_msgs::ArmNavigationErrorCodes error_code;
+      arm_navigation_msgs::ArmNavigationErrorCodes &error_code = request_validation_.goal_error_code;
       resetToStartState(planning_scene_state_);
       planning_scene_state_->setKinematicState(joint_values);
-      if(!collision_models_->isKinematicStateValid(*planning_scene_state_,
-                                                  group_joint_names_,
-                                                  error_code,
-                                                  original_request_.motion_plan_request.goal_constraints,
-						   original_request_.motion_plan_request.path_constraints,
-						   true))
+      // this is the goal check for the joint goal the pose goal becomes
+      request_validation_.ik_solution = solution;
+      request_validation_.goal_checked = true;
+      request_validation_.goal_valid = collision_models_->isKinematicStateValid(*planning_scene_state_,
+                                                                                group_joint_names_,
+                                                                                error_code,
+                                                                                original_request_.motion_plan_request.goal_constraints,
+                                                                                original_request_.motion_plan_request.path_constraints,
+                                                                                true);
+      if(!request_validation_.goal_valid)
       {
         ROS_INFO("IK returned joint state for goal that doesn't seem to be valid");
         if(error_code.val == error_code.GOAL_CONSTRAINTS_VIOLATED) {
           ROS_WARN("IK solution doesn't obey goal constraints");
         } else if(error_code.val == error_code.COLLISION_CONSTRAINTS_VIOLATED) {
           ROS_WARN("IK solution in collision");
+          collision_models_->getAllCollisionsForState(*planning_scene_state_,
+                                                      request_validation_.contacts);
         } else {
           ROS_WARN_STREAM("Some other problem with ik solution " << error_code.val);
         }
@@ -330,16 +374,25 @@ private:
   ///
   /// Trajectory Filtering
   ///
+  /// With from_current_state false the trajectory is filtered as starting
+  /// from its own first point instead of the robot's current state, and
+  /// without reaches_goal the goal constraints are not passed on (for pieces
+  /// of a plan in pipelined execution)
   bool filterTrajectory(const trajectory_msgs::JointTrajectory &trajectory_in, 
-                        trajectory_msgs::JointTrajectory &trajectory_out)
+                        trajectory_msgs::JointTrajectoryConstPtr &trajectory_out,
+                        bool from_current_state = true,
+                        bool reaches_goal = true)
   {
     arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request  req;
     arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Response res;
-    fillTrajectoryMsg(trajectory_in, req.trajectory);
+    if(from_current_state)
+      fillTrajectoryMsg(trajectory_in, req.trajectory);
+    else
+      req.trajectory = trajectory_in;
 
     if(trajectory_filter_allowed_time_ == 0.0)
     {
-      trajectory_out = req.trajectory;
+      trajectory_out = shareTrajectory(req.trajectory);
       return true;
     }
     resetToStartState(planning_scene_state_);
@@ -347,16 +400,36 @@ private:
                                                             ros::Time::now(),
                                                             collision_models_->getWorldFrameId(),
                                                             req.start_state);
+    if(!from_current_state && !req.trajectory.points.empty())
+    {
+      for(unsigned int i = 0; i < req.start_state.joint_state.name.size(); i++)
+      {
+        for(unsigned int j = 0; j < req.trajectory.joint_names.size(); j++)
+        {
+          if(req.start_state.joint_state.name[i] == req.trajectory.joint_names[j] && j < req.trajectory.points[0].positions.size())
+            req.start_state.joint_state.position[i] = req.trajectory.points[0].positions[j];
+        }
+      }
+    }
     req.group_name = group_;
     req.path_constraints = original_request_.motion_plan_request.path_constraints;
-    req.goal_constraints = original_request_.motion_plan_request.goal_constraints;
+    if(reaches_goal)
+      req.goal_constraints = original_request_.motion_plan_request.goal_constraints;
     req.allowed_time = ros::Duration(trajectory_filter_allowed_time_);
     ros::Time smoothing_time = ros::Time::now();
     if(filter_trajectory_client_.call(req,res))
     {
+      if(res.trajectory.points.empty())
+      {
+        ROS_ERROR("Trajectory filter returned an empty trajectory");
+        return false;
+      }
       move_arm_stats_.trajectory_duration = (res.trajectory.points.back().time_from_start-res.trajectory.points.front().time_from_start).toSec();
-      move_arm_stats_.smoothing_time = (ros::Time::now()-smoothing_time).toSec();
-      trajectory_out = res.trajectory;
+      if(from_current_state)
+        move_arm_stats_.smoothing_time = (ros::Time::now()-smoothing_time).toSec();
+      else
+        move_arm_stats_.smoothing_time += (ros::Time::now()-smoothing_time).toSec();
+      trajectory_out = shareTrajectory(res.trajectory);
       return true;
     }
     else
@@ -366,9 +439,64 @@ private:
     }
   }
 
+  /// Split a planned trajectory for pipelined execution; both pieces contain
+  /// the point at the split.  Returns false if the plan is too short to be
+  /// worth splitting
+  bool splitTrajectory(const trajectory_msgs::JointTrajectory &trajectory,
+                       trajectory_msgs::JointTrajectory &prefix,
+                       trajectory_msgs::JointTrajectory &tail)
+  {
+    const int n = trajectory.points.size();
+    if(n < pipelined_min_points_ || n < 4)
+      return false;
+    int split = (int)(pipelined_prefix_fraction_ * (n - 1) + 0.5);
+    split = std::max(1, std::min(n - 2, split));
+    prefix.header = tail.header = trajectory.header;
+    prefix.joint_names = tail.joint_names = trajectory.joint_names;
+    prefix.points.assign(trajectory.points.begin(), trajectory.points.begin() + split + 1);
+    tail.points.assign(trajectory.points.begin() + split, trajectory.points.end());
+    return true;
+  }
+
+  /// Append a filtered tail to the filtered prefix that is executing.  The
+  /// prefix ends at rest where the tail starts, so the tail is blended in
+  /// over the end of the prefix to keep the arm moving through the split;
+  /// the blend stays clear of the part of the prefix the controller has
+  /// already reached.  blend_index is the first point of the result that
+  /// is not a point of the prefix
+  bool spliceTrajectory(const trajectory_msgs::JointTrajectory &prefix,
+                        const trajectory_msgs::JointTrajectory &tail,
+                        trajectory_msgs::JointTrajectoryConstPtr &spliced,
+                        unsigned int &blend_index)
+  {
+    double executing = (ros::Time::now() - controller_trajectory_start_).toSec();
+    trajectory_msgs::JointTrajectoryPtr result(new trajectory_msgs::JointTrajectory());
+    if(!move_arm::spliceTrajectories(prefix, tail, pipelined_blend_time_,
+                                     executing + pipelined_blend_lead_, *result, blend_index))
+    {
+      ROS_ERROR("Filtered pieces of the trajectory do not fit together");
+      return false;
+    }
+    move_arm_stats_.trajectory_duration = (result->points.back().time_from_start - result->points.front().time_from_start).toSec();
+    spliced = result;
+    return true;
+  }
+
   ///
   /// End Trajectory Filtering
   ///
+
+  /// Trajectories are handed between planning, filtering, checking and
+  /// control as shared, immutable messages; the points are moved, not
+  /// copied, out of the service responses they arrive in
+  trajectory_msgs::JointTrajectoryConstPtr shareTrajectory(trajectory_msgs::JointTrajectory &trajectory)
+  {
+    trajectory_msgs::JointTrajectoryPtr shared(new trajectory_msgs::JointTrajectory());
+    shared->header = trajectory.header;
+    shared->joint_names.swap(trajectory.joint_names);
+    shared->points.swap(trajectory.points);
+    return shared;
+  }
  
   void discretizeTrajectory(const trajectory_msgs::JointTrajectory &trajectory, 
                             trajectory_msgs::JointTrajectory &trajectory_out,
@@ -494,42 +622,39 @@ private:
     if(planning_scene_state_ == NULL) {
       ROS_INFO("Can't do pre-planning checks without planning state");
     }
+    // every check below is recorded, so that later checks and an in-process planner reuse it
+    request_validation_.clear();
     resetToStartState(planning_scene_state_);
     arm_navigation_msgs::ArmNavigationErrorCodes error_code;
-    if(!collision_models_->isKinematicStateValid(*planning_scene_state_,
-                                                 group_joint_names_,
-                                                 error_code,
-                                                 empty_goal_constraints,
-                                                 original_request_.motion_plan_request.path_constraints,
-						 true)) {
+    request_validation_.start_checked = true;
+    request_validation_.start_valid = collision_models_->isKinematicStateValid(*planning_scene_state_,
+                                                                               group_joint_names_,
+                                                                               request_validation_.start_error_code,
+                                                                               empty_goal_constraints,
+                                                                               original_request_.motion_plan_request.path_constraints,
+                                                                               true);
+    if(!request_validation_.start_valid) {
+      error_code = request_validation_.start_error_code;
       if(error_code.val == error_code.COLLISION_CONSTRAINTS_VIOLATED) {
         move_arm_action_result_.error_code.val = error_code.START_STATE_IN_COLLISION;
         collision_models_->getAllCollisionsForState(*planning_scene_state_,
                                                     move_arm_action_result_.contacts);
         ROS_ERROR("Starting state is in collision, can't plan");
-        visualization_msgs::MarkerArray arr;
-        std_msgs::ColorRGBA point_color_;
-        point_color_.a = 1.0;
-        point_color_.r = 1.0;
-        point_color_.g = .8;
-        point_color_.b = 0.04;
-
-        collision_models_->getAllCollisionPointMarkers(*planning_scene_state_,
-                                                       arr,
-                                                       point_color_,
-                                                       ros::Duration(0.0)); 
-        std_msgs::ColorRGBA col;
-        col.a = .9;
-        col.r = 1.0;
-        col.b = 1.0;
-        col.g = 0.0;
-	/*
-	  collision_models_->getRobotTrimeshMarkersGivenState(*planning_scene_state_,
-	  arr,
-	  true,
-	  ros::Duration(0.0));
-	*/
-        vis_marker_array_publisher_.publish(arr);
+        // the markers are another collision query, only made for someone watching
+        if(vis_marker_array_publisher_.getNumSubscribers() > 0) {
+          visualization_msgs::MarkerArray arr;
+          std_msgs::ColorRGBA point_color_;
+          point_color_.a = 1.0;
+          point_color_.r = 1.0;
+          point_color_.g = .8;
+          point_color_.b = 0.04;
+
+          collision_models_->getAllCollisionPointMarkers(*planning_scene_state_,
+                                                         arr,
+                                                         point_color_,
+                                                         ros::Duration(0.0)); 
+          vis_marker_array_publisher_.publish(arr);
+        }
       } else if (error_code.val == error_code.PATH_CONSTRAINTS_VIOLATED) {
         move_arm_action_result_.error_code.val = error_code.START_STATE_VIOLATES_PATH_CONSTRAINTS;
         ROS_ERROR("Starting state violated path constraints, can't plan");;
@@ -544,7 +669,10 @@ private:
     // processing and checking goal
     if (!move_arm_parameters_.disable_ik && isPoseGoal(req)) {
       ROS_DEBUG("Planning to a pose goal");
-      if(!convertPoseGoalToJointGoal(req)) {
+      ros::Time ik_time = ros::Time::now();
+      bool converted = convertPoseGoalToJointGoal(req);
+      move_arm_stats_.ik_time = (ros::Time::now()-ik_time).toSec();
+      if(!converted) {
 	ROS_INFO("Setting aborted because ik failed");
 	action_server_->setAborted(move_arm_action_result_);
 	return false;
@@ -552,24 +680,31 @@ private:
     }
     //if we still have pose constraints at this point it's probably a constrained combo goal
     if(!hasPoseGoal(req)) {
-      arm_navigation_msgs::RobotState empty_state;
-      empty_state.joint_state = arm_navigation_msgs::jointConstraintsToJointState(req.motion_plan_request.goal_constraints.joint_constraints);
-      planning_environment::setRobotStateAndComputeTransforms(empty_state, *planning_scene_state_);
-      arm_navigation_msgs::Constraints empty_constraints;
-      if(!collision_models_->isKinematicStateValid(*planning_scene_state_,
-						   group_joint_names_,
-						   error_code,
-						   original_request_.motion_plan_request.goal_constraints,
-						   original_request_.motion_plan_request.path_constraints,
-						   true)) {
+      // a goal from IK has been checked already
+      if(!request_validation_.goal_checked) {
+        arm_navigation_msgs::RobotState empty_state;
+        empty_state.joint_state = arm_navigation_msgs::jointConstraintsToJointState(req.motion_plan_request.goal_constraints.joint_constraints);
+        planning_environment::setRobotStateAndComputeTransforms(empty_state, *planning_scene_state_);
+        request_validation_.goal_checked = true;
+        request_validation_.goal_valid = collision_models_->isKinematicStateValid(*planning_scene_state_,
+                                                                                  group_joint_names_,
+                                                                                  request_validation_.goal_error_code,
+                                                                                  original_request_.motion_plan_request.goal_constraints,
+                                                                                  original_request_.motion_plan_request.path_constraints,
+                                                                                  true);
+        if(request_validation_.goal_error_code.val == request_validation_.goal_error_code.COLLISION_CONSTRAINTS_VIOLATED)
+          collision_models_->getAllCollisionsForState(*planning_scene_state_,
+                                                      request_validation_.contacts);
+      }
+      error_code = request_validation_.goal_error_code;
+      if(!request_validation_.goal_valid) {
 	if(error_code.val == error_code.JOINT_LIMITS_VIOLATED) {
 	  ROS_ERROR("Will not plan to requested joint goal since it violates joint limits constraints");
 	  move_arm_action_result_.error_code.val = move_arm_action_result_.error_code.JOINT_LIMITS_VIOLATED;
 	} else if(error_code.val == error_code.COLLISION_CONSTRAINTS_VIOLATED) {
 	  ROS_ERROR("Will not plan to requested joint goal since it is in collision");
 	  move_arm_action_result_.error_code.val = move_arm_action_result_.error_code.GOAL_IN_COLLISION;
-          collision_models_->getAllCollisionsForState(*planning_scene_state_,
-                                                      move_arm_action_result_.contacts);
+          move_arm_action_result_.contacts = request_validation_.contacts;
 	} else if(error_code.val == error_code.GOAL_CONSTRAINTS_VIOLATED) {
 	  ROS_ERROR("Will not plan to requested joint goal since it violates goal constraints");
 	  move_arm_action_result_.error_code.val = move_arm_action_result_.error_code.GOAL_VIOLATES_PATH_CONSTRAINTS;
@@ -590,6 +725,20 @@ private:
   bool createPlan(arm_navigation_msgs::GetMotionPlan::Request &req,  
                   arm_navigation_msgs::GetMotionPlan::Response &res)
   {
+    if(planner_ && root_handle_.resolveName(move_arm_parameters_.planner_service_name) == 
+       ros::names::resolve(in_process_planner_namespace_, "plan_kinematic_path"))
+    {
+      move_arm_stats_.planner_service_name = move_arm_parameters_.planner_service_name;
+      ROS_DEBUG("Issuing request for motion plan to the in-process planner");
+      planner_->computeValidatedPlan(req, res, &request_validation_);
+      if (res.trajectory.joint_trajectory.points.empty())
+      {
+        ROS_WARN("Motion planner was unable to plan a path to goal");
+        return false;
+      }
+      ROS_DEBUG("Motion planning succeeded");
+      return true;
+    }
     while(!ros::service::waitForService(move_arm_parameters_.planner_service_name, ros::Duration(1.0))) {
       ROS_INFO_STREAM("Waiting for requested service " << move_arm_parameters_.planner_service_name);
     }
@@ -649,12 +798,16 @@ private:
       controller_goal_handle_.cancel();
     return true;
   }
-  bool sendTrajectory(trajectory_msgs::JointTrajectory &current_trajectory)
+  /// A non-zero start_time sends a trajectory that replaces the executing one
+  /// from its original start, which is how pipelined execution extends it
+  bool sendTrajectory(const trajectory_msgs::JointTrajectory &current_trajectory,
+                      const ros::Time &start_time = ros::Time())
   {
-    current_trajectory.header.stamp = ros::Time::now()+ros::Duration(0.2);
-
+    // the one copy of the points that is made for the controller
     control_msgs::FollowJointTrajectoryGoal goal;  
     goal.trajectory = current_trajectory;
+    goal.trajectory.header.stamp = start_time.isZero() ? ros::Time::now()+ros::Duration(0.2) : start_time;
+    controller_trajectory_start_ = goal.trajectory.header.stamp;
 
     ROS_DEBUG("Sending trajectory with %d points and timestamp: %f",(int)goal.trajectory.points.size(),goal.trajectory.header.stamp.toSec());
     for(unsigned int i=0; i < goal.trajectory.joint_names.size(); i++)
@@ -731,6 +884,62 @@ private:
       break;
     }
   } 
+  /// Filter and check the rest of a plan whose start is already executing,
+  /// then hand the controller the whole trajectory again with its original
+  /// start time, so it carries on from wherever it is in the prefix
+  bool extendExecutingTrajectory()
+  {
+    trajectory_msgs::JointTrajectoryConstPtr tail = pending_tail_;
+    pending_tail_.reset();
+
+    trajectory_msgs::JointTrajectoryConstPtr filtered_tail;
+    if(!filterTrajectory(*tail, filtered_tail, false, true))
+      return false;
+
+    trajectory_msgs::JointTrajectoryConstPtr spliced;
+    unsigned int blend_index;
+    if(!spliceTrajectory(*current_trajectory_, *filtered_tail, spliced, blend_index))
+      return false;
+
+    // the blend leaves the planned path a little, so the blended part is
+    // checked along with the rest of the tail
+    trajectory_msgs::JointTrajectory rest;
+    rest.header = spliced->header;
+    rest.joint_names = spliced->joint_names;
+    rest.points.assign(spliced->points.begin() + (blend_index > 0 ? blend_index - 1 : 0), spliced->points.end());
+
+    arm_navigation_msgs::ArmNavigationErrorCodes error_code;
+    std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> traj_error_codes;
+    resetToStartState(planning_scene_state_);
+    if(!collision_models_->isJointTrajectoryValid(*planning_scene_state_,
+                                                  rest,
+                                                  original_request_.motion_plan_request.goal_constraints,
+                                                  original_request_.motion_plan_request.path_constraints,
+                                                  error_code,
+                                                  traj_error_codes,
+                                                  false))
+    {
+      ROS_WARN("Filtered rest of the trajectory is not valid (error %d); stopping and replanning", error_code.val);
+      return false;
+    }
+    current_trajectory_ = spliced;
+
+    arm_navigation_msgs::ArmNavigationErrorCodes controller_error_code;
+    if(isControllerDone(controller_error_code))
+    {
+      if(controller_error_code.val != controller_error_code.SUCCESS)
+      {
+        ROS_WARN("Controller failed while the rest of the trajectory was being filtered");
+        return false;
+      }
+      // the prefix finished first; the arm is waiting at the start of the tail
+      ROS_INFO("Prefix finished before the rest of the trajectory was ready");
+      return sendTrajectory(*filtered_tail);
+    }
+    ROS_DEBUG("Extending the executing trajectory to %u points", (unsigned int)spliced->points.size());
+    return sendTrajectory(*spliced, controller_trajectory_start_);
+  }
+
   bool isControllerDone(arm_navigation_msgs::ArmNavigationErrorCodes& error_code)
   {      
     if (controller_status_ == SUCCESS)
@@ -749,10 +958,12 @@ private:
   void fillTrajectoryMsg(const trajectory_msgs::JointTrajectory &trajectory_in, 
                          trajectory_msgs::JointTrajectory &trajectory_out)
   {
-    trajectory_out = trajectory_in;
+    trajectory_out.header = trajectory_in.header;
+    trajectory_out.joint_names = trajectory_in.joint_names;
     if(trajectory_in.points.empty())
     {
       ROS_WARN("No points in trajectory");
+      trajectory_out.points.clear();
       return;
     }
     // get the current state
@@ -775,6 +986,7 @@ private:
       if (joint.get() == NULL)
       {
         ROS_ERROR("Joint name %s not found in urdf model", name.c_str());
+        trajectory_out.points = trajectory_in.points;
         return;
       }
       if (joint->type == urdf::Joint::CONTINUOUS) {
@@ -797,7 +1009,8 @@ private:
     // decide whether we place the current state in front of the trajectory_in
     int include_first = (d > 0.1) ? 1 : 0;
     double offset = 0.0;
-    trajectory_out.points.resize(trajectory_in.points.size() + include_first);
+    trajectory_out.points.clear();
+    trajectory_out.points.reserve(trajectory_in.points.size() + include_first);
 
     if (include_first)
     {
@@ -817,15 +1030,13 @@ private:
       // 		      << current.position[4]
       // 		      << current.position[5]
       // 		      << current.position[6]);
-      trajectory_out.points[0].positions = arm_navigation_msgs::jointStateToJointTrajectoryPoint(current).positions;
-      trajectory_out.points[0].time_from_start = ros::Duration(0.0);
+      trajectory_msgs::JointTrajectoryPoint first;
+      first.positions = arm_navigation_msgs::jointStateToJointTrajectoryPoint(current).positions;
+      first.time_from_start = ros::Duration(0.0);
+      trajectory_out.points.push_back(first);
       offset = 0.3 + d;
     } 
-    for (unsigned int i = 0 ; i < trajectory_in.points.size() ; ++i)
-    {
-      trajectory_out.points[i+include_first].time_from_start = trajectory_in.points[i].time_from_start;
-      trajectory_out.points[i+include_first].positions = trajectory_in.points[i].positions;
-    }
+    trajectory_out.points.insert(trajectory_out.points.end(), trajectory_in.points.begin(), trajectory_in.points.end());
     trajectory_out.header.stamp = ros::Time::now();
   }
 
@@ -839,8 +1050,8 @@ private:
   void resetStateMachine()
   {
     num_planning_attempts_ = 0;
-    current_trajectory_.points.clear();
-    current_trajectory_.joint_names.clear();
+    current_trajectory_.reset();
+    pending_tail_.reset();
     state_ = PLANNING;    
   }
   bool executeCycle(arm_navigation_msgs::GetMotionPlan::Request &req)
@@ -861,12 +1072,10 @@ private:
 
         visualizeJointGoal(req);
         resetToStartState(planning_scene_state_);
-        if(collision_models_->isKinematicStateValid(*planning_scene_state_,
-                                                    group_joint_names_,
-                                                    error_code,
-                                                    original_request_.motion_plan_request.goal_constraints,
-                                                    original_request_.motion_plan_request.path_constraints,
-						    false)) {
+        // the start state passed the pre-planning checks, only the goal constraints are left to test
+        if(request_validation_.start_valid &&
+           planning_environment::doesKinematicStateObeyConstraints(*planning_scene_state_,
+                                                                   original_request_.motion_plan_request.goal_constraints)) {
           resetStateMachine();
 	  move_arm_action_result_.error_code.val = move_arm_action_result_.error_code.SUCCESS;
 	  action_server_->setSucceeded(move_arm_action_result_);
@@ -909,9 +1118,9 @@ private:
           else{
             ROS_DEBUG("Trajectory validity check was successful");
 	    
-	    current_trajectory_ = res.trajectory.joint_trajectory;
-	    visualizePlan(current_trajectory_);
-	    //          printTrajectory(current_trajectory_);
+	    current_trajectory_ = shareTrajectory(res.trajectory.joint_trajectory);
+	    visualizePlan(*current_trajectory_);
+	    //          printTrajectory(*current_trajectory_);
 	    state_ = START_CONTROL;
 	    ROS_DEBUG("Done planning. Transitioning to control");
 	  }
@@ -941,15 +1150,24 @@ private:
         move_arm_action_feedback_.time_to_completion = ros::Duration(1.0/move_arm_frequency_);
         action_server_->publishFeedback(move_arm_action_feedback_);
         ROS_DEBUG("Filtering Trajectory");
-        trajectory_msgs::JointTrajectory filtered_trajectory;
-        if(filterTrajectory(current_trajectory_, filtered_trajectory))
+        trajectory_msgs::JointTrajectoryConstPtr filtered_trajectory;
+        trajectory_msgs::JointTrajectory prefix, tail;
+        pending_tail_.reset();
+        if(pipelined_execution_ && splitTrajectory(*current_trajectory_, prefix, tail))
+        {
+          ROS_DEBUG("Filtering the first %u of %u points ahead of the rest", (unsigned int)prefix.points.size(), (unsigned int)current_trajectory_->points.size());
+          pending_tail_ = shareTrajectory(tail);
+        }
+        if(pending_tail_ ? filterTrajectory(prefix, filtered_trajectory, true, false) : filterTrajectory(*current_trajectory_, filtered_trajectory))
         {
           arm_navigation_msgs::ArmNavigationErrorCodes error_code;
           std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> traj_error_codes;
           resetToStartState(planning_scene_state_);
+          // a prefix is not expected to reach the goal
+          arm_navigation_msgs::Constraints no_goal_constraints;
           if(!collision_models_->isJointTrajectoryValid(*planning_scene_state_,
-                                                        filtered_trajectory,
-                                                        original_request_.motion_plan_request.goal_constraints,
+                                                        *filtered_trajectory,
+                                                        pending_tail_ ? no_goal_constraints : original_request_.motion_plan_request.goal_constraints,
                                                         original_request_.motion_plan_request.path_constraints,
                                                         error_code,
                                                         traj_error_codes,
@@ -965,6 +1183,7 @@ private:
               ROS_WARN("Filtered trajectory doesn't reach goal");
             }
             ROS_ERROR("Move arm will abort this goal.  Will replan");
+            pending_tail_.reset();
             state_ = PLANNING;
 	    num_planning_attempts_++;	    
 	    if(num_planning_attempts_ > req.motion_plan_request.num_planning_attempts)
@@ -991,7 +1210,7 @@ private:
         }
         ROS_DEBUG("Sending trajectory");
         move_arm_stats_.time_to_execution = (ros::Time::now() - ros::Time(move_arm_stats_.time_to_execution)).toSec();
-        if(sendTrajectory(current_trajectory_))
+        if(sendTrajectory(*current_trajectory_))
         {
           state_ = MONITOR;
         }
@@ -1007,9 +1226,27 @@ private:
     case MONITOR:
       {
         move_arm_action_feedback_.state = "monitor";
-        move_arm_action_feedback_.time_to_completion = current_trajectory_.points.back().time_from_start;
+        move_arm_action_feedback_.time_to_completion = current_trajectory_->points.back().time_from_start;
         action_server_->publishFeedback(move_arm_action_feedback_);
         ROS_DEBUG("Start to monitor");
+        if(pending_tail_)
+        {
+          if(!extendExecutingTrajectory())
+          {
+            stopTrajectory();
+            pending_tail_.reset();
+            state_ = PLANNING;
+            num_planning_attempts_++;
+            if(num_planning_attempts_ > req.motion_plan_request.num_planning_attempts)
+            {
+              resetStateMachine();
+              ROS_INFO_STREAM("Setting aborted because we're out of planning attempts");
+              action_server_->setAborted(move_arm_action_result_);
+              return true;
+            }
+          }
+          break;
+        }
         arm_navigation_msgs::ArmNavigationErrorCodes controller_error_code;
         if(isControllerDone(controller_error_code))
         {
@@ -1188,7 +1425,14 @@ private:
 
     current_planning_scene_ = planning_scene_res.planning_scene;
 
-    planning_scene_state_ = collision_models_->setPlanningScene(current_planning_scene_);
+    if(collision_models_interface_ != NULL)
+    {
+      // the in-process planner plans against the scene state held by the interface
+      if(collision_models_interface_->setPlanningSceneWithCallbacks(current_planning_scene_))
+        planning_scene_state_ = collision_models_interface_->getPlanningSceneState();
+    }
+    else
+      planning_scene_state_ = collision_models_->setPlanningScene(current_planning_scene_);
 
     collision_models_->disableCollisionsForNonUpdatedLinks(group_);
 
@@ -1205,7 +1449,9 @@ private:
 
   bool revertPlanningScene() {
     if(planning_scene_state_ != NULL) {
-      collision_models_->revertPlanningScene(planning_scene_state_);
+      // the interface owns its scene state and reverts it when the next scene is set
+      if(collision_models_interface_ == NULL)
+        collision_models_->revertPlanningScene(planning_scene_state_);
       planning_scene_state_ = NULL;
     }
     return true;
@@ -1284,6 +1530,9 @@ private:
     move_arm_action_feedback_.state = "visualizing plan";
     if(action_server_->isActive())
       action_server_->publishFeedback(move_arm_action_feedback_);
+    // don't copy the trajectory into a display message nobody will see
+    if(display_path_publisher_.getNumSubscribers() == 0)
+      return;
     arm_navigation_msgs::DisplayTrajectory d_path;
     d_path.model_id = original_request_.motion_plan_request.group_name;
     d_path.trajectory.joint_trajectory = trajectory;
@@ -1388,7 +1637,19 @@ private:
   tf::TransformListener *tf_;
   MoveArmState state_;
   double move_arm_frequency_;      	
-  trajectory_msgs::JointTrajectory current_trajectory_;
+  trajectory_msgs::JointTrajectoryConstPtr current_trajectory_;
+  bool in_process_planner_;
+  std::string in_process_planner_namespace_;
+  planning_environment::CollisionModelsInterface* collision_models_interface_;
+  boost::shared_ptr<ompl_ros_interface::OmplRos> planner_;
+  ompl_ros_interface::RequestValidation request_validation_;
+  trajectory_msgs::JointTrajectoryConstPtr pending_tail_;
+  ros::Time controller_trajectory_start_;
+  bool pipelined_execution_;
+  double pipelined_prefix_fraction_;
+  int pipelined_min_points_;
+  double pipelined_blend_time_;
+  double pipelined_blend_lead_;
 
   int num_planning_attempts_;
 
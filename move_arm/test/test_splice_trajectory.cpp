@@ -0,0 +1,178 @@
+/*********************************************************************
+ *
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2008, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <move_arm/splice_trajectory.h>
+
+static trajectory_msgs::JointTrajectoryPoint makePoint(double time, double position, double velocity, double other)
+{
+  trajectory_msgs::JointTrajectoryPoint point;
+  point.positions.push_back(position);
+  point.positions.push_back(other);
+  point.velocities.push_back(velocity);
+  point.velocities.push_back(0.0);
+  point.accelerations.resize(2, 0.0);
+  point.time_from_start = ros::Duration(time);
+  return point;
+}
+
+// a rest to rest motion of the first joint from start to start+1 over two seconds
+static trajectory_msgs::JointTrajectory makePiece(double start)
+{
+  trajectory_msgs::JointTrajectory piece;
+  piece.joint_names.push_back("a");
+  piece.joint_names.push_back("b");
+  piece.points.push_back(makePoint(0.0, start, 0.0, 0.3));
+  piece.points.push_back(makePoint(1.0, start + 0.5, 0.75, 0.3));
+  piece.points.push_back(makePoint(2.0, start + 1.0, 0.0, 0.3));
+  return piece;
+}
+
+static double velocityAt(const trajectory_msgs::JointTrajectory &trajectory, double time)
+{
+  std::vector<double> pos, vel, acc;
+  move_arm::sampleTrajectory(trajectory, time, pos, vel, acc);
+  return vel[0];
+}
+
+static unsigned int pointAt(const trajectory_msgs::JointTrajectory &trajectory, double time)
+{
+  for(unsigned int i = 0; i < trajectory.points.size(); i++)
+    if(fabs(trajectory.points[i].time_from_start.toSec() - time) < 1e-6)
+      return i;
+  return trajectory.points.size();
+}
+
+TEST(TestSpliceTrajectory, BlendKeepsVelocityContinuous)
+{
+  trajectory_msgs::JointTrajectory prefix = makePiece(0.0);
+  trajectory_msgs::JointTrajectory tail = makePiece(1.0);
+  trajectory_msgs::JointTrajectory spliced;
+  unsigned int blend_index;
+  ASSERT_TRUE(move_arm::spliceTrajectories(prefix, tail, 0.5, 0.0, spliced, blend_index));
+
+  // the prefix is kept up to the blend, which starts half a second before its end
+  ASSERT_EQ(2u, blend_index);
+  for(unsigned int i = 0; i < blend_index; i++)
+    EXPECT_EQ(prefix.points[i].positions, spliced.points[i].positions);
+  EXPECT_NEAR(1.5, spliced.points[blend_index].time_from_start.toSec(), 1e-6);
+
+  // the point where the prefix used to stop is still moving, and the velocity
+  // is the same on either side of it
+  unsigned int splice = pointAt(spliced, 2.0);
+  ASSERT_LT(splice, spliced.points.size());
+  EXPECT_GT(spliced.points[splice].velocities[0], 0.1);
+  EXPECT_NEAR(velocityAt(spliced, 2.0 - 1e-4), velocityAt(spliced, 2.0 + 1e-4), 1e-3);
+  EXPECT_NEAR(spliced.points[splice].velocities[0], velocityAt(spliced, 2.0), 1e-9);
+
+  // and so is every other point of the blend
+  for(unsigned int i = blend_index; i + 1 < spliced.points.size(); i++)
+  {
+    double t = spliced.points[i].time_from_start.toSec();
+    EXPECT_NEAR(velocityAt(spliced, t - 1e-4), velocityAt(spliced, t + 1e-4), 1e-3);
+  }
+
+  // the arm never stops between the start and the end
+  for(double t = 0.05; t < 3.45; t += 0.05)
+    EXPECT_GT(velocityAt(spliced, t), 0.0) << "at " << t;
+
+  // the tail is followed to its end, without moving the other joint
+  EXPECT_NEAR(3.5, spliced.points.back().time_from_start.toSec(), 1e-6);
+  EXPECT_NEAR(2.0, spliced.points.back().positions[0], 1e-9);
+  for(unsigned int i = 0; i < spliced.points.size(); i++)
+    EXPECT_NEAR(0.3, spliced.points[i].positions[1], 1e-9);
+}
+
+TEST(TestSpliceTrajectory, BlendIsSumOfPieces)
+{
+  trajectory_msgs::JointTrajectory prefix = makePiece(0.0);
+  trajectory_msgs::JointTrajectory tail = makePiece(1.0);
+  trajectory_msgs::JointTrajectory spliced;
+  unsigned int blend_index;
+  ASSERT_TRUE(move_arm::spliceTrajectories(prefix, tail, 0.8, 0.0, spliced, blend_index));
+
+  std::vector<double> pos, vel, acc, prefix_pos, prefix_vel, prefix_acc, tail_pos, tail_vel, tail_acc;
+  for(double t = 1.2; t <= 2.0; t += 0.01)
+  {
+    move_arm::sampleTrajectory(spliced, t, pos, vel, acc);
+    move_arm::sampleTrajectory(prefix, t, prefix_pos, prefix_vel, prefix_acc);
+    move_arm::sampleTrajectory(tail, t - 1.2, tail_pos, tail_vel, tail_acc);
+    EXPECT_NEAR(prefix_pos[0] + tail_pos[0] - 1.0, pos[0], 1e-6);
+    EXPECT_NEAR(prefix_vel[0] + tail_vel[0], vel[0], 1e-6);
+    EXPECT_NEAR(prefix_acc[0] + tail_acc[0], acc[0], 1e-6);
+  }
+}
+
+TEST(TestSpliceTrajectory, BlendStaysClearOfExecutingPart)
+{
+  trajectory_msgs::JointTrajectory prefix = makePiece(0.0);
+  trajectory_msgs::JointTrajectory tail = makePiece(1.0);
+  trajectory_msgs::JointTrajectory spliced;
+  unsigned int blend_index;
+
+  // the controller is already past where the blend would start
+  ASSERT_TRUE(move_arm::spliceTrajectories(prefix, tail, 0.5, 1.8, spliced, blend_index));
+  EXPECT_NEAR(1.8, spliced.points[blend_index].time_from_start.toSec(), 1e-6);
+  EXPECT_NEAR(velocityAt(spliced, 1.8 - 1e-4), velocityAt(spliced, 1.8 + 1e-4), 1e-3);
+
+  // with nothing of the prefix left to blend into, the tail just follows it
+  ASSERT_TRUE(move_arm::spliceTrajectories(prefix, tail, 0.5, 2.5, spliced, blend_index));
+  ASSERT_EQ(5u, spliced.points.size());
+  EXPECT_EQ(2u, blend_index);
+  EXPECT_NEAR(2.0, spliced.points[2].time_from_start.toSec(), 1e-6);
+  EXPECT_NEAR(0.0, spliced.points[2].velocities[0], 1e-9);
+  EXPECT_NEAR(4.0, spliced.points.back().time_from_start.toSec(), 1e-6);
+  EXPECT_NEAR(2.0, spliced.points.back().positions[0], 1e-9);
+}
+
+TEST(TestSpliceTrajectory, MismatchedPiecesAreRejected)
+{
+  trajectory_msgs::JointTrajectory prefix = makePiece(0.0);
+  trajectory_msgs::JointTrajectory tail = makePiece(1.0);
+  tail.joint_names[1] = "c";
+  trajectory_msgs::JointTrajectory spliced;
+  unsigned int blend_index;
+  EXPECT_FALSE(move_arm::spliceTrajectories(prefix, tail, 0.5, 0.0, spliced, blend_index));
+  tail = makePiece(1.0);
+  tail.points[1].positions.pop_back();
+  EXPECT_FALSE(move_arm::spliceTrajectories(prefix, tail, 0.5, 0.0, spliced, blend_index));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -63,6 +63,14 @@ class OmplRos
 public:
 
   OmplRos();
+
+  /**
+     @brief Plan in the namespace of node_handle against a collision models interface owned by the
+     caller, whose planning scene the caller sets. Used to host the planner inside another node.
+   */
+  OmplRos(const ros::NodeHandle &node_handle,
+          planning_environment::CollisionModelsInterface *cmi);
+
   ~OmplRos();
 
   /**
@@ -71,12 +79,10 @@ public:
   void run(void);
 
   /**
-     @brief Get a particular planner for a given group
+     @brief Initialize the planners without advertising the planning service; 
+     plans are then requested through computePlan
    */
-  boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup>& getPlanner(const std::string &group_name, 
-                                                                          const std::string &planner_config_name);
-
-private:
+  bool configure(void);
 
  /**
     @brief Planning - choose the correct planner and then call it
@@ -85,6 +91,32 @@ private:
   bool computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
                    arm_navigation_msgs::GetMotionPlan::Response &response);
 
+ /**
+    @brief Plan for a request whose start and goal the caller has already checked in the same planning 
+    scene; those checks are not repeated
+ */
+  bool computeValidatedPlan(arm_navigation_msgs::GetMotionPlan::Request &request,
+                            arm_navigation_msgs::GetMotionPlan::Response &response,
+                            const ompl_ros_interface::RequestValidation *validation);
+
+  /**
+     @brief Get a particular planner for a given group
+   */
+  boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup>& getPlanner(const std::string &group_name, 
+                                                                          const std::string &planner_config_name);
+
+  /**
+     @brief Create and initialize a planner for a given group and planner configuration, using the planner type 
+     set for the group on the param server. Returns an empty pointer on failure.
+   */
+  static boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> createPlanningGroup(const ros::NodeHandle &node_handle,
+                                                                                         const std::string &param_server_prefix,
+                                                                                         const std::string &group_name,
+                                                                                         const std::string &planner_config_name,
+                                                                                         planning_environment::CollisionModelsInterface *cmi);
+
+private:
+
  /**
     @brief Get the names of all groups we will be planning for
  */
@@ -108,6 +140,7 @@ private:
   boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> empty_ptr;
   ros::ServiceServer                     plan_path_service_;
   planning_environment::CollisionModelsInterface *collision_models_interface_;
+  bool owns_collision_models_interface_;
   ros::NodeHandle                        node_handle_;
   std::string default_planner_config_;
   bool publish_diagnostics_;
@@ -0,0 +1,208 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef OMPL_ROS_CONSTRAINED_SAMPLING_H_
+#define OMPL_ROS_CONSTRAINED_SAMPLING_H_
+
+#include <planning_models/kinematic_state.h>
+#include <arm_navigation_msgs/Constraints.h>
+
+#include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
+
+#include <ompl/base/StateSampler.h>
+#include <ompl/base/MotionValidator.h>
+#include <ompl/base/DiscreteMotionValidator.h>
+#include <ompl/base/SpaceInformation.h>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/scoped_ptr.hpp>
+
+namespace ompl_ros_interface
+{
+/**
+ * @class OmplRosConstraintProjector
+ * @brief Projects joint space states onto the manifold defined by the orientation path constraints
+ * of a request. Projection runs damped least squares iterations on the roll, pitch and yaw error 
+ * that the orientation constraint evaluator computes, using a finite difference jacobian.
+ */
+class OmplRosConstraintProjector
+{
+public:
+  /**
+   * @brief Default constructor
+   * @param state_space The state space that states to be projected belong to
+   * @param mapping The mapping from the ompl state to the physical joint group
+   */
+  OmplRosConstraintProjector(const ompl::base::StateSpacePtr &state_space,
+                             const ompl_ros_interface::OmplStateToKinematicStateMapping &mapping);
+
+  /**
+   * @brief Set the parameters used in projection
+   * @param tolerance_fraction The fraction of each orientation tolerance that projection aims for
+   * @param max_iterations The maximum number of iterations per projection
+   */
+  void setParameters(double tolerance_fraction, 
+                     unsigned int max_iterations);
+
+  /**
+   * @brief Configure the projector for a new request. Only orientation constraints on links that are 
+   * moved by the physical group are used. 
+   * @param kinematic_state The state of the whole robot for this request
+   * @param physical_group_name The name of the physical group being planned for
+   * @param path_constraints The path constraints for this request, in the planning frame
+   * @return true if there is at least one constraint that states will be projected on
+   */
+  bool configureOnRequest(const planning_models::KinematicState *kinematic_state,
+                          const std::string &physical_group_name,
+                          const arm_navigation_msgs::Constraints &path_constraints);
+
+  /**
+   * @brief Remove the constraints configured for the last request
+   */
+  void clear();
+
+  /**
+   * @brief Return whether there are constraints to project on
+   */
+  bool isActive() const
+  {
+    return active_;
+  }
+
+  /**
+   * @brief Project a state onto the constraint manifold in place
+   * @return true if the projected state satisfies the orientation constraints
+   */
+  bool project(ompl::base::State *state) const;
+
+private:
+
+  struct ConstraintLink
+  {
+    const planning_models::KinematicState::LinkState* link_state;
+    tf::Matrix3x3 inverse_rotation;
+    bool header_frame;
+    double tolerance[3];
+  };
+
+  bool computeError(const ompl::base::State *state,
+                    std::vector<double> &error) const;
+
+  bool computeResidual(const std::vector<double> &error,
+                       std::vector<double> &residual) const;
+
+  void getProjectedValues(ompl::base::State *state,
+                          std::vector<double*> &values) const;
+
+  ompl::base::StateSpacePtr state_space_;
+  ompl_ros_interface::OmplStateToKinematicStateMapping mapping_;
+
+  boost::scoped_ptr<planning_models::KinematicState> kinematic_state_;
+  planning_models::KinematicState::JointStateGroup* joint_state_group_;
+  std::vector<ConstraintLink> constraint_links_;
+
+  double tolerance_fraction_;
+  unsigned int max_iterations_;
+  bool active_;
+
+  mutable boost::mutex lock_;
+};
+
+typedef boost::shared_ptr<ompl_ros_interface::OmplRosConstraintProjector> OmplRosConstraintProjectorPtr;
+
+/**
+ * @class OmplRosConstrainedStateSampler
+ * @brief A state sampler that projects the samples of the default sampler onto the constraint manifold
+ */
+class OmplRosConstrainedStateSampler : public ompl::base::StateSampler
+{
+public:
+  OmplRosConstrainedStateSampler(const ompl::base::StateSpace *state_space,
+                                 const OmplRosConstraintProjectorPtr &projector,
+                                 unsigned int max_attempts);
+
+  virtual void sampleUniform(ompl::base::State *state);
+
+  virtual void sampleUniformNear(ompl::base::State *state, 
+                                 const ompl::base::State *near, 
+                                 const double distance);
+
+  virtual void sampleGaussian(ompl::base::State *state, 
+                              const ompl::base::State *mean, 
+                              const double std_dev);
+
+private:
+  ompl::base::StateSamplerPtr default_sampler_;
+  OmplRosConstraintProjectorPtr projector_;
+  unsigned int max_attempts_;
+};
+
+/**
+ * @class OmplRosConstrainedMotionValidator
+ * @brief A motion validator that checks the projection of each interpolated state of a motion. 
+ * Paths found with this validator have to be interpolated with interpolateSolutionPath() so that
+ * the executed states are the ones that were checked.
+ */
+class OmplRosConstrainedMotionValidator : public ompl::base::MotionValidator
+{
+public:
+  OmplRosConstrainedMotionValidator(ompl::base::SpaceInformation *si,
+                                    const OmplRosConstraintProjectorPtr &projector);
+
+  virtual bool checkMotion(const ompl::base::State *s1, 
+                           const ompl::base::State *s2) const;
+
+  virtual bool checkMotion(const ompl::base::State *s1, 
+                           const ompl::base::State *s2, 
+                           std::pair<ompl::base::State*, double> &last_valid) const;
+
+  /**
+   * @brief Interpolate a path the same way motions are checked by this validator
+   * @return false if a projected state could not be computed
+   */
+  bool interpolateSolutionPath(ompl::geometric::PathGeometric &path) const;
+
+private:
+  bool computeMotion(const ompl::base::State *s1, 
+                     const ompl::base::State *s2,
+                     std::vector<ompl::base::State*> *states,
+                     std::pair<ompl::base::State*, double> *last_valid) const;
+
+  ompl::base::MotionValidatorPtr default_validator_;
+  OmplRosConstraintProjectorPtr projector_;
+};
+
+}
+
+#endif //OMPL_ROS_CONSTRAINED_SAMPLING_H_
@@ -0,0 +1,128 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef OMPL_ROS_PLAN_CACHE_H_
+#define OMPL_ROS_PLAN_CACHE_H_
+
+#include <ros/ros.h>
+#include <arm_navigation_msgs/MotionPlanRequest.h>
+#include <arm_navigation_msgs/RobotTrajectory.h>
+
+#include <map>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace ompl_ros_interface
+{
+/**
+ * @class OmplRosPlanCache
+ * @brief A cache of planned trajectories for repeated requests. Requests are keyed on a quantized start 
+ * state for the group, and on the goal and path constraints with their positions quantized and header stamps
+ * removed. Cached trajectories are not guaranteed to be valid in the current planning scene; they must be 
+ * revalidated by the caller before they are used.
+ */
+class OmplRosPlanCache
+{
+public:
+  /**
+   * @brief Default constructor
+   * @param max_size The maximum number of trajectories stored, the least recently used entry is dropped when this is exceeded
+   * @param resolution The resolution that joint values and positions are quantized with
+   */
+  OmplRosPlanCache(unsigned int max_size, 
+                   double resolution);
+
+  /**
+   * @brief Compute the key for a request
+   * @param start_values The start values of the joints in the group being planned for
+   * @param request The motion plan request
+   */
+  std::string computeKey(const std::vector<double> &start_values,
+                         const arm_navigation_msgs::MotionPlanRequest &request) const;
+
+  /**
+   * @brief Look up the trajectory stored for a key, marking it as the most recently used entry
+   * @param key The key computed for the request
+   * @param trajectory The stored trajectory
+   * @param planning_time The time that it took to plan the stored trajectory
+   * @return false if there is no trajectory for this key
+   */
+  bool lookup(const std::string &key,
+              arm_navigation_msgs::RobotTrajectory &trajectory,
+              double &planning_time);
+
+  /**
+   * @brief Store the trajectory for a key, replacing any previous entry
+   */
+  void store(const std::string &key,
+             const arm_navigation_msgs::RobotTrajectory &trajectory,
+             double planning_time);
+
+  /**
+   * @brief Remove the trajectory stored for a key
+   */
+  void remove(const std::string &key);
+
+  /**
+   * @brief Remove all trajectories
+   */
+  void clear();
+
+  unsigned int size() const
+  {
+    return entries_.size();
+  }
+
+private:
+
+  struct Entry
+  {
+    arm_navigation_msgs::RobotTrajectory trajectory;
+    double planning_time;
+    std::list<std::string>::iterator order;
+  };
+
+  double quantize(double value) const;
+
+  void quantizeConstraints(arm_navigation_msgs::Constraints &constraints) const;
+
+  std::map<std::string, Entry> entries_;
+  std::list<std::string> order_;
+  unsigned int max_size_;
+  double resolution_;
+};
+
+}
+#endif //OMPL_ROS_PLAN_CACHE_H_
@@ -58,8 +58,11 @@ public:
    * @param description - the namespace containing the parameters corresponding to the planner
    * @param config - the actual name of the configuration space for this planner, the parameters will be 
 read from the ROS parameter server at "description/config".
+   * @param group (optional) - the group using this configuration. Parameters at 
+"description/group/planner_config_overrides/config" take precedence over the shared ones.
    */
-  PlannerConfig(const std::string &description, const std::string &config) : description_(description), config_(config)
+  PlannerConfig(const std::string &description, const std::string &config, const std::string &group = "") : 
+    description_(description), config_(config), group_(group)
   {
   }
   
@@ -102,9 +105,12 @@ read from the ROS parameter server at "description/config".
   int         getParamInt(const std::string &param, int def);
   
 private:
+
+  std::string getParamName(const std::string &param);
   
   std::string     description_;
   std::string     config_;
+  std::string     group_;
   ros::NodeHandle nh_;	  
 };
 
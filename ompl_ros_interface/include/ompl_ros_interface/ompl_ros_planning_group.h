@@ -54,6 +54,9 @@
 #include <ompl_ros_interface/ompl_ros_state_validity_checker.h>
 #include <ompl_ros_interface/ompl_ros_projection_evaluator.h>
 #include <ompl_ros_interface/ompl_ros_planner_config.h>
+#include <ompl_ros_interface/ompl_ros_constrained_sampling.h>
+#include <ompl_ros_interface/ompl_ros_plan_cache.h>
+#include <ompl_ros_interface/ompl_ros_request_validation.h>
 #include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
 
 // OMPL
@@ -80,7 +83,7 @@ namespace ompl_ros_interface
   {
   public:
     
-    OmplRosPlanningGroup(){}
+    OmplRosPlanningGroup():request_validation_(NULL),plan_cache_hits_(0),plan_cache_misses_(0),plan_cache_time_saved_(0.0),last_plan_from_cache_(false){}
     
     /**
        @brief Initialize the planning group from the param server
@@ -114,9 +117,32 @@ namespace ompl_ros_interface
       @brief Compute the plan
       @param The motion planning request
       @param The motion planner response
+      @param Start and goal checks already run on the request by the caller, if any
      */
     bool computePlan(arm_navigation_msgs::GetMotionPlan::Request &request, 
-                     arm_navigation_msgs::GetMotionPlan::Response &response);
+                     arm_navigation_msgs::GetMotionPlan::Response &response,
+                     const ompl_ros_interface::RequestValidation *validation = NULL);
+
+    /*
+      @brief Return whether the last plan was a cached plan
+     */
+    bool lastPlanFromCache() const
+    {
+      return last_plan_from_cache_;
+    }
+
+    /*
+      @brief Return the number of requests answered from the plan cache, the number of lookups that 
+      had to be planned for and the total planning time saved by the cache
+     */
+    void getPlanCacheStatistics(unsigned int &hits,
+                                unsigned int &misses,
+                                double &time_saved) const
+    {
+      hits = plan_cache_hits_;
+      misses = plan_cache_misses_;
+      time_saved = plan_cache_time_saved_;
+    }
 
     /**
        @brief The underlying planner to be used for planning
@@ -159,6 +185,15 @@ namespace ompl_ros_interface
      */
     virtual bool initializePlanningStateSpace(ompl::base::StateSpacePtr &state_space) = 0;
 
+    /**
+     * @brief Initialize the projector used for sampling on orientation path constraints. Groups that do not plan
+     * directly in joint space do not support projection and return false.
+     */
+    virtual bool initializeConstraintProjector(ompl_ros_interface::OmplRosConstraintProjectorPtr &constraint_projector)
+    {
+      return false;
+    }
+
     std::string group_name_;///the name of the group
 
     planning_environment::CollisionModelsInterface* collision_models_interface_;///A pointer to an instance of the planning monitor
@@ -186,8 +221,28 @@ namespace ompl_ros_interface
      */
     virtual arm_navigation_msgs::RobotTrajectory getSolutionPath() = 0;
 
+    /**
+       @brief The projector onto orientation path constraints, set if constrained sampling is enabled
+    */
+    ompl_ros_interface::OmplRosConstraintProjectorPtr constraint_projector_;
+
+    /**
+       @brief The motion validator that checks projected motions, set if constrained sampling is enabled
+    */
+    boost::shared_ptr<ompl_ros_interface::OmplRosConstrainedMotionValidator> constrained_motion_validator_;
+
+    /**
+       @brief Returns true if the current request is planned with constrained sampling
+    */
+    bool isConstrainedSamplingActive() const
+    {
+      return constraint_projector_ && constraint_projector_->isActive();
+    }
+
   protected:
     ros::NodeHandle node_handle_;
+    /// Checks already run on the request being planned for; NULL outside of computePlan
+    const ompl_ros_interface::RequestValidation *request_validation_;
     bool omplPathGeometricToRobotTrajectory(const ompl::geometric::PathGeometric &path, 
                                             arm_navigation_msgs::RobotTrajectory &robot_trajectory);
     bool finish(const bool &result);
@@ -202,8 +257,23 @@ namespace ompl_ros_interface
 
     ompl::base::PlannerPtr ompl_planner_;
 
+    boost::scoped_ptr<ompl_ros_interface::OmplRosPlanCache> plan_cache_;
+    unsigned int plan_cache_hits_, plan_cache_misses_;
+    double plan_cache_time_saved_;
+    bool last_plan_from_cache_;
+
     bool initializeProjectionEvaluator();
 
+    bool initializeConstrainedSampling();
+
+    bool getCachedPlan(const std::string &key,
+                       arm_navigation_msgs::GetMotionPlan::Request &request, 
+                       arm_navigation_msgs::GetMotionPlan::Response &response);
+
+    static ompl::base::StateSamplerPtr allocConstrainedStateSampler(const ompl_ros_interface::OmplRosConstraintProjectorPtr &projector,
+                                                                    unsigned int max_attempts,
+                                                                    const ompl::base::StateSpace *state_space);
+
     bool initializePhysicalGroup();
 
     bool initializePlanner();
@@ -0,0 +1,85 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef OMPL_ROS_REQUEST_VALIDATION_H_
+#define OMPL_ROS_REQUEST_VALIDATION_H_
+
+#include <arm_navigation_msgs/ArmNavigationErrorCodes.h>
+#include <arm_navigation_msgs/ContactInformation.h>
+#include <sensor_msgs/JointState.h>
+
+#include <vector>
+
+namespace ompl_ros_interface
+{
+/**
+ * @class RequestValidation
+ * @brief Results of the start and goal checks that a caller (e.g. move_arm) has already run on a motion plan 
+ * request, in the planning scene the planner plans in. Passed along with the request to a planner in the same 
+ * process so that the checks are not repeated. A check that has not been run is left unchecked and is done by
+ * the planner as usual. Error codes are as returned by CollisionModels::isKinematicStateValid.
+ */
+struct RequestValidation
+{
+  RequestValidation()
+  {
+    clear();
+  }
+
+  void clear()
+  {
+    start_checked = start_valid = false;
+    goal_checked = goal_valid = false;
+    start_error_code.val = goal_error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::SUCCESS;
+    contacts.clear();
+    ik_solution = sensor_msgs::JointState();
+  }
+
+  /// The start state was checked for joint limits, path constraints and collisions
+  bool start_checked, start_valid;
+  arm_navigation_msgs::ArmNavigationErrorCodes start_error_code;
+
+  /// The (single) joint goal was checked for joint limits, goal and path constraints and collisions
+  bool goal_checked, goal_valid;
+  arm_navigation_msgs::ArmNavigationErrorCodes goal_error_code;
+
+  /// Contacts of whichever checked state was found in collision
+  std::vector<arm_navigation_msgs::ContactInformation> contacts;
+
+  /// The IK solution a pose goal was turned into, if any
+  sensor_msgs::JointState ik_solution;
+};
+}
+
+#endif
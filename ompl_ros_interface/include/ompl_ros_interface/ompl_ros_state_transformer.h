@@ -106,6 +106,13 @@ public:
   virtual bool forwardTransform(const arm_navigation_msgs::RobotState &robot_state,
                                 ompl::base::State &ompl_state) = 0;
 
+  /**
+   * @brief Set the state that the next inverse transforms are computed from, e.g. the start of a motion that 
+   * is being checked. Transformers that search for a solution can use the solution for this state as a seed.
+   * @param parent_state - the parent state, or NULL if there is none
+   */ 
+  virtual void setParentState(const ompl::base::State *parent_state){};
+
   /**
    * @brief Return the frame in which planning state space is defined
    */ 
@@ -88,6 +88,11 @@ namespace ompl_ros_interface
      */
     virtual bool initializePlanningStateSpace(ompl::base::StateSpacePtr &state_space);
 
+    /**
+     * @brief Initialize the projector used for sampling on orientation path constraints
+     */
+    virtual bool initializeConstraintProjector(ompl_ros_interface::OmplRosConstraintProjectorPtr &constraint_projector);
+
     /**
       @brief Returns the solution path
      */
@@ -80,6 +80,10 @@ public:
   virtual bool forwardTransform(const arm_navigation_msgs::RobotState &robot_state,
                                 ompl::base::State &ompl_state);
 
+  /* @brief Seed the following IK queries from the solution found for the parent state
+   */ 
+  virtual void setParentState(const ompl::base::State *parent_state);
+
   /* 
      @brief Get a default physical state
   */ 
@@ -95,9 +99,22 @@ private:
   ompl_ros_interface::OmplStateToRobotStateMapping ompl_state_to_robot_state_mapping_;
   ompl_ros_interface::RobotStateToOmplStateMapping robot_state_to_ompl_state_mapping_;
 
+  /* IK solutions for the task space states seen during the current planning request, keyed by the values of the state. 
+     Failures are not cached so that a state is retried with a fresh seed the next time it is checked */
+  std::map<std::vector<double>, std::vector<double> > ik_cache_;
+
+  /* The cache key of the parent state set through setParentState(), empty if there is none */
+  std::vector<double> parent_key_;
+
   void omplStateToPose(const ompl::base::State &ompl_state,
                        geometry_msgs::Pose &pose);
 
+  void omplStateToCacheKey(const ompl::base::State &ompl_state,
+                           std::vector<double> &key);
+
+  bool computeIK(const ompl::base::State &ompl_state,
+                 std::vector<double> &solution);
+
   double generateRandomNumber(const double &min, const double &max);
   void generateRandomState(arm_navigation_msgs::RobotState &robot_state);
 
@@ -39,6 +39,7 @@
 
 #include <ompl_ros_interface/ompl_ros_state_validity_checker.h>
 #include <ompl_ros_interface/ompl_ros_state_transformer.h>
+#include <ompl/base/DiscreteMotionValidator.h>
 
 namespace ompl_ros_interface
 {
@@ -110,5 +111,28 @@ protected:
   boost::shared_ptr<ompl_ros_interface::OmplRosStateTransformer> state_transformer_;
   ompl_ros_interface::RobotStateToKinematicStateMapping robot_state_to_joint_state_group_mapping_;
 };
+
+/**
+ * @class OmplRosTaskSpaceMotionValidator
+ * @brief Checks motions in task space like the default discrete validator, but first tells the state transformer
+ * that the start of the motion is the parent of the states checked along it
+ */
+class OmplRosTaskSpaceMotionValidator : public ompl::base::MotionValidator
+{
+public:
+  OmplRosTaskSpaceMotionValidator(ompl::base::SpaceInformation *si,
+                                  const boost::shared_ptr<ompl_ros_interface::OmplRosStateTransformer> &state_transformer);
+
+  virtual bool checkMotion(const ompl::base::State *s1, 
+                           const ompl::base::State *s2) const;
+
+  virtual bool checkMotion(const ompl::base::State *s1, 
+                           const ompl::base::State *s2, 
+                           std::pair<ompl::base::State*, double> &last_valid) const;
+
+private:
+  ompl::base::MotionValidatorPtr default_validator_;
+  boost::shared_ptr<ompl_ros_interface::OmplRosStateTransformer> state_transformer_;
+};
 }
 #endif
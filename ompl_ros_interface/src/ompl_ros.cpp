@@ -42,27 +42,42 @@ namespace ompl_ros_interface
   OmplRos::OmplRos(void): node_handle_("~")
 {
   collision_models_interface_ = new planning_environment::CollisionModelsInterface("robot_description");
+  owns_collision_models_interface_ = true;
+}
+
+OmplRos::OmplRos(const ros::NodeHandle &node_handle,
+                 planning_environment::CollisionModelsInterface *cmi): node_handle_(node_handle)
+{
+  collision_models_interface_ = cmi;
+  owns_collision_models_interface_ = false;
 }
 
 /** Free the memory */
 OmplRos::~OmplRos(void)
 {
-  delete collision_models_interface_;
+  if(owns_collision_models_interface_)
+    delete collision_models_interface_;
 }
 
 void OmplRos::run(void)
+{
+  if(configure())
+    plan_path_service_ = node_handle_.advertiseService("plan_kinematic_path", &OmplRos::computePlan, this);
+}
+
+bool OmplRos::configure(void)
 {
   if(!initialize(node_handle_.getNamespace()))
-    return;
-  if (collision_models_interface_->loadedModels())
+    return false;
+  if (!collision_models_interface_->loadedModels())
   {
-    plan_path_service_ = node_handle_.advertiseService("plan_kinematic_path", &OmplRos::computePlan, this);
-    node_handle_.param<bool>("publish_diagnostics", publish_diagnostics_,false);
-    if(publish_diagnostics_)
-      diagnostic_publisher_ = node_handle_.advertise<ompl_ros_interface::OmplPlannerDiagnostics>("diagnostics", 1);
-  }
-  else
     ROS_ERROR("Collision models not loaded.");
+    return false;
+  }
+  node_handle_.param<bool>("publish_diagnostics", publish_diagnostics_,false);
+  if(publish_diagnostics_)
+    diagnostic_publisher_ = node_handle_.advertise<ompl_ros_interface::OmplPlannerDiagnostics>("diagnostics", 1);
+  return true;
 }
 
 bool OmplRos::initialize(const std::string &param_server_prefix)
@@ -171,52 +186,62 @@ bool OmplRos::initializePlanningInstance(const std::string &param_server_prefix,
     return true;
   }
 
-  if(!node_handle_.hasParam(param_server_prefix+"/"+group_name+"/planner_type"))
+  boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> new_planner = createPlanningGroup(node_handle_,
+                                                                                                param_server_prefix,
+                                                                                                group_name,
+                                                                                                planner_config_name,
+                                                                                                collision_models_interface_);
+  if(!new_planner)
+    return false;
+  planner_map_[location] = new_planner;
+  return true;
+};
+
+boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> OmplRos::createPlanningGroup(const ros::NodeHandle &node_handle,
+                                                                                        const std::string &param_server_prefix,
+                                                                                        const std::string &group_name,
+                                                                                        const std::string &planner_config_name,
+                                                                                        planning_environment::CollisionModelsInterface *cmi)
+{
+  boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> new_planner;
+  if(!node_handle.hasParam(param_server_prefix+"/"+group_name+"/planner_type"))
   {
     ROS_ERROR_STREAM("Planner type not defined for group " << group_name << " param name " << param_server_prefix+"/"+group_name+"/planner_type");
-    return false;
+    return new_planner;
   }
 
   std::string planner_type;
-  node_handle_.getParam(param_server_prefix+"/"+group_name+"/planner_type",planner_type);
+  node_handle.getParam(param_server_prefix+"/"+group_name+"/planner_type",planner_type);
   if(planner_type == "JointPlanner")
-  {
-    boost::shared_ptr<ompl_ros_interface::OmplRosJointPlanner> new_planner;
     new_planner.reset(new ompl_ros_interface::OmplRosJointPlanner());
-    if(!new_planner->initialize(ros::NodeHandle(param_server_prefix),group_name,planner_config_name,collision_models_interface_))
-    {
-      new_planner.reset();
-      ROS_ERROR("Could not configure planner for group %s with config %s",group_name.c_str(),planner_config_name.c_str());
-      return false;
-    }
-    planner_map_[location] = new_planner;
-  }
   else if(planner_type == "RPYIKTaskSpacePlanner")
-  {
-    boost::shared_ptr<ompl_ros_interface::OmplRosRPYIKTaskSpacePlanner> new_planner;
     new_planner.reset(new ompl_ros_interface::OmplRosRPYIKTaskSpacePlanner());
-    if(!new_planner->initialize(ros::NodeHandle(param_server_prefix),group_name,planner_config_name,collision_models_interface_))
-    {
-      new_planner.reset();
-      ROS_ERROR("Could not configure planner for group %s with config %s",group_name.c_str(),planner_config_name.c_str());
-      return false;
-    }
-    planner_map_[location] = new_planner;
-  }
   else
   {
     ROS_ERROR("No planner type %s available",planner_type.c_str());
     std::string cast;
-    node_handle_.getParam(param_server_prefix+"/"+group_name, cast);
+    node_handle.getParam(param_server_prefix+"/"+group_name, cast);
     ROS_ERROR_STREAM("Here " << cast);
-    return false;
+    return new_planner;
   }
 
-  return true;
+  if(!new_planner->initialize(ros::NodeHandle(param_server_prefix),group_name,planner_config_name,cmi))
+  {
+    new_planner.reset();
+    ROS_ERROR("Could not configure planner for group %s with config %s",group_name.c_str(),planner_config_name.c_str());
+  }
+  return new_planner;
 };
 
 bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request, 
                           arm_navigation_msgs::GetMotionPlan::Response &response)
+{
+  return computeValidatedPlan(request,response,NULL);
+}
+
+bool OmplRos::computeValidatedPlan(arm_navigation_msgs::GetMotionPlan::Request &request, 
+                                   arm_navigation_msgs::GetMotionPlan::Response &response,
+                                   const ompl_ros_interface::RequestValidation *validation)
 {
   std::string location;
   std::string planner_id;
@@ -235,7 +260,7 @@ bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
   {
     ROS_DEBUG("Using planner config %s",location.c_str());
   }
-  planner_map_[location]->computePlan(request,response);
+  planner_map_[location]->computePlan(request,response,validation);
   if(publish_diagnostics_)
   {
     ompl_ros_interface::OmplPlannerDiagnostics msg;
@@ -263,6 +288,11 @@ bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
       msg.trajectory_duration = response.trajectory.joint_trajectory.points.back().time_from_start.toSec()-response.trajectory.joint_trajectory.points.front().time_from_start.toSec();    
       //      msg.state_allocator_size = planner_map_[location]->planner_->getSpaceInformation()->getStateAllocator().sizeInUse();
     }
+    unsigned int plan_cache_hits, plan_cache_misses;
+    planner_map_[location]->getPlanCacheStatistics(plan_cache_hits,plan_cache_misses,msg.plan_cache_time_saved);
+    msg.plan_cache_hits = plan_cache_hits;
+    msg.plan_cache_misses = plan_cache_misses;
+    msg.plan_from_cache = planner_map_[location]->lastPlanFromCache();
     diagnostic_publisher_.publish(msg);
   }
   return true;
@@ -0,0 +1,428 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ompl_ros_interface/ompl_ros_constrained_sampling.h>
+
+#include <tf/transform_datatypes.h>
+#include <boost/math/constants/constants.hpp>
+#include <algorithm>
+
+namespace ompl_ros_interface
+{
+
+namespace
+{
+const double JACOBIAN_STEP = 1e-5;
+const double DAMPING = 1e-3;
+const double MAX_JOINT_STEP = 0.5;
+const double CONTINUITY_FACTOR = 2.0;
+
+// Solves a x = b in place for a symmetric positive definite a, stored row major
+bool solveSymmetric(std::vector<double> &a, 
+                    std::vector<double> &b)
+{
+  unsigned int n = b.size();
+  for(unsigned int i=0; i < n; i++)
+  {
+    for(unsigned int j=0; j <= i; j++)
+    {
+      double sum = a[i*n+j];
+      for(unsigned int k=0; k < j; k++)
+        sum -= a[i*n+k]*a[j*n+k];
+      if(i == j)
+      {
+        if(sum <= 0.0)
+          return false;
+        a[i*n+i] = sqrt(sum);
+      }
+      else
+        a[i*n+j] = sum/a[j*n+j];
+    }
+  }
+  for(unsigned int i=0; i < n; i++)
+  {
+    for(unsigned int k=0; k < i; k++)
+      b[i] -= a[i*n+k]*b[k];
+    b[i] /= a[i*n+i];
+  }
+  for(int i=n-1; i >= 0; i--)
+  {
+    for(unsigned int k=i+1; k < n; k++)
+      b[i] -= a[k*n+i]*b[k];
+    b[i] /= a[i*n+i];
+  }
+  return true;
+}
+}
+
+OmplRosConstraintProjector::OmplRosConstraintProjector(const ompl::base::StateSpacePtr &state_space,
+                                                       const ompl_ros_interface::OmplStateToKinematicStateMapping &mapping) :
+  state_space_(state_space),
+  mapping_(mapping),
+  joint_state_group_(NULL),
+  tolerance_fraction_(0.5),
+  max_iterations_(20),
+  active_(false)
+{
+}
+
+void OmplRosConstraintProjector::setParameters(double tolerance_fraction, 
+                                               unsigned int max_iterations)
+{
+  tolerance_fraction_ = tolerance_fraction;
+  max_iterations_ = max_iterations;
+}
+
+bool OmplRosConstraintProjector::configureOnRequest(const planning_models::KinematicState *kinematic_state,
+                                                    const std::string &physical_group_name,
+                                                    const arm_navigation_msgs::Constraints &path_constraints)
+{
+  clear();
+  boost::mutex::scoped_lock lock(lock_);
+  kinematic_state_.reset(new planning_models::KinematicState(*kinematic_state));
+  joint_state_group_ = kinematic_state_->getJointStateGroup(physical_group_name);
+  if(!joint_state_group_)
+  {
+    ROS_ERROR("Could not find group %s for constraint projection",physical_group_name.c_str());
+    return false;
+  }
+  std::vector<std::string> updated_links = joint_state_group_->getJointModelGroup()->getUpdatedLinkModelNames();
+  for(unsigned int i=0; i < path_constraints.orientation_constraints.size(); i++)
+  {
+    const arm_navigation_msgs::OrientationConstraint &oc = path_constraints.orientation_constraints[i];
+    if(std::find(updated_links.begin(),updated_links.end(),oc.link_name) == updated_links.end())
+      continue;
+    ConstraintLink constraint_link;
+    constraint_link.link_state = kinematic_state_->getLinkState(oc.link_name);
+    if(!constraint_link.link_state)
+      continue;
+    tf::Quaternion q;
+    tf::quaternionMsgToTF(oc.orientation,q);
+    constraint_link.inverse_rotation = tf::Matrix3x3(q).inverse();
+    constraint_link.header_frame = (oc.type == oc.HEADER_FRAME);
+    constraint_link.tolerance[0] = oc.absolute_roll_tolerance;
+    constraint_link.tolerance[1] = oc.absolute_pitch_tolerance;
+    constraint_link.tolerance[2] = oc.absolute_yaw_tolerance;
+    constraint_links_.push_back(constraint_link);
+  }
+  active_ = !constraint_links_.empty();
+  ROS_DEBUG("Projecting samples on %d orientation constraints",(int) constraint_links_.size());
+  return active_;
+}
+
+void OmplRosConstraintProjector::clear()
+{
+  boost::mutex::scoped_lock lock(lock_);
+  constraint_links_.clear();
+  active_ = false;
+}
+
+void OmplRosConstraintProjector::getProjectedValues(ompl::base::State *state,
+                                                    std::vector<double*> &values) const
+{
+  values.clear();
+  ompl::base::CompoundState *compound_state = state->as<ompl::base::CompoundState>();
+  bool added_real_vector = false;
+  for(unsigned int i=0; i < mapping_.mapping_type.size(); i++)
+  {
+    if(mapping_.mapping_type[i] == ompl_ros_interface::SO2)
+      values.push_back(&(compound_state->as<ompl::base::SO2StateSpace::StateType>(i)->value));
+    else if(mapping_.mapping_type[i] == ompl_ros_interface::REAL_VECTOR && !added_real_vector)
+    {
+      ompl::base::RealVectorStateSpace::StateType *real_vector_state = 
+        compound_state->as<ompl::base::RealVectorStateSpace::StateType>(mapping_.real_vector_index);
+      for(unsigned int j=0; j < mapping_.real_vector_mapping.size(); j++)
+        values.push_back(&(real_vector_state->values[j]));
+      added_real_vector = true;
+    }
+  }
+}
+
+bool OmplRosConstraintProjector::computeError(const ompl::base::State *state,
+                                              std::vector<double> &error) const
+{
+  if(!omplStateToKinematicStateGroup(state,mapping_,joint_state_group_))
+    return false;
+  joint_state_group_->updateKinematicLinks();
+  error.resize(3*constraint_links_.size());
+  for(unsigned int i=0; i < constraint_links_.size(); i++)
+  {
+    const tf::Matrix3x3 &link_rotation = constraint_links_[i].link_state->getGlobalLinkTransform().getBasis();
+    tf::Matrix3x3 result;
+    if(constraint_links_[i].header_frame)
+      result = link_rotation * constraint_links_[i].inverse_rotation;
+    else
+      result = constraint_links_[i].inverse_rotation * link_rotation;
+    tfScalar yaw, pitch, roll;
+    result.getRPY(roll, pitch, yaw);
+    error[3*i] = roll;
+    error[3*i+1] = pitch;
+    error[3*i+2] = yaw;
+  }
+  return true;
+}
+
+bool OmplRosConstraintProjector::computeResidual(const std::vector<double> &error,
+                                                 std::vector<double> &residual) const
+{
+  bool violated = false;
+  residual.resize(error.size());
+  for(unsigned int i=0; i < error.size(); i++)
+  {
+    double tolerance = constraint_links_[i/3].tolerance[i%3];
+    residual[i] = 0.0;
+    // Tolerances this large do not constrain the axis
+    if(tolerance >= boost::math::constants::pi<double>())
+      continue;
+    double band = tolerance_fraction_*tolerance;
+    if(error[i] > band)
+      residual[i] = error[i] - band;
+    else if(error[i] < -band)
+      residual[i] = error[i] + band;
+    if(residual[i] != 0.0)
+      violated = true;
+  }
+  return violated;
+}
+
+bool OmplRosConstraintProjector::project(ompl::base::State *state) const
+{
+  boost::mutex::scoped_lock lock(lock_);
+  if(!active_)
+    return true;
+
+  std::vector<double*> values;
+  getProjectedValues(state,values);
+  unsigned int num_values = values.size();
+  if(num_values == 0)
+    return false;
+
+  std::vector<double> error, residual, perturbed_error;
+  std::vector<double> jacobian;
+  for(unsigned int iteration = 0; ; iteration++)
+  {
+    if(!computeError(state,error))
+      return false;
+    if(!computeResidual(error,residual))
+      return true;
+    if(iteration >= max_iterations_)
+      break;
+
+    unsigned int num_rows = error.size();
+    jacobian.resize(num_rows*num_values);
+    for(unsigned int j=0; j < num_values; j++)
+    {
+      double value = *values[j];
+      *values[j] = value + JACOBIAN_STEP;
+      bool computed = computeError(state,perturbed_error);
+      *values[j] = value;
+      if(!computed)
+        return false;
+      for(unsigned int i=0; i < num_rows; i++)
+        jacobian[i*num_values+j] = angles::normalize_angle(perturbed_error[i]-error[i])/JACOBIAN_STEP;
+    }
+
+    // Damped least squares step: dq = -J^T (J J^T + damping I)^-1 r
+    std::vector<double> jjt(num_rows*num_rows,0.0);
+    for(unsigned int i=0; i < num_rows; i++)
+    {
+      for(unsigned int k=0; k < num_rows; k++)
+        for(unsigned int j=0; j < num_values; j++)
+          jjt[i*num_rows+k] += jacobian[i*num_values+j]*jacobian[k*num_values+j];
+      jjt[i*num_rows+i] += DAMPING;
+    }
+    if(!solveSymmetric(jjt,residual))
+      return false;
+
+    std::vector<double> step(num_values,0.0);
+    double max_step = 0.0;
+    for(unsigned int j=0; j < num_values; j++)
+    {
+      for(unsigned int i=0; i < num_rows; i++)
+        step[j] -= jacobian[i*num_values+j]*residual[i];
+      max_step = std::max(max_step,fabs(step[j]));
+    }
+    double scale = max_step > MAX_JOINT_STEP ? MAX_JOINT_STEP/max_step : 1.0;
+    for(unsigned int j=0; j < num_values; j++)
+      *values[j] += scale*step[j];
+    state_space_->enforceBounds(state);
+  }
+
+  // Out of iterations; accept the state if it is within the actual tolerances
+  for(unsigned int i=0; i < error.size(); i++)
+    if(fabs(error[i]) >= constraint_links_[i/3].tolerance[i%3])
+      return false;
+  return true;
+}
+
+OmplRosConstrainedStateSampler::OmplRosConstrainedStateSampler(const ompl::base::StateSpace *state_space,
+                                                               const OmplRosConstraintProjectorPtr &projector,
+                                                               unsigned int max_attempts) :
+  ompl::base::StateSampler(state_space),
+  default_sampler_(state_space->allocDefaultStateSampler()),
+  projector_(projector),
+  max_attempts_(max_attempts)
+{
+}
+
+void OmplRosConstrainedStateSampler::sampleUniform(ompl::base::State *state)
+{
+  for(unsigned int i=0; i < max_attempts_; i++)
+  {
+    default_sampler_->sampleUniform(state);
+    if(projector_->project(state))
+      return;
+  }
+}
+
+void OmplRosConstrainedStateSampler::sampleUniformNear(ompl::base::State *state, 
+                                                       const ompl::base::State *near, 
+                                                       const double distance)
+{
+  for(unsigned int i=0; i < max_attempts_; i++)
+  {
+    default_sampler_->sampleUniformNear(state,near,distance);
+    if(projector_->project(state))
+      return;
+  }
+}
+
+void OmplRosConstrainedStateSampler::sampleGaussian(ompl::base::State *state, 
+                                                    const ompl::base::State *mean, 
+                                                    const double std_dev)
+{
+  for(unsigned int i=0; i < max_attempts_; i++)
+  {
+    default_sampler_->sampleGaussian(state,mean,std_dev);
+    if(projector_->project(state))
+      return;
+  }
+}
+
+OmplRosConstrainedMotionValidator::OmplRosConstrainedMotionValidator(ompl::base::SpaceInformation *si,
+                                                                     const OmplRosConstraintProjectorPtr &projector) :
+  ompl::base::MotionValidator(si),
+  default_validator_(new ompl::base::DiscreteMotionValidator(si)),
+  projector_(projector)
+{
+}
+
+bool OmplRosConstrainedMotionValidator::checkMotion(const ompl::base::State *s1, 
+                                                    const ompl::base::State *s2) const
+{
+  return computeMotion(s1,s2,NULL,NULL);
+}
+
+bool OmplRosConstrainedMotionValidator::checkMotion(const ompl::base::State *s1, 
+                                                    const ompl::base::State *s2, 
+                                                    std::pair<ompl::base::State*, double> &last_valid) const
+{
+  return computeMotion(s1,s2,NULL,&last_valid);
+}
+
+bool OmplRosConstrainedMotionValidator::computeMotion(const ompl::base::State *s1, 
+                                                      const ompl::base::State *s2,
+                                                      std::vector<ompl::base::State*> *states,
+                                                      std::pair<ompl::base::State*, double> *last_valid) const
+{
+  if(!projector_->isActive() && !states)
+  {
+    if(last_valid)
+      return default_validator_->checkMotion(s1,s2,*last_valid);
+    return default_validator_->checkMotion(s1,s2);
+  }
+
+  unsigned int nd = si_->getStateSpace()->validSegmentCount(s1,s2);
+  double max_distance = CONTINUITY_FACTOR*si_->distance(s1,s2)/(double) nd;
+
+  ompl::base::State *previous = si_->cloneState(s1);
+  ompl::base::State *test = si_->allocState();
+  bool result = true;
+  unsigned int j = 1;
+  for(; j < nd; j++)
+  {
+    si_->getStateSpace()->interpolate(s1,s2,(double) j/(double) nd,test);
+    if(!projector_->project(test) || 
+       si_->distance(previous,test) > max_distance ||
+       !si_->isValid(test))
+    {
+      result = false;
+      break;
+    }
+    if(states)
+      states->push_back(si_->cloneState(test));
+    si_->copyState(previous,test);
+  }
+  if(result)
+    result = si_->isValid(s2) && si_->distance(previous,s2) <= max_distance;
+
+  if(!result && last_valid)
+  {
+    if(last_valid->first)
+      si_->copyState(last_valid->first,previous);
+    last_valid->second = (double) (j-1)/(double) nd;
+  }
+  si_->freeState(test);
+  si_->freeState(previous);
+  return result;
+}
+
+bool OmplRosConstrainedMotionValidator::interpolateSolutionPath(ompl::geometric::PathGeometric &path) const
+{
+  std::vector<ompl::base::State*> &path_states = path.getStates();
+  if(path_states.size() < 2)
+    return true;
+  std::vector<ompl::base::State*> states;
+  std::vector<ompl::base::State*> interpolated_states;
+  for(unsigned int i=0; i < path_states.size()-1; i++)
+  {
+    states.push_back(path_states[i]);
+    interpolated_states.clear();
+    if(!computeMotion(path_states[i],path_states[i+1],&interpolated_states,NULL))
+    {
+      for(unsigned int j=0; j < interpolated_states.size(); j++)
+        si_->freeState(interpolated_states[j]);
+      for(unsigned int j=0; j < states.size(); j++)
+        if(std::find(path_states.begin(),path_states.end(),states[j]) == path_states.end())
+          si_->freeState(states[j]);
+      return false;
+    }
+    states.insert(states.end(),interpolated_states.begin(),interpolated_states.end());
+  }
+  states.push_back(path_states.back());
+  path_states.swap(states);
+  return true;
+}
+
+}
@@ -0,0 +1,166 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ompl_ros_interface/ompl_ros_plan_cache.h>
+#include <ros/serialization.h>
+#include <sstream>
+#include <cmath>
+
+namespace ompl_ros_interface
+{
+
+OmplRosPlanCache::OmplRosPlanCache(unsigned int max_size, 
+                                   double resolution) : max_size_(max_size), resolution_(resolution)
+{
+}
+
+double OmplRosPlanCache::quantize(double value) const
+{
+  return floor(value/resolution_ + 0.5)*resolution_;
+}
+
+void OmplRosPlanCache::quantizeConstraints(arm_navigation_msgs::Constraints &constraints) const
+{
+  for(unsigned int i=0; i < constraints.joint_constraints.size(); i++)
+    constraints.joint_constraints[i].position = quantize(constraints.joint_constraints[i].position);
+  for(unsigned int i=0; i < constraints.position_constraints.size(); i++)
+  {
+    arm_navigation_msgs::PositionConstraint &pc = constraints.position_constraints[i];
+    pc.header.stamp = ros::Time();
+    pc.header.seq = 0;
+    pc.position.x = quantize(pc.position.x);
+    pc.position.y = quantize(pc.position.y);
+    pc.position.z = quantize(pc.position.z);
+    pc.constraint_region_orientation.x = quantize(pc.constraint_region_orientation.x);
+    pc.constraint_region_orientation.y = quantize(pc.constraint_region_orientation.y);
+    pc.constraint_region_orientation.z = quantize(pc.constraint_region_orientation.z);
+    pc.constraint_region_orientation.w = quantize(pc.constraint_region_orientation.w);
+  }
+  for(unsigned int i=0; i < constraints.orientation_constraints.size(); i++)
+  {
+    arm_navigation_msgs::OrientationConstraint &oc = constraints.orientation_constraints[i];
+    oc.header.stamp = ros::Time();
+    oc.header.seq = 0;
+    oc.orientation.x = quantize(oc.orientation.x);
+    oc.orientation.y = quantize(oc.orientation.y);
+    oc.orientation.z = quantize(oc.orientation.z);
+    oc.orientation.w = quantize(oc.orientation.w);
+  }
+  for(unsigned int i=0; i < constraints.visibility_constraints.size(); i++)
+  {
+    arm_navigation_msgs::VisibilityConstraint &vc = constraints.visibility_constraints[i];
+    vc.header.stamp = ros::Time();
+    vc.header.seq = 0;
+    vc.target.header.stamp = ros::Time();
+    vc.target.header.seq = 0;
+    vc.sensor_pose.header.stamp = ros::Time();
+    vc.sensor_pose.header.seq = 0;
+  }
+}
+
+std::string OmplRosPlanCache::computeKey(const std::vector<double> &start_values,
+                                         const arm_navigation_msgs::MotionPlanRequest &request) const
+{
+  std::stringstream key;
+  key << request.group_name;
+  for(unsigned int i=0; i < start_values.size(); i++)
+    key << " " << (long) floor(start_values[i]/resolution_ + 0.5);
+  key << "|";
+
+  arm_navigation_msgs::Constraints constraints[2];
+  constraints[0] = request.goal_constraints;
+  constraints[1] = request.path_constraints;
+  for(unsigned int i=0; i < 2; i++)
+  {
+    quantizeConstraints(constraints[i]);
+    uint32_t length = ros::serialization::serializationLength(constraints[i]);
+    std::vector<uint8_t> buffer(length);
+    if(length > 0)
+    {
+      ros::serialization::OStream stream(&buffer[0],length);
+      ros::serialization::serialize(stream,constraints[i]);
+      key.write(reinterpret_cast<const char*>(&buffer[0]),length);
+    }
+  }
+  return key.str();
+}
+
+bool OmplRosPlanCache::lookup(const std::string &key,
+                              arm_navigation_msgs::RobotTrajectory &trajectory,
+                              double &planning_time)
+{
+  std::map<std::string, Entry>::iterator it = entries_.find(key);
+  if(it == entries_.end())
+    return false;
+  order_.splice(order_.end(),order_,it->second.order);
+  trajectory = it->second.trajectory;
+  planning_time = it->second.planning_time;
+  return true;
+}
+
+void OmplRosPlanCache::store(const std::string &key,
+                             const arm_navigation_msgs::RobotTrajectory &trajectory,
+                             double planning_time)
+{
+  if(max_size_ == 0)
+    return;
+  remove(key);
+  while(entries_.size() >= max_size_)
+  {
+    entries_.erase(order_.front());
+    order_.pop_front();
+  }
+  order_.push_back(key);
+  Entry &entry = entries_[key];
+  entry.trajectory = trajectory;
+  entry.planning_time = planning_time;
+  entry.order = --order_.end();
+}
+
+void OmplRosPlanCache::remove(const std::string &key)
+{
+  std::map<std::string, Entry>::iterator it = entries_.find(key);
+  if(it == entries_.end())
+    return;
+  order_.erase(it->second.order);
+  entries_.erase(it);
+}
+
+void OmplRosPlanCache::clear()
+{
+  entries_.clear();
+  order_.clear();
+}
+
+}
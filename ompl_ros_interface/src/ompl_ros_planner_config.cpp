@@ -43,15 +43,26 @@ const std::string& ompl_ros_interface::PlannerConfig::getName(void)
     return config_;
 }
 
+std::string ompl_ros_interface::PlannerConfig::getParamName(const std::string &param)
+{
+    if(!group_.empty())
+    {
+      std::string override_name = description_ + "/" + group_ + "/planner_config_overrides/" + config_ + "/" + param;
+      if(nh_.hasParam(override_name))
+        return override_name;
+    }
+    return description_ + "/planner_configs/" + config_ + "/" + param;
+}
+
 bool ompl_ros_interface::PlannerConfig::hasParam(const std::string &param)
 {
-    return nh_.hasParam(description_ + "/planner_configs/" + config_ + "/" + param);
+    return nh_.hasParam(getParamName(param));
 }
 
 std::string ompl_ros_interface::PlannerConfig::getParamString(const std::string &param, const std::string& def)
 {
     std::string value;
-    nh_.param(description_ + "/planner_configs/" + config_ + "/" + param, value, def);
+    nh_.param(getParamName(param), value, def);
     boost::trim(value);
     return value;
 }
@@ -59,14 +70,14 @@ std::string ompl_ros_interface::PlannerConfig::getParamString(const std::string
 double ompl_ros_interface::PlannerConfig::getParamDouble(const std::string &param, double def)
 {
     double value;
-    nh_.param(description_ + "/planner_configs/" + config_ + "/" + param, value, def);
+    nh_.param(getParamName(param), value, def);
     return value;
 }
 
 int ompl_ros_interface::PlannerConfig::getParamInt(const std::string &param, int def)
 {
     int value;
-    nh_.param(description_ + "/planner_configs/" + config_ + "/" + param, value, def);
+    nh_.param(getParamName(param), value, def);
     return value;
 }
 
@@ -135,7 +146,7 @@ std::vector< boost::shared_ptr<ompl_ros_interface::PlannerConfig> > ompl_ros_int
     for(std::vector<std::string>::const_iterator it = group_to_planner_string_config_map_.find(group)->second.begin();
         it != group_to_planner_string_config_map_.find(group)->second.end();
         it++) {
-      ret.push_back(boost::shared_ptr<PlannerConfig>(new ompl_ros_interface::PlannerConfig(description_, (*it))));
+      ret.push_back(boost::shared_ptr<PlannerConfig>(new ompl_ros_interface::PlannerConfig(description_, (*it), group)));
     }
   }
   return ret;
@@ -36,6 +36,7 @@
 
 #include <ompl_ros_interface/ompl_ros_planning_group.h>
 #include <planning_environment/models/model_utils.h>
+#include <boost/bind.hpp>
 
 namespace ompl_ros_interface
 {
@@ -59,6 +60,15 @@ bool OmplRosPlanningGroup::initialize(const ros::NodeHandle &node_handle,
   node_handle_.param(group_name_+"/longest_valid_segment_fraction",longest_valid_segment_fraction,0.005);
   state_space_->setLongestValidSegmentFraction(longest_valid_segment_fraction);
 
+  int plan_cache_size;
+  node_handle_.param(group_name_+"/plan_cache_size",plan_cache_size,0);
+  if(plan_cache_size > 0)
+  {
+    double plan_cache_resolution;
+    node_handle_.param(group_name_+"/plan_cache_resolution",plan_cache_resolution,0.001);
+    plan_cache_.reset(new ompl_ros_interface::OmplRosPlanCache(plan_cache_size,plan_cache_resolution));
+  }
+
   //Setup the projection evaluator for this group
   if(!initializeProjectionEvaluator())
   {
@@ -77,9 +87,43 @@ bool OmplRosPlanningGroup::initialize(const ros::NodeHandle &node_handle,
   planner_->setStateValidityChecker(static_cast<ompl::base::StateValidityCheckerPtr> (state_validity_checker_));
   planner_->setPlanner(ompl_planner_);
 
+  if(!initializeConstrainedSampling())
+    return false;
+
   return true;
 };
 
+bool OmplRosPlanningGroup::initializeConstrainedSampling()
+{
+  if(!planner_config_->getParamInt("constrained_sampling",0))
+    return true;
+
+  if(!initializeConstraintProjector(constraint_projector_) || !constraint_projector_)
+  {
+    ROS_WARN("Constrained sampling is not supported for group %s, using the default sampler",group_name_.c_str());
+    constraint_projector_.reset();
+    return true;
+  }
+  constraint_projector_->setParameters(planner_config_->getParamDouble("constrained_sampling_tolerance_fraction",0.5),
+                                       planner_config_->getParamInt("constrained_sampling_max_iterations",20));
+  unsigned int max_attempts = planner_config_->getParamInt("constrained_sampling_attempts",10);
+
+  state_space_->setStateSamplerAllocator(boost::bind(&OmplRosPlanningGroup::allocConstrainedStateSampler,
+                                                     constraint_projector_,max_attempts,_1));
+  constrained_motion_validator_.reset(new ompl_ros_interface::OmplRosConstrainedMotionValidator(planner_->getSpaceInformation().get(),
+                                                                                               constraint_projector_));
+  planner_->getSpaceInformation()->setMotionValidator(constrained_motion_validator_);
+  ROS_DEBUG("Using constrained sampling for group %s",group_name_.c_str());
+  return true;
+}
+
+ompl::base::StateSamplerPtr OmplRosPlanningGroup::allocConstrainedStateSampler(const ompl_ros_interface::OmplRosConstraintProjectorPtr &projector,
+                                                                               unsigned int max_attempts,
+                                                                               const ompl::base::StateSpace *state_space)
+{
+  return ompl::base::StateSamplerPtr(new ompl_ros_interface::OmplRosConstrainedStateSampler(state_space,projector,max_attempts));
+}
+
 bool OmplRosPlanningGroup::initializePhysicalGroup()
 {
   std::string physical_group_name;
@@ -127,7 +171,7 @@ bool OmplRosPlanningGroup::initializeProjectionEvaluator()
 
 bool OmplRosPlanningGroup::initializePlanner()
 {
-  planner_config_.reset(new ompl_ros_interface::PlannerConfig(node_handle_.getNamespace(),planner_config_name_));
+  planner_config_.reset(new ompl_ros_interface::PlannerConfig(node_handle_.getNamespace(),planner_config_name_,group_name_));
   std::string planner_type = planner_config_->getParamString("type");
   if(planner_type == "kinematic::RRT")
     return initializeRRTPlanner();
@@ -397,9 +441,12 @@ bool OmplRosPlanningGroup::omplPathGeometricToRobotTrajectory(const ompl::geomet
 }
 
 bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request, 
-                                       arm_navigation_msgs::GetMotionPlan::Response &response)
+                                       arm_navigation_msgs::GetMotionPlan::Response &response,
+                                       const ompl_ros_interface::RequestValidation *validation)
 {
   planner_->clear();
+  request_validation_ = validation;
+  last_plan_from_cache_ = false;
   planning_models::KinematicState* kinematic_state = collision_models_interface_->getPlanningSceneState();
   if(kinematic_state == NULL) {
     ROS_ERROR_STREAM("Planning scene hasn't been set");
@@ -429,6 +476,21 @@ bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Reque
   
   if(!transformConstraints(request,response))
     return finish(false);
+
+  std::string plan_cache_key;
+  if(plan_cache_)
+  {
+    std::vector<double> start_values;
+    physical_joint_state_group_->getKinematicStateValues(start_values);
+    plan_cache_key = plan_cache_->computeKey(start_values,request.motion_plan_request);
+    if(getCachedPlan(plan_cache_key,request,response))
+      return finish(true);
+  }
+
+  if(constraint_projector_)
+    constraint_projector_->configureOnRequest(kinematic_state,
+                                              physical_joint_group_->getName(),
+                                              request.motion_plan_request.path_constraints);
   
   if(!setStartAndGoalStates(request,response))
     return finish(false);
@@ -446,6 +508,8 @@ bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Reque
     {
       response.trajectory = getSolutionPath();
       response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::SUCCESS;
+      if(plan_cache_ && response.trajectory.multi_dof_joint_trajectory.points.empty())
+        plan_cache_->store(plan_cache_key,response.trajectory,response.planning_time.toSec());
       return finish(true);
     }
     catch(...)
@@ -463,9 +527,64 @@ bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Reque
   }  
 }
 
+bool OmplRosPlanningGroup::getCachedPlan(const std::string &key,
+                                         arm_navigation_msgs::GetMotionPlan::Request &request, 
+                                         arm_navigation_msgs::GetMotionPlan::Response &response)
+{
+  arm_navigation_msgs::RobotTrajectory trajectory;
+  double planning_time;
+  if(!plan_cache_->lookup(key,trajectory,planning_time) || trajectory.joint_trajectory.points.empty())
+  {
+    plan_cache_misses_++;
+    return false;
+  }
+  ros::WallTime start_time = ros::WallTime::now();
+
+  // The cached trajectory starts at the quantized start, move it to the actual start
+  trajectory_msgs::JointTrajectory &joint_trajectory = trajectory.joint_trajectory;
+  for(unsigned int i=0; i < joint_trajectory.joint_names.size(); i++)
+  {
+    planning_models::KinematicState::JointState* joint_state = physical_joint_state_group_->getJointState(joint_trajectory.joint_names[i]);
+    if(joint_state && joint_state->getJointStateValues().size() == 1)
+      joint_trajectory.points.front().positions[i] = joint_state->getJointStateValues()[0];
+  }
+
+  std::vector<double> start_values;
+  physical_joint_state_group_->getKinematicStateValues(start_values);
+  arm_navigation_msgs::ArmNavigationErrorCodes error_code;
+  std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
+  bool valid = collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
+                                                                   joint_trajectory,
+                                                                   request.motion_plan_request.goal_constraints,
+                                                                   request.motion_plan_request.path_constraints,
+                                                                   error_code,
+                                                                   trajectory_error_codes,
+                                                                   false);
+  physical_joint_state_group_->setKinematicState(start_values);
+  if(!valid)
+  {
+    ROS_DEBUG("Cached plan is invalid in the current scene. Reason: %s",arm_navigation_msgs::armNavigationErrorCodeToString(error_code).c_str());
+    plan_cache_->remove(key);
+    plan_cache_misses_++;
+    return false;
+  }
+
+  double validation_time = (ros::WallTime::now()-start_time).toSec();
+  plan_cache_hits_++;
+  plan_cache_time_saved_ += std::max(0.0,planning_time-validation_time);
+  last_plan_from_cache_ = true;
+  ROS_DEBUG("Returning cached plan, validated in %f seconds",validation_time);
+  response.trajectory = trajectory;
+  response.planning_time = ros::Duration(validation_time);
+  response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::SUCCESS;
+  return true;
+}
 
 bool OmplRosPlanningGroup::finish(const bool &result)
 {
+  request_validation_ = NULL;
+  if(constraint_projector_)
+    constraint_projector_->clear();
   if(collision_models_interface_->getPlanningSceneState() != NULL) {
     collision_models_interface_->resetToStartState(*collision_models_interface_->getPlanningSceneState());
   }
@@ -72,6 +72,13 @@ bool OmplRosJointPlanner::initializePlanningStateSpace(ompl::base::StateSpacePtr
   return true;
 }
 
+bool OmplRosJointPlanner::initializeConstraintProjector(ompl_ros_interface::OmplRosConstraintProjectorPtr &constraint_projector)
+{
+  constraint_projector.reset(new ompl_ros_interface::OmplRosConstraintProjector(state_space_,
+                                                                                ompl_state_to_kinematic_state_mapping_));
+  return true;
+}
+
 bool OmplRosJointPlanner::isRequestValid(arm_navigation_msgs::GetMotionPlan::Request &request,
                                          arm_navigation_msgs::GetMotionPlan::Response &response)
 {
@@ -156,7 +163,21 @@ bool OmplRosJointPlanner::setStart(arm_navigation_msgs::GetMotionPlan::Request &
   }
 
   ompl_ros_interface::OmplRosJointStateValidityChecker *my_checker = dynamic_cast<ompl_ros_interface::OmplRosJointStateValidityChecker*>(state_validity_checker_.get());  
-  if(!my_checker->isStateValid(start.get()))
+  if(request_validation_ && request_validation_->start_checked)
+  {
+    // already checked by the caller in this scene
+    if(!request_validation_->start_valid)
+    {
+      response.error_code = request_validation_->start_error_code;
+      if(response.error_code.val == response.error_code.PATH_CONSTRAINTS_VIOLATED)
+        response.error_code.val = response.error_code.START_STATE_VIOLATES_PATH_CONSTRAINTS;
+      else if(response.error_code.val == response.error_code.COLLISION_CONSTRAINTS_VIOLATED)
+        response.error_code.val = response.error_code.START_STATE_IN_COLLISION;
+      ROS_ERROR("Start state is invalid. Reason: %s",arm_navigation_msgs::armNavigationErrorCodeToString(response.error_code).c_str());
+      return false;
+    }
+  }
+  else if(!my_checker->isStateValid(start.get()))
   {
     response.error_code = my_checker->getLastErrorCode();
     if(response.error_code.val == response.error_code.PATH_CONSTRAINTS_VIOLATED)
@@ -203,7 +224,21 @@ bool OmplRosJointPlanner::setJointGoal(arm_navigation_msgs::GetMotionPlan::Reque
     goal_states->as<ompl::base::GoalStates>()->addState(goal.get());
   }
   ompl_ros_interface::OmplRosJointStateValidityChecker *my_checker = dynamic_cast<ompl_ros_interface::OmplRosJointStateValidityChecker*>(state_validity_checker_.get());  
-  if(num_goals == 1 && !my_checker->isStateValid(goal.get()))
+  if(num_goals == 1 && request_validation_ && request_validation_->goal_checked)
+  {
+    // already checked by the caller in this scene
+    if(!request_validation_->goal_valid)
+    {
+      response.error_code = request_validation_->goal_error_code;
+      if(response.error_code.val == response.error_code.PATH_CONSTRAINTS_VIOLATED)
+        response.error_code.val = response.error_code.GOAL_VIOLATES_PATH_CONSTRAINTS;
+      else if(response.error_code.val == response.error_code.COLLISION_CONSTRAINTS_VIOLATED)
+        response.error_code.val = response.error_code.GOAL_IN_COLLISION;
+      ROS_ERROR("Joint space goal is invalid. Reason: %s",arm_navigation_msgs::armNavigationErrorCodeToString(response.error_code).c_str());
+      return false;
+    }
+  }
+  else if(num_goals == 1 && !my_checker->isStateValid(goal.get()))
   {
     response.error_code = my_checker->getLastErrorCode();
     if(response.error_code.val == response.error_code.PATH_CONSTRAINTS_VIOLATED)
@@ -246,7 +281,16 @@ arm_navigation_msgs::RobotTrajectory OmplRosJointPlanner::getSolutionPath()
 {
   arm_navigation_msgs::RobotTrajectory robot_trajectory;
   ompl::geometric::PathGeometric solution = planner_->getSolutionPath();
-  solution.interpolate();
+  if(isConstrainedSamplingActive())
+  {
+    if(!constrained_motion_validator_->interpolateSolutionPath(solution))
+    {
+      ROS_ERROR("Could not interpolate solution path on path constraints");
+      throw new OMPLROSException();
+    }
+  }
+  else
+    solution.interpolate();
   omplPathGeometricToRobotTrajectory(solution,robot_trajectory);
   return robot_trajectory;
 }
@@ -51,6 +51,8 @@ bool OmplRosRPYIKTaskSpacePlanner::initializeStateValidityChecker(ompl_ros_inter
   if(!(dynamic_cast<ompl_ros_interface::OmplRosTaskSpaceValidityChecker*>(state_validity_checker.get()))->setStateTransformer(state_transformer))
     return false;
   state_transformer_ = state_transformer;
+  planner_->getSpaceInformation()->setMotionValidator(ompl::base::MotionValidatorPtr(new ompl_ros_interface::OmplRosTaskSpaceMotionValidator(planner_->getSpaceInformation().get(),
+                                                                                                                                           state_transformer)));
   if(!node_handle_.hasParam(state_space_->getName()+"/tip_name"))
   {
     ROS_ERROR("Could not find tip name for state_space %s",state_space_->getName().c_str());
@@ -75,6 +77,8 @@ arm_navigation_msgs::RobotTrajectory OmplRosRPYIKTaskSpacePlanner::getSolutionPa
     trajectory_msgs::JointTrajectoryPoint joint_trajectory_point;
     arm_navigation_msgs::MultiDOFJointTrajectoryPoint multi_dof_joint_trajectory_point;
 
+    //seed each waypoint from the one before it so that consecutive waypoints stay on the same IK branch
+    state_transformer_->setParentState(i > 0 ? path.getState(i-1) : NULL);
     if(!state_transformer_->inverseTransform(*(path.getState(i)),
                                              robot_state))
     {
@@ -104,12 +108,20 @@ arm_navigation_msgs::RobotTrajectory OmplRosRPYIKTaskSpacePlanner::getSolutionPa
     if(!robot_state.multi_dof_joint_state.joint_names.empty())
       robot_trajectory.multi_dof_joint_trajectory.points.push_back(multi_dof_joint_trajectory_point);
   }
+  state_transformer_->setParentState(NULL);
   return robot_trajectory;
 }
 
 bool OmplRosRPYIKTaskSpacePlanner::setStart(arm_navigation_msgs::GetMotionPlan::Request &request,
                                             arm_navigation_msgs::GetMotionPlan::Response &response)
 {
+  //resets the IK solutions cached by the transformer for the previous request
+  if(!state_transformer_->configureOnRequest(request,response))
+  {
+    ROS_ERROR("Could not configure state transformer for request");
+    return false;
+  }
+
   //Use the path constraints to set component bounds first
   arm_navigation_msgs::ArmNavigationErrorCodes error_code;
   state_space_->as<ompl::base::CompoundStateSpace>()->getSubspace("real_vector")->as<ompl::base::RealVectorStateSpace>()->setBounds(*original_real_vector_bounds_);
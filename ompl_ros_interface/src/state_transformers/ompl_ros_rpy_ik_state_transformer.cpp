@@ -38,6 +38,8 @@
 
 namespace ompl_ros_interface
 {
+//bounds the memory used by the IK cache for very long planning requests
+static const unsigned int MAX_IK_CACHE_SIZE = 100000;
 
 bool OmplRosRPYIKStateTransformer::initialize()
 {
@@ -80,21 +82,65 @@ bool OmplRosRPYIKStateTransformer::initialize()
 bool OmplRosRPYIKStateTransformer::configureOnRequest(const arm_navigation_msgs::GetMotionPlan::Request &request,
                                                       arm_navigation_msgs::GetMotionPlan::Response &response)
 {  
-
+  ik_cache_.clear();
+  parent_key_.clear();
   return true;
 }
 
+void OmplRosRPYIKStateTransformer::setParentState(const ompl::base::State *parent_state)
+{
+  if(parent_state)
+    omplStateToCacheKey(*parent_state,parent_key_);
+  else
+    parent_key_.clear();
+}
+
 bool OmplRosRPYIKStateTransformer::inverseTransform(const ompl::base::State &ompl_state,
                                                     arm_navigation_msgs::RobotState &robot_state)
+{
+  std::vector<double> key;
+  omplStateToCacheKey(ompl_state,key);
+  std::map<std::vector<double>, std::vector<double> >::iterator it = ik_cache_.find(key);
+  if(it == ik_cache_.end())
+  {
+    std::vector<double> solution;
+    if(!computeIK(ompl_state,solution))
+      return false;
+    if(ik_cache_.size() >= MAX_IK_CACHE_SIZE)
+      ik_cache_.clear();
+    it = ik_cache_.insert(std::make_pair(key,solution)).first;
+  }
+  solution_state_.joint_state.position = it->second;
+  robot_state.joint_state = solution_state_.joint_state;
+  return true;
+}
+
+bool OmplRosRPYIKStateTransformer::computeIK(const ompl::base::State &ompl_state,
+                                             std::vector<double> &solution)
 {
   geometry_msgs::Pose pose;
   omplStateToPose(ompl_state,pose);
-  generateRandomState(seed_state_);
-
   (*scoped_state_) = ompl_state;
-  ompl_ros_interface::omplStateToRobotState(*scoped_state_,ompl_state_to_robot_state_mapping_,seed_state_);
   int error_code;
 
+  //try a quick solve seeded from the solution for the parent state first
+  std::map<std::vector<double>, std::vector<double> >::const_iterator parent = ik_cache_.end();
+  if(!parent_key_.empty())
+    parent = ik_cache_.find(parent_key_);
+  if(parent != ik_cache_.end())
+  {
+    seed_state_.joint_state.position = parent->second;
+    ompl_ros_interface::omplStateToRobotState(*scoped_state_,ompl_state_to_robot_state_mapping_,seed_state_);
+    if(kinematics_solver_->getPositionIK(pose,
+                                         seed_state_.joint_state.position,
+                                         solution,
+                                         error_code))
+      return true;
+  }
+
+  generateRandomState(seed_state_);
+  ompl_ros_interface::omplStateToRobotState(*scoped_state_,ompl_state_to_robot_state_mapping_,seed_state_);
+
   ROS_DEBUG_STREAM("Inner pose is " <<
                    pose.position.x << " " <<
                    pose.position.y << " " <<
@@ -104,16 +150,11 @@ bool OmplRosRPYIKStateTransformer::inverseTransform(const ompl::base::State &omp
                    pose.orientation.z << " " << 
                    pose.orientation.w);
 
-  if(kinematics_solver_->searchPositionIK(pose,
-                                          seed_state_.joint_state.position,
-                                          1.0,
-                                          solution_state_.joint_state.position,
-                                          error_code))
-  {
-    robot_state.joint_state = solution_state_.joint_state;
-    return true;
-  }
-  return false;
+  return kinematics_solver_->searchPositionIK(pose,
+                                              seed_state_.joint_state.position,
+                                              1.0,
+                                              solution,
+                                              error_code);
 }
 
 bool OmplRosRPYIKStateTransformer::forwardTransform(const arm_navigation_msgs::RobotState &joint_state,
@@ -138,6 +179,25 @@ void OmplRosRPYIKStateTransformer::omplStateToPose(const ompl::base::State &ompl
 }
 
 
+void OmplRosRPYIKStateTransformer::omplStateToCacheKey(const ompl::base::State &ompl_state,
+                                                       std::vector<double> &key)
+{
+  const ompl::base::CompoundStateSpace *compound_space = state_space_->as<ompl::base::CompoundStateSpace>();
+  const ompl::base::CompoundState *compound_state = ompl_state.as<ompl::base::CompoundState>();
+  key.clear();
+  for(unsigned int i=0; i < compound_space->getSubspaceCount(); i++)
+  {
+    if(ompl_state_to_robot_state_mapping_.mapping_type[i] == ompl_ros_interface::SO2)
+      key.push_back(compound_state->as<ompl::base::SO2StateSpace::StateType>(i)->value);
+    else if(ompl_state_to_robot_state_mapping_.mapping_type[i] == ompl_ros_interface::REAL_VECTOR)
+    {
+      const ompl::base::RealVectorStateSpace::StateType *real_vector_state = compound_state->as<ompl::base::RealVectorStateSpace::StateType>(i);
+      for(unsigned int j=0; j < compound_space->getSubspace(i)->getDimension(); j++)
+        key.push_back(real_vector_state->values[j]);
+    }
+  }
+}
+
 arm_navigation_msgs::RobotState OmplRosRPYIKStateTransformer::getDefaultState()
 {
   arm_navigation_msgs::RobotState robot_state;
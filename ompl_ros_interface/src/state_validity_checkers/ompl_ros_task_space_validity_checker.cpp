@@ -163,4 +163,31 @@ void OmplRosTaskSpaceValidityChecker::configureOnRequest(planning_models::Kinema
     return;
 }
 
+OmplRosTaskSpaceMotionValidator::OmplRosTaskSpaceMotionValidator(ompl::base::SpaceInformation *si,
+                                                                 const boost::shared_ptr<ompl_ros_interface::OmplRosStateTransformer> &state_transformer) :
+  ompl::base::MotionValidator(si),
+  default_validator_(new ompl::base::DiscreteMotionValidator(si)),
+  state_transformer_(state_transformer)
+{
+}
+
+bool OmplRosTaskSpaceMotionValidator::checkMotion(const ompl::base::State *s1, 
+                                                  const ompl::base::State *s2) const
+{
+  state_transformer_->setParentState(s1);
+  bool result = default_validator_->checkMotion(s1,s2);
+  state_transformer_->setParentState(NULL);
+  return result;
+}
+
+bool OmplRosTaskSpaceMotionValidator::checkMotion(const ompl::base::State *s1, 
+                                                  const ompl::base::State *s2, 
+                                                  std::pair<ompl::base::State*, double> &last_valid) const
+{
+  state_transformer_->setParentState(s1);
+  bool result = default_validator_->checkMotion(s1,s2,last_valid);
+  state_transformer_->setParentState(NULL);
+  return result;
+}
+
 }
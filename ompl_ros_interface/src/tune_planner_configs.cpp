@@ -0,0 +1,493 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of Willow Garage, Inc. nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ompl_ros_interface/ompl_ros.h>
+#include <ompl/util/RandomNumbers.h>
+
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Offline tuning of planner configuration parameters. Motion plan requests recorded in planning scene bags 
+ * (as written by ompl_ros on planning failures, or by the warehouse tools) are replayed against randomly 
+ * sampled parameter sets for every planner configuration of every group that has requests. Candidates are 
+ * raced: after a minimum number of requests, candidates that can no longer reach the target success rate or
+ * that are much slower than the best candidate are dropped. The fastest remaining candidate (by median plus 
+ * 95th percentile planning time) that reaches the target success rate is written out as a per-group override 
+ * of the planner configuration in a copy of the planning parameters.
+ *
+ * Usage: tune_planner_configs <output_yaml> <bag> [<bag> ...]
+ * The ompl planning parameters have to be loaded in the private namespace of this node.
+ */
+
+namespace ompl_ros_interface
+{
+
+struct TunedParameter
+{
+  TunedParameter(const std::string &name, double min, double max, bool log_scale) : 
+    name(name), min(min), max(max), log_scale(log_scale)
+  {
+  }
+  std::string name;
+  double min, max;
+  bool log_scale;
+};
+
+struct PlanningProblem
+{
+  arm_navigation_msgs::PlanningScene planning_scene;
+  arm_navigation_msgs::MotionPlanRequest motion_plan_request;
+};
+
+struct Candidate
+{
+  Candidate() : failures(0), alive(true)
+  {
+  }
+  std::map<std::string, double> values;
+  boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> planner;
+  std::vector<double> planning_times;
+  unsigned int failures;
+  bool alive;
+};
+
+class PlannerConfigTuner
+{
+public:
+
+  PlannerConfigTuner() : node_handle_("~"), collision_models_interface_("robot_description", false)
+  {
+    node_handle_.param("tuning/target_success_rate", target_success_rate_, 0.95);
+    node_handle_.param("tuning/num_candidates", num_candidates_, 16);
+    node_handle_.param("tuning/min_rounds", min_rounds_, 5);
+    node_handle_.param("tuning/elimination_factor", elimination_factor_, 1.5);
+    node_handle_.param("tuning/allowed_planning_time", allowed_planning_time_, 0.0);
+    node_handle_.param<std::string>("tuning/motion_plan_request_topic", motion_plan_request_topic_, "motion_plan_request");
+    node_handle_.getParam(node_handle_.getNamespace(), original_parameters_);
+    if(original_parameters_.getType() == XmlRpc::XmlRpcValue::TypeStruct && original_parameters_.hasMember("tuning"))
+      original_parameters_ = removeMember(original_parameters_, "tuning");
+  }
+
+  bool loadProblems(const std::vector<std::string> &bag_files)
+  {
+    for(unsigned int i=0; i < bag_files.size(); i++)
+    {
+      PlanningProblem problem;
+      if(!collision_models_interface_.readPlanningSceneBag(bag_files[i], problem.planning_scene))
+      {
+        ROS_WARN("Could not read planning scene from %s", bag_files[i].c_str());
+        continue;
+      }
+      std::vector<arm_navigation_msgs::MotionPlanRequest> motion_plan_requests;
+      if(!collision_models_interface_.loadMotionPlanRequestsInPlanningSceneBag(bag_files[i], motion_plan_request_topic_, motion_plan_requests))
+      {
+        ROS_WARN("Could not read motion plan requests from %s", bag_files[i].c_str());
+        continue;
+      }
+      for(unsigned int j=0; j < motion_plan_requests.size(); j++)
+      {
+        problem.motion_plan_request = motion_plan_requests[j];
+        problems_[motion_plan_requests[j].group_name].push_back(problem);
+      }
+    }
+    return !problems_.empty();
+  }
+
+  bool tune()
+  {
+    tuned_parameters_ = original_parameters_;
+    for(std::map<std::string, std::vector<PlanningProblem> >::iterator it = problems_.begin(); it != problems_.end(); it++)
+    {
+      XmlRpc::XmlRpcValue planner_configs;
+      if(!node_handle_.getParam(it->first+"/planner_configs", planner_configs) || 
+         planner_configs.getType() != XmlRpc::XmlRpcValue::TypeArray)
+      {
+        ROS_WARN("No planner configurations for group %s, skipping its %d requests", it->first.c_str(), (int) it->second.size());
+        continue;
+      }
+      // Cached plans would hide the planning time of every candidate but the first
+      node_handle_.setParam(it->first+"/plan_cache_size", 0);
+      for(int i=0; i < planner_configs.size(); i++)
+        tuneConfig(it->first, static_cast<std::string>(planner_configs[i]), it->second);
+      if(original_parameters_.hasMember(it->first) && original_parameters_[it->first].hasMember("plan_cache_size"))
+        node_handle_.setParam(it->first+"/plan_cache_size", original_parameters_[it->first]["plan_cache_size"]);
+      else
+        node_handle_.deleteParam(it->first+"/plan_cache_size");
+    }
+    return true;
+  }
+
+  bool writeConfig(const std::string &filename)
+  {
+    std::ofstream out(filename.c_str());
+    if(!out.good())
+    {
+      ROS_ERROR("Could not open %s for writing", filename.c_str());
+      return false;
+    }
+    out << "## Generated by tune_planner_configs" << std::endl;
+    writeYaml(out, tuned_parameters_, 0);
+    return out.good();
+  }
+
+private:
+
+  void getTunedParameters(const std::string &planner_type,
+                          double extent,
+                          std::vector<TunedParameter> &parameters) const
+  {
+    parameters.push_back(TunedParameter("range", 0.02*extent, 0.5*extent, true));
+    if(planner_type == "kinematic::RRT" || planner_type == "kinematic::RRTStar" || planner_type == "kinematic::pRRT" ||
+       planner_type == "kinematic::LazyRRT" || planner_type == "kinematic::EST" || planner_type == "kinematic::KPIECE")
+      parameters.push_back(TunedParameter("goal_bias", 0.0, 0.3, false));
+    if(planner_type == "kinematic::BKPIECE" || planner_type == "kinematic::LBKPIECE")
+      parameters.push_back(TunedParameter("border_fraction", 0.5, 0.95, false));
+    if(planner_type == "kinematic::KPIECE" || planner_type == "kinematic::BKPIECE" || planner_type == "kinematic::LBKPIECE")
+      parameters.push_back(TunedParameter("min_valid_path_fraction", 0.1, 0.9, false));
+    if(planner_type == "kinematic::KPIECE" || planner_type == "kinematic::BKPIECE")
+      parameters.push_back(TunedParameter("failed_expansion_cell_score_factor", 0.3, 0.9, false));
+  }
+
+  std::string getOverrideName(const std::string &group_name,
+                              const std::string &config_name) const
+  {
+    return group_name+"/planner_config_overrides/"+config_name;
+  }
+
+  void tuneConfig(const std::string &group_name,
+                  const std::string &config_name,
+                  const std::vector<PlanningProblem> &problems)
+  {
+    std::string override_name = getOverrideName(group_name, config_name);
+    XmlRpc::XmlRpcValue original_override;
+    bool has_override = node_handle_.getParam(override_name, original_override);
+
+    std::vector<Candidate> candidates(num_candidates_ > 1 ? num_candidates_ : 1);
+    candidates[0].planner = OmplRos::createPlanningGroup(node_handle_, node_handle_.getNamespace(), group_name, config_name, &collision_models_interface_);
+    if(!candidates[0].planner)
+    {
+      ROS_WARN("Could not create planner %s for group %s", config_name.c_str(), group_name.c_str());
+      return;
+    }
+
+    std::string planner_type;
+    node_handle_.param<std::string>("planner_configs/"+config_name+"/type", planner_type, "");
+    std::vector<TunedParameter> parameters;
+    getTunedParameters(planner_type, candidates[0].planner->planner_->getSpaceInformation()->getMaximumExtent(), parameters);
+
+    ompl_ros_interface::PlannerConfig planner_config(node_handle_.getNamespace(), config_name, group_name);
+    for(unsigned int j=0; j < parameters.size(); j++)
+      if(planner_config.hasParam(parameters[j].name))
+        candidates[0].values[parameters[j].name] = planner_config.getParamDouble(parameters[j].name, 0.0);
+
+    for(unsigned int i=1; i < candidates.size(); i++)
+    {
+      for(unsigned int j=0; j < parameters.size(); j++)
+      {
+        double value;
+        if(parameters[j].log_scale)
+          value = exp(rng_.uniformReal(log(parameters[j].min), log(parameters[j].max)));
+        else
+          value = rng_.uniformReal(parameters[j].min, parameters[j].max);
+        candidates[i].values[parameters[j].name] = value;
+        node_handle_.setParam(override_name+"/"+parameters[j].name, value);
+      }
+      candidates[i].planner = OmplRos::createPlanningGroup(node_handle_, node_handle_.getNamespace(), group_name, config_name, &collision_models_interface_);
+      if(!candidates[i].planner)
+        candidates[i].alive = false;
+    }
+
+    node_handle_.deleteParam(override_name);
+    if(has_override)
+      node_handle_.setParam(override_name, original_override);
+
+    race(problems, candidates);
+
+    unsigned int best = selectBest(candidates, problems.size());
+    reportCandidate(group_name, config_name, "current", candidates[0]);
+    if(best == 0)
+    {
+      ROS_INFO("Keeping the current parameters of %s for group %s", config_name.c_str(), group_name.c_str());
+      return;
+    }
+    reportCandidate(group_name, config_name, "tuned", candidates[best]);
+
+    for(std::map<std::string, double>::const_iterator it = candidates[best].values.begin(); it != candidates[best].values.end(); it++)
+      tuned_parameters_[group_name]["planner_config_overrides"][config_name][it->first] = it->second;
+  }
+
+  void race(const std::vector<PlanningProblem> &problems,
+            std::vector<Candidate> &candidates)
+  {
+    std::vector<unsigned int> order(problems.size());
+    for(unsigned int i=0; i < order.size(); i++)
+      order[i] = i;
+    for(unsigned int i=order.size(); i > 1; i--)
+      std::swap(order[i-1], order[rng_.uniformInt(0, i-1)]);
+
+    unsigned int max_failures = (unsigned int) floor((1.0-target_success_rate_)*problems.size());
+    for(unsigned int round=0; round < order.size() && ros::ok(); round++)
+    {
+      const PlanningProblem &problem = problems[order[round]];
+      if(!collision_models_interface_.setPlanningSceneWithCallbacks(problem.planning_scene))
+        continue;
+      for(unsigned int i=0; i < candidates.size(); i++)
+      {
+        if(!candidates[i].alive)
+          continue;
+        arm_navigation_msgs::GetMotionPlan::Request request;
+        arm_navigation_msgs::GetMotionPlan::Response response;
+        request.motion_plan_request = problem.motion_plan_request;
+        if(allowed_planning_time_ > 0.0)
+          request.motion_plan_request.allowed_planning_time = ros::Duration(allowed_planning_time_);
+        ros::WallTime start_time = ros::WallTime::now();
+        candidates[i].planner->computePlan(request, response);
+        double planning_time = (ros::WallTime::now()-start_time).toSec();
+        if(response.error_code.val != arm_navigation_msgs::ArmNavigationErrorCodes::SUCCESS)
+        {
+          candidates[i].failures++;
+          planning_time = std::max(planning_time, request.motion_plan_request.allowed_planning_time.toSec());
+        }
+        candidates[i].planning_times.push_back(planning_time);
+        if(candidates[i].failures > max_failures)
+          candidates[i].alive = false;
+      }
+      if(round+1 < (unsigned int) min_rounds_)
+        continue;
+
+      double best_score = -1.0;
+      for(unsigned int i=0; i < candidates.size(); i++)
+        if(candidates[i].alive && (best_score < 0.0 || getScore(candidates[i]) < best_score))
+          best_score = getScore(candidates[i]);
+      unsigned int num_alive = 0;
+      for(unsigned int i=0; i < candidates.size(); i++)
+      {
+        if(candidates[i].alive && getScore(candidates[i]) > elimination_factor_*best_score)
+          candidates[i].alive = false;
+        if(candidates[i].alive)
+          num_alive++;
+      }
+      if(num_alive <= 1)
+        break;
+    }
+  }
+
+  unsigned int selectBest(const std::vector<Candidate> &candidates,
+                          unsigned int num_problems) const
+  {
+    unsigned int best = 0;
+    bool found = false;
+    for(unsigned int i=0; i < candidates.size(); i++)
+    {
+      if(!candidates[i].alive || candidates[i].planning_times.empty())
+        continue;
+      double success_rate = 1.0 - (double) candidates[i].failures/(double) candidates[i].planning_times.size();
+      if(success_rate < target_success_rate_)
+        continue;
+      if(!found || getScore(candidates[i]) < getScore(candidates[best]))
+      {
+        best = i;
+        found = true;
+      }
+    }
+    if(!found)
+      ROS_WARN("No candidate reached the target success rate of %f over %d requests", target_success_rate_, (int) num_problems);
+    return best;
+  }
+
+  double getPercentile(const std::vector<double> &values, 
+                       double fraction) const
+  {
+    if(values.empty())
+      return 0.0;
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    unsigned int index = (unsigned int) ceil(fraction*sorted.size());
+    return sorted[index > 0 ? index-1 : 0];
+  }
+
+  double getScore(const Candidate &candidate) const
+  {
+    return getPercentile(candidate.planning_times, 0.5) + getPercentile(candidate.planning_times, 0.95);
+  }
+
+  void reportCandidate(const std::string &group_name,
+                       const std::string &config_name,
+                       const std::string &label,
+                       const Candidate &candidate) const
+  {
+    std::stringstream values;
+    for(std::map<std::string, double>::const_iterator it = candidate.values.begin(); it != candidate.values.end(); it++)
+      values << " " << it->first << "=" << it->second;
+    ROS_INFO("%s[%s] %s:%s median %f p95 %f failures %d/%d", config_name.c_str(), group_name.c_str(), label.c_str(), 
+             values.str().c_str(), getPercentile(candidate.planning_times, 0.5), getPercentile(candidate.planning_times, 0.95),
+             candidate.failures, (int) candidate.planning_times.size());
+  }
+
+  static XmlRpc::XmlRpcValue removeMember(XmlRpc::XmlRpcValue &value, 
+                                          const std::string &name)
+  {
+    XmlRpc::XmlRpcValue result;
+    for(XmlRpc::XmlRpcValue::iterator it = value.begin(); it != value.end(); it++)
+      if(it->first != name)
+        result[it->first] = it->second;
+    return result;
+  }
+
+  static void writeScalar(std::ostream &out, 
+                          XmlRpc::XmlRpcValue &value)
+  {
+    switch(value.getType())
+    {
+    case XmlRpc::XmlRpcValue::TypeBoolean:
+      out << (static_cast<bool>(value) ? "true" : "false");
+      break;
+    case XmlRpc::XmlRpcValue::TypeInt:
+      out << static_cast<int>(value);
+      break;
+    case XmlRpc::XmlRpcValue::TypeDouble:
+      {
+        std::stringstream number;
+        number << std::setprecision(12) << static_cast<double>(value);
+        std::string text = number.str();
+        if(text.find_first_of(".eEn") == std::string::npos)
+          text += ".0";
+        out << text;
+      }
+      break;
+    default:
+      {
+        std::string text = static_cast<std::string>(value);
+        out << "\"";
+        for(unsigned int i=0; i < text.size(); i++)
+        {
+          if(text[i] == '"' || text[i] == '\\')
+            out << "\\";
+          out << text[i];
+        }
+        out << "\"";
+      }
+    }
+  }
+
+  static void writeYaml(std::ostream &out, 
+                        XmlRpc::XmlRpcValue &value, 
+                        unsigned int indent)
+  {
+    std::string spaces(indent, ' ');
+    if(value.getType() == XmlRpc::XmlRpcValue::TypeStruct)
+    {
+      for(XmlRpc::XmlRpcValue::iterator it = value.begin(); it != value.end(); it++)
+      {
+        out << spaces << it->first << ":";
+        writeValue(out, it->second, indent);
+      }
+    }
+    else if(value.getType() == XmlRpc::XmlRpcValue::TypeArray)
+    {
+      for(int i=0; i < value.size(); i++)
+      {
+        out << spaces << "-";
+        writeValue(out, value[i], indent);
+      }
+    }
+  }
+
+  static void writeValue(std::ostream &out, 
+                         XmlRpc::XmlRpcValue &value, 
+                         unsigned int indent)
+  {
+    if(value.getType() == XmlRpc::XmlRpcValue::TypeStruct || value.getType() == XmlRpc::XmlRpcValue::TypeArray)
+    {
+      if(value.size() == 0)
+        out << (value.getType() == XmlRpc::XmlRpcValue::TypeStruct ? " {}" : " []") << std::endl;
+      else
+      {
+        out << std::endl;
+        writeYaml(out, value, indent+2);
+      }
+    }
+    else
+    {
+      out << " ";
+      writeScalar(out, value);
+      out << std::endl;
+    }
+  }
+
+  ros::NodeHandle node_handle_;
+  planning_environment::CollisionModelsInterface collision_models_interface_;
+  std::map<std::string, std::vector<PlanningProblem> > problems_;
+  XmlRpc::XmlRpcValue original_parameters_;
+  XmlRpc::XmlRpcValue tuned_parameters_;
+  ompl::RNG rng_;
+
+  double target_success_rate_;
+  int num_candidates_;
+  int min_rounds_;
+  double elimination_factor_;
+  double allowed_planning_time_;
+  std::string motion_plan_request_topic_;
+};
+
+}
+
+int main(int argc, char **argv)
+{ 
+  ros::init(argc, argv, "tune_planner_configs");
+  if(argc < 3)
+  {
+    ROS_ERROR("Usage: tune_planner_configs <output_yaml> <bag> [<bag> ...]");
+    return 1;
+  }
+
+  ros::AsyncSpinner spinner(1); 
+  spinner.start();
+
+  ompl_ros_interface::PlannerConfigTuner tuner;
+  std::vector<std::string> bag_files(argv+2, argv+argc);
+  if(!tuner.loadProblems(bag_files))
+  {
+    ROS_ERROR("No motion plan requests found");
+    return 1;
+  }
+  tuner.tune();
+  if(!tuner.writeConfig(argv[1]))
+    return 1;
+  ros::shutdown();
+  return 0;
+}
@@ -41,9 +41,11 @@
 #include <planning_environment/models/model_utils.h>
 #include <planning_environment/models/collision_models_interface.h>
 #include <actionlib/client/simple_action_client.h>
+#include <ompl_ros_interface/OmplPlannerDiagnostics.h>
 
 static const std::string SET_PLANNING_SCENE_DIFF_SERVICE="/environment_server/set_planning_scene_diff";
 static const std::string PLANNER_SERVICE_NAME="/ompl_planning/plan_kinematic_path";
+static const std::string PLANNER_DIAGNOSTICS_NAME="/ompl_planning/diagnostics";
 
 class OmplPlanningTest : public testing::Test {
 protected:
@@ -81,6 +83,25 @@ protected:
   void GetAndSetPlanningScene() {
     ASSERT_TRUE(set_planning_scene_diff_client_.call(get_req, get_res));
   }
+
+  void diagnosticsCallback(const ompl_ros_interface::OmplPlannerDiagnosticsConstPtr& diagnostics) {
+    diagnostics_ = *diagnostics;
+    diagnostics_received_ = true;
+  }
+
+  bool PlanAndWaitForDiagnostics(arm_navigation_msgs::GetMotionPlan::Request& req,
+                                 arm_navigation_msgs::GetMotionPlan::Response& res) {
+    diagnostics_received_ = false;
+    if(!planning_service_client_.call(req, res)) {
+      return false;
+    }
+    ros::WallTime start = ros::WallTime::now();
+    while(!diagnostics_received_ && ros::WallTime::now()-start < ros::WallDuration(5.0)) {
+      ros::spinOnce();
+      ros::WallDuration(0.01).sleep();
+    }
+    return diagnostics_received_;
+  }
       
 protected:
 
@@ -96,6 +117,9 @@ protected:
 
   ros::ServiceClient set_planning_scene_diff_client_;
   ros::ServiceClient planning_service_client_;
+
+  bool diagnostics_received_;
+  ompl_ros_interface::OmplPlannerDiagnostics diagnostics_;
 };
 
 TEST_F(OmplPlanningTest, TestPole)
@@ -145,6 +169,101 @@ TEST_F(OmplPlanningTest, TestPole)
   }
 }
 
+TEST_F(OmplPlanningTest, TestCachedPlanRevalidated)
+{
+  //the left arm has a plan cache in ompl_planning.yaml
+  ros::Subscriber diagnostics_sub = nh_.subscribe(PLANNER_DIAGNOSTICS_NAME, 10, &OmplPlanningTest::diagnosticsCallback, this);
+  ros::WallTime start = ros::WallTime::now();
+  while(diagnostics_sub.getNumPublishers() == 0 && ros::WallTime::now()-start < ros::WallDuration(5.0)) {
+    ros::WallDuration(0.01).sleep();
+  }
+  ASSERT_GT(diagnostics_sub.getNumPublishers(), 0u);
+
+  arm_navigation_msgs::GetMotionPlan::Request req;
+  req.motion_plan_request.group_name = "left_arm";
+  req.motion_plan_request.num_planning_attempts = 1;
+  req.motion_plan_request.allowed_planning_time = ros::Duration(5.0);
+  const std::vector<std::string>& joint_names = cm_->getKinematicModel()->getModelGroup("left_arm")->getJointModelNames();
+  req.motion_plan_request.goal_constraints.joint_constraints.resize(joint_names.size());
+  for(unsigned int i = 0; i < joint_names.size(); i++) {
+    req.motion_plan_request.goal_constraints.joint_constraints[i].joint_name = joint_names[i];
+    req.motion_plan_request.goal_constraints.joint_constraints[i].position = 0.0;
+    req.motion_plan_request.goal_constraints.joint_constraints[i].tolerance_above = 0.001;
+    req.motion_plan_request.goal_constraints.joint_constraints[i].tolerance_below = 0.001;
+  }      
+  req.motion_plan_request.goal_constraints.joint_constraints[0].position = 2.0;
+  req.motion_plan_request.goal_constraints.joint_constraints[3].position = -.2;
+  req.motion_plan_request.goal_constraints.joint_constraints[5].position = -.2;
+
+  GetAndSetPlanningScene();
+
+  //the first plan fills the cache, the second comes from it
+  arm_navigation_msgs::GetMotionPlan::Response first_res;
+  ASSERT_TRUE(PlanAndWaitForDiagnostics(req, first_res));
+  ASSERT_EQ(first_res.error_code.val,first_res.error_code.SUCCESS);
+  EXPECT_FALSE(diagnostics_.plan_from_cache);
+
+  arm_navigation_msgs::GetMotionPlan::Response cached_res;
+  ASSERT_TRUE(PlanAndWaitForDiagnostics(req, cached_res));
+  ASSERT_EQ(cached_res.error_code.val,cached_res.error_code.SUCCESS);
+  EXPECT_TRUE(diagnostics_.plan_from_cache);
+
+  const trajectory_msgs::JointTrajectory& cached_trajectory = cached_res.trajectory.joint_trajectory;
+  ASSERT_GT(cached_trajectory.points.size(), 2u);
+
+  //put an obstacle where the wrist is halfway along the cached trajectory
+  std::map<std::string, double> halfway_values;
+  for(unsigned int i = 0; i < cached_trajectory.joint_names.size(); i++) {
+    halfway_values[cached_trajectory.joint_names[i]] = cached_trajectory.points[cached_trajectory.points.size()/2].positions[i];
+  }
+  planning_models::KinematicState* state = cm_->setPlanningScene(get_res.planning_scene);
+  ASSERT_TRUE(state != NULL);
+  state->setKinematicState(halfway_values);
+  tf::Transform wrist_pose = state->getLinkState("l_wrist_roll_link")->getGlobalLinkTransform();
+  cm_->revertPlanningScene(state);
+
+  arm_navigation_msgs::CollisionObject obstacle;
+  obstacle.header.stamp = ros::Time::now();
+  obstacle.header.frame_id = cm_->getWorldFrameId();
+  obstacle.id = "obstacle";
+  obstacle.operation.operation = arm_navigation_msgs::CollisionObjectOperation::ADD;
+  obstacle.shapes.resize(1);
+  obstacle.shapes[0].type = arm_navigation_msgs::Shape::SPHERE;
+  obstacle.shapes[0].dimensions.resize(1);
+  obstacle.shapes[0].dimensions[0] = 0.05;
+  obstacle.poses.resize(1);
+  obstacle.poses[0].position.x = wrist_pose.getOrigin().x();
+  obstacle.poses[0].position.y = wrist_pose.getOrigin().y();
+  obstacle.poses[0].position.z = wrist_pose.getOrigin().z();
+  obstacle.poses[0].orientation.w = 1.0;
+
+  get_req.planning_scene_diff.collision_objects.push_back(obstacle);
+
+  GetAndSetPlanningScene();
+
+  arm_navigation_msgs::ArmNavigationErrorCodes error_code;
+  std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
+  ASSERT_FALSE(cm_->isJointTrajectoryValid(get_res.planning_scene,
+                                           cached_trajectory,
+                                           req.motion_plan_request.goal_constraints,
+                                           req.motion_plan_request.path_constraints,
+                                           error_code,
+                                           trajectory_error_codes, false));
+
+  //the cached trajectory now collides, so it must not be returned again
+  arm_navigation_msgs::GetMotionPlan::Response replanned_res;
+  ASSERT_TRUE(PlanAndWaitForDiagnostics(req, replanned_res));
+  EXPECT_FALSE(diagnostics_.plan_from_cache);
+  if(replanned_res.error_code.val == replanned_res.error_code.SUCCESS) {
+    EXPECT_TRUE(cm_->isJointTrajectoryValid(get_res.planning_scene,
+                                            replanned_res.trajectory.joint_trajectory,
+                                            req.motion_plan_request.goal_constraints,
+                                            req.motion_plan_request.path_constraints,
+                                            error_code,
+                                            trajectory_error_codes, false));
+  }
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
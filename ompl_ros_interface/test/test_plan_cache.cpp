@@ -0,0 +1,228 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <gtest/gtest.h>
+#include <ompl_ros_interface/ompl_ros_plan_cache.h>
+
+class TestPlanCache : public testing::Test {
+protected:
+
+  virtual void SetUp() {
+    start_values_.resize(3, 0.0);
+    start_values_[0] = 0.5;
+    start_values_[1] = -1.2;
+    start_values_[2] = 3.0;
+
+    request_.group_name = "right_arm";
+    request_.goal_constraints.joint_constraints.resize(2);
+    request_.goal_constraints.joint_constraints[0].joint_name = "r_shoulder_pan_joint";
+    request_.goal_constraints.joint_constraints[0].position = -0.4;
+    request_.goal_constraints.joint_constraints[1].joint_name = "r_elbow_flex_joint";
+    request_.goal_constraints.joint_constraints[1].position = -1.0;
+
+    request_.goal_constraints.position_constraints.resize(1);
+    request_.goal_constraints.position_constraints[0].header.frame_id = "torso_lift_link";
+    request_.goal_constraints.position_constraints[0].header.stamp = ros::Time(10.0);
+    request_.goal_constraints.position_constraints[0].link_name = "r_wrist_roll_link";
+    request_.goal_constraints.position_constraints[0].position.x = 0.6;
+    request_.goal_constraints.position_constraints[0].position.y = -0.2;
+    request_.goal_constraints.position_constraints[0].position.z = 0.1;
+    request_.goal_constraints.position_constraints[0].constraint_region_orientation.w = 1.0;
+  }
+
+  arm_navigation_msgs::RobotTrajectory makeTrajectory(double position) {
+    arm_navigation_msgs::RobotTrajectory trajectory;
+    trajectory.joint_trajectory.joint_names.push_back("r_shoulder_pan_joint");
+    trajectory.joint_trajectory.points.resize(1);
+    trajectory.joint_trajectory.points[0].positions.push_back(position);
+    return trajectory;
+  }
+
+  std::string keyFor(unsigned int i) {
+    arm_navigation_msgs::MotionPlanRequest request = request_;
+    request.goal_constraints.joint_constraints[0].position = i;
+    return ompl_ros_interface::OmplRosPlanCache(1, 0.01).computeKey(start_values_, request);
+  }
+
+protected:
+
+  std::vector<double> start_values_;
+  arm_navigation_msgs::MotionPlanRequest request_;
+};
+
+TEST_F(TestPlanCache, TestStartQuantization)
+{
+  ompl_ros_interface::OmplRosPlanCache cache(4, 0.01);
+  std::string key = cache.computeKey(start_values_, request_);
+
+  //start values that round to the same cells give the same key
+  std::vector<double> start_values = start_values_;
+  start_values[0] += 0.004;
+  start_values[1] -= 0.004;
+  EXPECT_EQ(key, cache.computeKey(start_values, request_));
+
+  //a start value that rounds to a neighbouring cell does not
+  start_values = start_values_;
+  start_values[2] += 0.006;
+  EXPECT_NE(key, cache.computeKey(start_values, request_));
+
+  //so does a start with a different number of joints
+  start_values = start_values_;
+  start_values.push_back(0.0);
+  EXPECT_NE(key, cache.computeKey(start_values, request_));
+}
+
+TEST_F(TestPlanCache, TestConstraintKey)
+{
+  ompl_ros_interface::OmplRosPlanCache cache(4, 0.01);
+  std::string key = cache.computeKey(start_values_, request_);
+
+  //header stamps do not change the key
+  arm_navigation_msgs::MotionPlanRequest request = request_;
+  request.goal_constraints.position_constraints[0].header.stamp = ros::Time(20.0);
+  request.goal_constraints.position_constraints[0].header.seq = 7;
+  EXPECT_EQ(key, cache.computeKey(start_values_, request));
+
+  //positions are quantized
+  request = request_;
+  request.goal_constraints.joint_constraints[1].position += 0.004;
+  request.goal_constraints.position_constraints[0].position.x -= 0.004;
+  EXPECT_EQ(key, cache.computeKey(start_values_, request));
+
+  request = request_;
+  request.goal_constraints.joint_constraints[1].position += 0.02;
+  EXPECT_NE(key, cache.computeKey(start_values_, request));
+
+  request = request_;
+  request.goal_constraints.position_constraints[0].position.z += 0.02;
+  EXPECT_NE(key, cache.computeKey(start_values_, request));
+
+  //everything else in the constraints is part of the key
+  request = request_;
+  request.goal_constraints.position_constraints[0].header.frame_id = "base_link";
+  EXPECT_NE(key, cache.computeKey(start_values_, request));
+
+  request = request_;
+  request.goal_constraints.joint_constraints[0].tolerance_above = 0.1;
+  EXPECT_NE(key, cache.computeKey(start_values_, request));
+
+  //as are the path constraints and the group
+  request = request_;
+  request.path_constraints.joint_constraints.resize(1);
+  request.path_constraints.joint_constraints[0].joint_name = "r_wrist_flex_joint";
+  EXPECT_NE(key, cache.computeKey(start_values_, request));
+
+  request = request_;
+  request.group_name = "left_arm";
+  EXPECT_NE(key, cache.computeKey(start_values_, request));
+}
+
+TEST_F(TestPlanCache, TestStoreAndLookup)
+{
+  ompl_ros_interface::OmplRosPlanCache cache(4, 0.01);
+  arm_navigation_msgs::RobotTrajectory trajectory;
+  double planning_time;
+
+  EXPECT_FALSE(cache.lookup(keyFor(0), trajectory, planning_time));
+
+  cache.store(keyFor(0), makeTrajectory(1.0), 2.0);
+  ASSERT_TRUE(cache.lookup(keyFor(0), trajectory, planning_time));
+  ASSERT_EQ(trajectory.joint_trajectory.points.size(), 1u);
+  EXPECT_EQ(trajectory.joint_trajectory.points[0].positions[0], 1.0);
+  EXPECT_EQ(planning_time, 2.0);
+
+  //storing under the same key replaces the entry
+  cache.store(keyFor(0), makeTrajectory(3.0), 4.0);
+  EXPECT_EQ(cache.size(), 1u);
+  ASSERT_TRUE(cache.lookup(keyFor(0), trajectory, planning_time));
+  EXPECT_EQ(trajectory.joint_trajectory.points[0].positions[0], 3.0);
+  EXPECT_EQ(planning_time, 4.0);
+
+  cache.remove(keyFor(0));
+  EXPECT_EQ(cache.size(), 0u);
+  EXPECT_FALSE(cache.lookup(keyFor(0), trajectory, planning_time));
+
+  //a cache without room stores nothing
+  ompl_ros_interface::OmplRosPlanCache empty_cache(0, 0.01);
+  empty_cache.store(keyFor(0), makeTrajectory(1.0), 2.0);
+  EXPECT_EQ(empty_cache.size(), 0u);
+  EXPECT_FALSE(empty_cache.lookup(keyFor(0), trajectory, planning_time));
+}
+
+TEST_F(TestPlanCache, TestLRUEviction)
+{
+  ompl_ros_interface::OmplRosPlanCache cache(3, 0.01);
+  arm_navigation_msgs::RobotTrajectory trajectory;
+  double planning_time;
+
+  for(unsigned int i = 0; i < 3; i++) {
+    cache.store(keyFor(i), makeTrajectory(i), 1.0);
+  }
+  EXPECT_EQ(cache.size(), 3u);
+
+  //using the oldest entry keeps it, the next oldest goes instead
+  EXPECT_TRUE(cache.lookup(keyFor(0), trajectory, planning_time));
+  cache.store(keyFor(3), makeTrajectory(3), 1.0);
+  EXPECT_EQ(cache.size(), 3u);
+  EXPECT_TRUE(cache.lookup(keyFor(0), trajectory, planning_time));
+  EXPECT_FALSE(cache.lookup(keyFor(1), trajectory, planning_time));
+  EXPECT_TRUE(cache.lookup(keyFor(2), trajectory, planning_time));
+  EXPECT_TRUE(cache.lookup(keyFor(3), trajectory, planning_time));
+
+  //replacing an entry also makes it the most recent one
+  cache.store(keyFor(0), makeTrajectory(5), 1.0);
+  cache.store(keyFor(4), makeTrajectory(4), 1.0);
+  EXPECT_TRUE(cache.lookup(keyFor(0), trajectory, planning_time));
+  EXPECT_FALSE(cache.lookup(keyFor(2), trajectory, planning_time));
+  EXPECT_TRUE(cache.lookup(keyFor(3), trajectory, planning_time));
+  EXPECT_TRUE(cache.lookup(keyFor(4), trajectory, planning_time));
+
+  //removed entries free their slot
+  cache.remove(keyFor(3));
+  cache.store(keyFor(5), makeTrajectory(5), 1.0);
+  EXPECT_EQ(cache.size(), 3u);
+  EXPECT_TRUE(cache.lookup(keyFor(0), trajectory, planning_time));
+  EXPECT_TRUE(cache.lookup(keyFor(4), trajectory, planning_time));
+  EXPECT_TRUE(cache.lookup(keyFor(5), trajectory, planning_time));
+
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0u);
+  EXPECT_FALSE(cache.lookup(keyFor(0), trajectory, planning_time));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
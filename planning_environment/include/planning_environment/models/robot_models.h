@@ -114,6 +114,12 @@ protected:
 	
   void loadRobotFromParamServer(void);
 
+  /** \brief Build the kinematic model, reusing the link collision shapes from a snapshot file if
+      the parameter <description>_planning/model_snapshot_directory is set */
+  planning_models::KinematicModel* loadKinematicModel(const std::string& content,
+                                                      const std::vector<planning_models::KinematicModel::GroupConfig>& group_configs,
+                                                      const std::vector<planning_models::KinematicModel::MultiDofConfig>& multi_dof_configs);
+
   bool loadMultiDofConfigsFromParamServer(std::vector<planning_models::KinematicModel::MultiDofConfig>& configs);
   void loadGroupConfigsFromParamServer(const std::vector<planning_models::KinematicModel::MultiDofConfig>& multi_dof_configs,
                                        std::vector<planning_models::KinematicModel::GroupConfig>& configs);
@@ -40,10 +40,12 @@
 #include <planning_environment/models/collision_models.h>
 #include <planning_environment/monitors/kinematic_model_state_monitor.h>
 #include <arm_navigation_msgs/CollisionMap.h>
+#include <arm_navigation_msgs/CollisionMapDelta.h>
 #include <arm_navigation_msgs/CollisionObject.h>
 #include <arm_navigation_msgs/AttachedCollisionObject.h>
 #include <boost/thread/mutex.hpp>
 #include <std_srvs/Empty.h>
+#include <map>
 
 namespace planning_environment
 {
@@ -75,6 +77,10 @@ public:
       delete collisionMapUpdateFilter_;
     if (collisionMapUpdateSubscriber_)
       delete collisionMapUpdateSubscriber_;
+    if (collisionMapDeltaFilter_)
+      delete collisionMapDeltaFilter_;
+    if (collisionMapDeltaSubscriber_)
+      delete collisionMapDeltaSubscriber_;
     if (attachedCollisionObjectSubscriber_)
       delete attachedCollisionObjectSubscriber_;
 
@@ -142,6 +148,7 @@ protected:
                            std::vector<shapes::Shape*> &boxes, std::vector<tf::Transform> &poses);
   void collisionMapCallback(const arm_navigation_msgs::CollisionMapConstPtr &collisionMap);
   void collisionMapUpdateCallback(const arm_navigation_msgs::CollisionMapConstPtr &collisionMap);
+  void collisionMapDeltaCallback(const arm_navigation_msgs::CollisionMapDeltaConstPtr &collisionMapDelta);
   void collisionObjectCallback(const arm_navigation_msgs::CollisionObjectConstPtr &collisionObject);
   virtual bool attachObjectCallback(const arm_navigation_msgs::AttachedCollisionObjectConstPtr &attachedObject);
 
@@ -157,6 +164,8 @@ protected:
   tf::MessageFilter<arm_navigation_msgs::CollisionMap> *collisionMapFilter_;
   message_filters::Subscriber<arm_navigation_msgs::CollisionMap> *collisionMapUpdateSubscriber_;
   tf::MessageFilter<arm_navigation_msgs::CollisionMap> *collisionMapUpdateFilter_;
+  message_filters::Subscriber<arm_navigation_msgs::CollisionMapDelta> *collisionMapDeltaSubscriber_;
+  tf::MessageFilter<arm_navigation_msgs::CollisionMapDelta> *collisionMapDeltaFilter_;
   message_filters::Subscriber<arm_navigation_msgs::CollisionObject> *collisionObjectSubscriber_;
   tf::MessageFilter<arm_navigation_msgs::CollisionObject> *collisionObjectFilter_;
 
@@ -164,6 +173,34 @@ protected:
 
   bool use_collision_map_;
 
+  /** \brief Integer index of a collision map cell as published by the mapper, used to match removals in deltas against the cells already held */
+  struct CollisionMapCell
+  {
+    int x, y, z;
+
+    bool operator<(const CollisionMapCell &other) const
+    {
+      if (x != other.x)
+        return x < other.x;
+      if (y != other.y)
+        return y < other.y;
+      return z < other.z;
+    }
+  };
+
+  /** \brief Maintain the collision map from collision_map_occ_delta instead of full collision_map_occ messages */
+  bool use_collision_map_delta_;
+  bool have_delta_keyframe_;
+  unsigned int last_delta_sequence_;
+  /** \brief The cells accumulated from deltas, in the frame of the last applied delta */
+  arm_navigation_msgs::CollisionMap delta_map_;
+  /** \brief The cell of every box in delta_map_, and the slot of every cell */
+  std::vector<CollisionMapCell> delta_map_cells_;
+  std::map<CollisionMapCell, unsigned int> delta_map_index_;
+  /** \brief The grid the cell indices of the last keyframe refer to */
+  double delta_resolution_;
+  geometry_msgs::Point delta_origin_;
+
   boost::recursive_mutex collision_map_lock_;
 };
     
@@ -44,6 +44,7 @@
 
 #include <planning_environment/models/collision_models.h>
 #include <yaml-cpp/yaml.h>
+#include <boost/random/mersenne_twister.hpp>
 
 namespace planning_environment 
 {
@@ -114,6 +115,7 @@ public:
         establish_often_percentage_ = 0.5;
         establish_occasional_num_ = 1000000;
         performance_testing_num_ = 5000;
+        establish_adaptive_resolution_ = 0.00001;
         break;
 
       case Safe:
@@ -122,6 +124,7 @@ public:
         establish_often_percentage_ = 0.5;
         establish_occasional_num_ = 100000;
         performance_testing_num_ = 1000;
+        establish_adaptive_resolution_ = 0.0001;
         break;
 
       case Normal:
@@ -130,6 +133,7 @@ public:
         establish_often_percentage_ = 0.5;
         establish_occasional_num_ = 20000;
         performance_testing_num_ = 1000;
+        establish_adaptive_resolution_ = 0.001;
         break;
 
       case Fast:
@@ -138,6 +142,7 @@ public:
         establish_often_percentage_ = 0.5;
         establish_occasional_num_ = 1000;
         performance_testing_num_ = 100;
+        establish_adaptive_resolution_ = 0.01;
         break;
 
       case VeryFast:
@@ -146,15 +151,48 @@ public:
         establish_often_percentage_ = 0.5;
         establish_occasional_num_ = 500;
         performance_testing_num_ = 10;
+        establish_adaptive_resolution_ = 0.01;
         break;
     }
   }
 
+  /** \brief Sets the number of threads used for sampling; 0 uses one per hardware thread */
+  void setNumThreads(unsigned int num_threads);
+
+  /** \brief Sets the seed that sample sequences are derived from.  Results are
+      reproducible for a given seed regardless of the number of threads */
+  void setRandomSeed(unsigned int seed)
+  {
+    random_seed_ = seed;
+  }
+
+  /** \brief Enables adaptive sampling.  Each pair is sampled only until its
+      collision frequency is determined with respect to the threshold being
+      established, using a Wilson score interval with the given z value, or
+      the rule of three for pairs that always or never collided; see
+      establish_adaptive_resolution_.  Only the joints that move a pair
+      relative to itself are sampled */
+  void setAdaptiveSampling(bool adaptive, double confidence_z = 2.576)
+  {
+    adaptive_sampling_ = adaptive;
+    adaptive_confidence_z_ = confidence_z;
+  }
+
+  /** \brief Number of samples each pair was checked in by the last adaptive sampling pass */
+  const std::map<std::string, std::map<std::string, unsigned int> >& getPairSampleCounts() const
+  {
+    return collision_sample_count_map_;
+  }
+
   unsigned int establish_always_num_;
   unsigned int establish_often_num_;
   double establish_often_percentage_;
   unsigned int establish_occasional_num_;
   unsigned int performance_testing_num_;
+  //collision frequency under which adaptive sampling takes a pair it never
+  //saw collide to never collide, and within which of 1.0 it takes a pair
+  //that always collided to always collide
+  double establish_adaptive_resolution_;
 
 protected:
 
@@ -163,6 +201,30 @@ protected:
 
   void sampleAndCountCollisions(unsigned int num);
 
+  void sampleAndCountCollisionsAdaptive(unsigned int max_num, double low_threshold, double high_threshold);
+
+  //per-thread results of sampleAndCountCollisions, merged once all threads finish
+  struct SampleCounts
+  {
+    std::map<std::string, std::map<std::string, unsigned int> > collision_count_map;
+    //joint values of the last colliding sample for each pair, tagged with the sample index
+    std::map<std::string, std::map<std::string, std::pair<unsigned int, CollidingJointValues> > > collision_joint_values;
+  };
+
+  void runSamplingThreads(unsigned int first_sample, unsigned int num,
+                          const collision_space::EnvironmentModel::AllowedCollisionMatrix* acm,
+                          const std::map<std::string, std::pair<double, double> >& joint_bounds);
+
+  void sampleAndCountCollisionsThread(unsigned int thread_index, unsigned int num_threads,
+                                      unsigned int first_sample, unsigned int num,
+                                      const collision_space::EnvironmentModel::AllowedCollisionMatrix* acm,
+                                      const std::map<std::string, std::pair<double, double> >* joint_bounds,
+                                      SampleCounts* counts);
+
+  void getPairJointBounds(const StringPair& pair, std::map<std::string, std::pair<double, double> >& joint_bounds) const;
+
+  collision_space::EnvironmentModel* cloneCollisionSpace() const;
+
   void buildOutputStructures(unsigned int num, double low_value, double high_value, 
                              std::vector<StringPair>& meets_threshold_collision,
                              std::vector<double>& collision_percentages, 
@@ -171,13 +233,22 @@ protected:
   
   void resetCountingMap();
 
-  void generateRandomState(planning_models::KinematicState& state);
+  void generateRandomState(planning_models::KinematicState& state,
+                           const std::map<std::string, std::pair<double, double> >& joint_bounds,
+                           boost::mt19937& rng);
 
   std::map<std::string, std::pair<double, double> > joint_bounds_map_;
   std::map<std::string, std::map<std::string, unsigned int> > collision_count_map_;
   std::map<std::string, std::map<std::string, CollidingJointValues> > collision_joint_values_;
+  //number of samples each pair was checked in, only filled by adaptive sampling
+  std::map<std::string, std::map<std::string, unsigned int> > collision_sample_count_map_;
 
   planning_environment::CollisionModels* cm_;
 
+  unsigned int num_threads_;
+  unsigned int random_seed_;
+  bool adaptive_sampling_;
+  double adaptive_confidence_z_;
+
 };
 }
@@ -1019,10 +1019,12 @@ bool planning_environment::CollisionModels::convertAttachedObjectToStaticObject(
   static_object_map_[object_name] = link_attached_objects_[link_name][object_name];
   link_attached_objects_[link_name].erase(object_name);
 
+  //holding the version keeps att alive after it is detached below
+  planning_models::KinematicModel::AttachedBodyModelSetConstPtr attached = link->getAttachedBodyModelSet();
   const planning_models::KinematicModel::AttachedBodyModel* att = NULL;
-  for (unsigned int i = 0 ; i < link->getAttachedBodyModels().size() ; ++i) {
-    if(link->getAttachedBodyModels()[i]->getName() == object_name) {
-      att = link->getAttachedBodyModels()[i];
+  for (unsigned int i = 0 ; i < attached->models.size() ; ++i) {
+    if(attached->models[i]->getName() == object_name) {
+      att = attached->models[i];
       break;
     }
   }
@@ -1109,7 +1111,6 @@ bool planning_environment::CollisionModels::applyOrderedCollisionOperationsToCol
 bool planning_environment::CollisionModels::disableCollisionsForNonUpdatedLinks(const std::string& group_name,
                                                                                 bool use_default)
 {
-  kmodel_->sharedLock();  
   const planning_models::KinematicModel::JointModelGroup* joint_model_group = kmodel_->getModelGroup(group_name);
   collision_space::EnvironmentModel::AllowedCollisionMatrix acm;
   if(use_default) { 
@@ -1119,7 +1120,6 @@ bool planning_environment::CollisionModels::disableCollisionsForNonUpdatedLinks(
   }
   if(joint_model_group == NULL) {
     ROS_WARN_STREAM("No joint group " << group_name);
-    kmodel_->sharedUnlock();  
     return false;
   }
 
@@ -1160,12 +1160,10 @@ bool planning_environment::CollisionModels::disableCollisionsForNonUpdatedLinks(
   //this allows all collisions for these links with each other
   if(!acm.changeEntry(non_group_names, non_group_names, true)) {
     ROS_INFO_STREAM("Some problem changing entries");
-    kmodel_->sharedUnlock();  
     return false;
   }
   setAlteredAllowedCollisionMatrix(acm);  
 
-  kmodel_->sharedUnlock();  
   return true;
 }
 
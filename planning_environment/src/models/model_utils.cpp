@@ -37,6 +37,84 @@
 #include <planning_environment/models/model_utils.h>
 #include <geometric_shapes/bodies.h>
 #include <planning_environment/util/construct_object.h>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace {
+
+//maps the joint_state names of a RobotState message onto the joint states of a kinematic state
+struct RobotStateLayout {
+  std::vector<std::string> names;
+  //for each message entry, the index of the joint state in the state's joint state vector, or -1 if the state has no such value
+  std::vector<int> joint_state_indices;
+  //for each message entry, the index of the value in its joint state
+  std::vector<unsigned int> value_indices;
+  //joint states that have at least one value set by the message
+  std::vector<unsigned int> set_joint_states;
+  //state values the message does not set
+  std::vector<std::string> missing_states;
+};
+
+//keyed on the model's instance id, which unlike its address is never reused by another model
+typedef std::pair<unsigned int, std::size_t> RobotStateLayoutKey;
+typedef std::map<RobotStateLayoutKey, boost::shared_ptr<const RobotStateLayout> > RobotStateLayoutMap;
+
+//message layouts hardly ever change, so this only needs to hold a handful of entries
+static const unsigned int MAX_ROBOT_STATE_LAYOUTS = 32;
+
+//one cache per thread, so planner threads never wait on each other here
+boost::thread_specific_ptr<RobotStateLayoutMap> robot_state_layouts;
+
+boost::shared_ptr<const RobotStateLayout> getRobotStateLayout(const std::vector<std::string>& names,
+                                                              const planning_models::KinematicState& state)
+{
+  if(robot_state_layouts.get() == NULL) {
+    robot_state_layouts.reset(new RobotStateLayoutMap());
+  }
+  RobotStateLayoutMap& layouts = *robot_state_layouts;
+  RobotStateLayoutKey key(state.getKinematicModel()->getInstanceId(), boost::hash_range(names.begin(), names.end()));
+  RobotStateLayoutMap::iterator it = layouts.find(key);
+  //hash collisions fall through and replace the entry
+  if(it != layouts.end() && it->second->names == names) {
+    return it->second;
+  }
+
+  boost::shared_ptr<RobotStateLayout> layout(new RobotStateLayout());
+  layout->names = names;
+  layout->joint_state_indices.resize(names.size(), -1);
+  layout->value_indices.resize(names.size(), 0);
+
+  std::map<std::string, unsigned int> name_map;
+  for(unsigned int i = 0; i < names.size(); i++) {
+    name_map[names[i]] = i;
+  }
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = state.getJointStateVector();
+  for(unsigned int i = 0; i < joint_states.size(); i++) {
+    bool is_set = false;
+    const std::map<std::string, unsigned int>& index_map = joint_states[i]->getJointStateIndexMap();
+    for(std::map<std::string, unsigned int>::const_iterator it = index_map.begin(); it != index_map.end(); it++) {
+      std::map<std::string, unsigned int>::const_iterator it2 = name_map.find(it->first);
+      if(it2 == name_map.end() || it->second >= joint_states[i]->getJointStateValues().size()) {
+        layout->missing_states.push_back(it->first);
+        continue;
+      }
+      layout->joint_state_indices[it2->second] = i;
+      layout->value_indices[it2->second] = it->second;
+      is_set = true;
+    }
+    if(is_set) {
+      layout->set_joint_states.push_back(i);
+    }
+  }
+
+  if(layouts.size() >= MAX_ROBOT_STATE_LAYOUTS) {
+    layouts.clear();
+  }
+  layouts[key] = layout;
+  return layout;
+}
+
+}
 
 //returns true if the joint_state_map sets all the joints in the state, 
 bool planning_environment::setRobotStateAndComputeTransforms(const arm_navigation_msgs::RobotState &robot_state,
@@ -47,18 +125,20 @@ bool planning_environment::setRobotStateAndComputeTransforms(const arm_navigatio
                     << " " << robot_state.joint_state.position.size());
     return false;
   }
-  std::map<std::string, double> joint_state_map;
-  for (unsigned int i = 0 ; i < robot_state.joint_state.name.size(); ++i)
-  {
-    joint_state_map[robot_state.joint_state.name[i]] = robot_state.joint_state.position[i];
-  }
-  std::vector<std::string> missing_states;
-  bool complete = state.setKinematicState(joint_state_map, missing_states);
-  if(!complete) {
-    if(missing_states.empty()) {
-      ROS_INFO("Incomplete, but no missing states");
+  //the name to index resolution is cached per message layout, so the positions are copied straight into the joint states
+  boost::shared_ptr<const RobotStateLayout> layout = getRobotStateLayout(robot_state.joint_state.name, state);
+  const std::vector<planning_models::KinematicState::JointState*>& joint_states = state.getJointStateVector();
+  for(unsigned int i = 0; i < layout->joint_state_indices.size(); i++) {
+    if(layout->joint_state_indices[i] >= 0) {
+      joint_states[layout->joint_state_indices[i]]->setJointStateValue(layout->value_indices[i], robot_state.joint_state.position[i]);
     }
   }
+  for(unsigned int i = 0; i < layout->set_joint_states.size(); i++) {
+    joint_states[layout->set_joint_states[i]]->updateVariableTransform();
+  }
+  state.updateKinematicLinks();
+  const std::vector<std::string>& missing_states = layout->missing_states;
+  bool complete = missing_states.empty();
   std::map<std::string, bool> has_missing_state_map;
   for(unsigned int i = 0; i < missing_states.size(); i++) {
     has_missing_state_map[missing_states[i]] = false;
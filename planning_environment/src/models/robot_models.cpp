@@ -35,9 +35,11 @@
 /** \author Ioan Sucan */
 
 #include "planning_environment/models/robot_models.h"
+#include <planning_models/model_snapshot.h>
 #include <ros/console.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
 #include <sstream>
 
 planning_environment::RobotModels::RobotModels(const std::string &description) : priv_nh_("~")
@@ -76,7 +78,7 @@ void planning_environment::RobotModels::loadRobotFromParamServer(void)
       bool hasMulti = loadMultiDofConfigsFromParamServer(multi_dof_configs);
       loadGroupConfigsFromParamServer(multi_dof_configs, group_configs);
       if(hasMulti) {
-        kmodel_ = new planning_models::KinematicModel(*urdf_, group_configs, multi_dof_configs);
+        kmodel_ = loadKinematicModel(content, group_configs, multi_dof_configs);
       } else {
         ROS_WARN("Can't do anything without a root transform");
       }
@@ -91,6 +93,42 @@ void planning_environment::RobotModels::loadRobotFromParamServer(void)
     ROS_ERROR("Robot model '%s' not found! Did you remap 'robot_description'?", description_.c_str());
 }
 
+planning_models::KinematicModel* 
+planning_environment::RobotModels::loadKinematicModel(const std::string& content,
+                                                      const std::vector<planning_models::KinematicModel::GroupConfig>& group_configs,
+                                                      const std::vector<planning_models::KinematicModel::MultiDofConfig>& multi_dof_configs)
+{
+  //the collision shapes (mesh import in particular) are the expensive part of building the model,
+  //so they can be kept in a snapshot keyed on the robot description
+  std::string snapshot_directory;
+  nh_.param(description_ + "_planning/model_snapshot_directory", snapshot_directory, std::string());
+  if(snapshot_directory.empty()) {
+    return new planning_models::KinematicModel(*urdf_, group_configs, multi_dof_configs);
+  }
+
+  boost::uint64_t key = boost::hash<std::string>()(content);
+  std::stringstream filename;
+  filename << snapshot_directory << "/" << urdf_->getName() << "_" << std::hex << key << ".shapes";
+
+  std::map<std::string, const shapes::Shape*> link_shapes;
+  if(planning_models::loadLinkShapeSnapshot(filename.str(), key, link_shapes)) {
+    ROS_DEBUG_STREAM("Using link shapes from model snapshot " << filename.str());
+    planning_models::KinematicModel* kmodel = new planning_models::KinematicModel(*urdf_, group_configs, multi_dof_configs, link_shapes);
+    for(std::map<std::string, const shapes::Shape*>::iterator it = link_shapes.begin();
+        it != link_shapes.end();
+        it++) {
+      delete it->second;
+    }
+    return kmodel;
+  }
+
+  planning_models::KinematicModel* kmodel = new planning_models::KinematicModel(*urdf_, group_configs, multi_dof_configs);
+  if(!planning_models::saveLinkShapeSnapshot(filename.str(), key, *kmodel)) {
+    ROS_WARN_STREAM("Unable to write model snapshot " << filename.str());
+  }
+  return kmodel;
+}
+
 bool planning_environment::RobotModels::loadMultiDofConfigsFromParamServer(std::vector<planning_models::KinematicModel::MultiDofConfig>& configs) 
 {
   configs.clear();
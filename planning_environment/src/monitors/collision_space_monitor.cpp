@@ -35,6 +35,7 @@
 /** \author Ioan Sucan, E. Gil Jones */
 #include <boost/bind.hpp>
 #include <climits>
+#include <cmath>
 #include <sstream>
 
 #include <planning_environment/monitors/collision_space_monitor.h>
@@ -60,11 +61,19 @@ void planning_environment::CollisionSpaceMonitor::setupCSM(void)
   collisionMapSubscriber_ = NULL;
   collisionMapUpdateSubscriber_ = NULL;
   collisionObjectSubscriber_ = NULL;
+
+  collisionMapDeltaFilter_ = NULL;
+  collisionMapDeltaSubscriber_ = NULL;
     
   have_map_ = false;
   use_collision_map_ = false;
 
+  have_delta_keyframe_ = false;
+  last_delta_sequence_ = 0;
+  delta_resolution_ = 0.0;
+
   nh_.param<double>("pointcloud_padd", pointcloud_padd_, 0.00);
+  nh_.param<bool>("use_collision_map_delta", use_collision_map_delta_, false);
 }
 
 void planning_environment::CollisionSpaceMonitor::startEnvironmentMonitor(void)
@@ -73,10 +82,19 @@ void planning_environment::CollisionSpaceMonitor::startEnvironmentMonitor(void)
     return;
 
   if(use_collision_map_) {
-    collisionMapSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMap>(root_handle_, "collision_map_occ", 1);
-    collisionMapFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMap>(*collisionMapSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
-    collisionMapFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapCallback, this, _1));
-    ROS_INFO("Listening to collision_map using message notifier with target frame %s", collisionMapFilter_->getTargetFramesString().c_str());
+    if(use_collision_map_delta_) {
+      //deltas can't be dropped without losing sync, so the queues are deeper than for full maps
+      have_delta_keyframe_ = false;
+      collisionMapDeltaSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMapDelta>(root_handle_, "collision_map_occ_delta", 16);
+      collisionMapDeltaFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMapDelta>(*collisionMapDeltaSubscriber_, *tf_, cm_->getWorldFrameId(), 16);
+      collisionMapDeltaFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapDeltaCallback, this, _1));
+      ROS_INFO("Listening to collision_map_occ_delta using message notifier with target frame %s", collisionMapDeltaFilter_->getTargetFramesString().c_str());
+    } else {
+      collisionMapSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMap>(root_handle_, "collision_map_occ", 1);
+      collisionMapFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMap>(*collisionMapSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
+      collisionMapFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapCallback, this, _1));
+      ROS_INFO("Listening to collision_map using message notifier with target frame %s", collisionMapFilter_->getTargetFramesString().c_str());
+    }
     
     collisionMapUpdateSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMap>(root_handle_, "collision_map_update", 1024);
     collisionMapUpdateFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMap>(*collisionMapUpdateSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
@@ -104,10 +122,18 @@ void planning_environment::CollisionSpaceMonitor::setUseCollisionMap(bool use_co
   if(!envMonitorStarted_) return;
 
   if(use_collision_map_) {
-    collisionMapSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMap>(root_handle_, "collision_map", 1);
-    collisionMapFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMap>(*collisionMapSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
-    collisionMapFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapCallback, this, _1));
-    ROS_DEBUG("Listening to collision_map using message notifier with target frame %s", collisionMapFilter_->getTargetFramesString().c_str());
+    if(use_collision_map_delta_) {
+      have_delta_keyframe_ = false;
+      collisionMapDeltaSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMapDelta>(root_handle_, "collision_map_occ_delta", 16);
+      collisionMapDeltaFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMapDelta>(*collisionMapDeltaSubscriber_, *tf_, cm_->getWorldFrameId(), 16);
+      collisionMapDeltaFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapDeltaCallback, this, _1));
+      ROS_DEBUG("Listening to collision_map_occ_delta using message notifier with target frame %s", collisionMapDeltaFilter_->getTargetFramesString().c_str());
+    } else {
+      collisionMapSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMap>(root_handle_, "collision_map", 1);
+      collisionMapFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMap>(*collisionMapSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
+      collisionMapFilter_->registerCallback(boost::bind(&CollisionSpaceMonitor::collisionMapCallback, this, _1));
+      ROS_DEBUG("Listening to collision_map using message notifier with target frame %s", collisionMapFilter_->getTargetFramesString().c_str());
+    }
     
     collisionMapUpdateSubscriber_ = new message_filters::Subscriber<arm_navigation_msgs::CollisionMap>(root_handle_, "collision_map_update", 1);
     collisionMapUpdateFilter_ = new tf::MessageFilter<arm_navigation_msgs::CollisionMap>(*collisionMapUpdateSubscriber_, *tf_, cm_->getWorldFrameId(), 1);
@@ -131,6 +157,14 @@ void planning_environment::CollisionSpaceMonitor::setUseCollisionMap(bool use_co
       delete collisionMapSubscriber_;
       collisionMapSubscriber_ = NULL;
     }
+    if(collisionMapDeltaFilter_) {
+      delete collisionMapDeltaFilter_;
+      collisionMapDeltaFilter_ = NULL;
+    }
+    if(collisionMapDeltaSubscriber_) {
+      delete collisionMapDeltaSubscriber_;
+      collisionMapDeltaSubscriber_ = NULL;
+    }
   }
 }
   
@@ -156,6 +190,16 @@ void planning_environment::CollisionSpaceMonitor::stopEnvironmentMonitor(void)
     delete collisionMapSubscriber_;
     collisionMapSubscriber_ = NULL;
   }
+
+  if(collisionMapDeltaFilter_) {
+    delete collisionMapDeltaFilter_;
+    collisionMapDeltaFilter_ = NULL;
+  }
+
+  if(collisionMapDeltaSubscriber_) {
+    delete collisionMapDeltaSubscriber_;
+    collisionMapDeltaSubscriber_ = NULL;
+  }
    
   if(collisionObjectFilter_) {
     delete collisionObjectFilter_;
@@ -229,6 +273,93 @@ void planning_environment::CollisionSpaceMonitor::collisionMapCallback(const arm
   updateCollisionSpace(collisionMap, true);
 }
 
+void planning_environment::CollisionSpaceMonitor::collisionMapDeltaCallback(const arm_navigation_msgs::CollisionMapDeltaConstPtr &collisionMapDelta)
+{
+  boost::recursive_mutex::scoped_lock lock(collision_map_lock_);
+
+  if(!collisionMapDelta->keyframe) {
+    if(!have_delta_keyframe_) {
+      ROS_DEBUG("Ignoring collision map delta %u while waiting for a keyframe", collisionMapDelta->sequence);
+      return;
+    }
+    if(collisionMapDelta->sequence != last_delta_sequence_ + 1 ||
+       collisionMapDelta->header.frame_id != delta_map_.header.frame_id ||
+       collisionMapDelta->resolution != delta_resolution_ ||
+       collisionMapDelta->origin.x != delta_origin_.x ||
+       collisionMapDelta->origin.y != delta_origin_.y ||
+       collisionMapDelta->origin.z != delta_origin_.z) {
+      ROS_WARN("Collision map delta %u does not follow %u; waiting for the next keyframe",
+               collisionMapDelta->sequence, last_delta_sequence_);
+      have_delta_keyframe_ = false;
+      return;
+    }
+  } else {
+    delta_map_.boxes.clear();
+    delta_map_cells_.clear();
+    delta_map_index_.clear();
+    delta_resolution_ = collisionMapDelta->resolution;
+    delta_origin_ = collisionMapDelta->origin;
+  }
+
+  if(collisionMapDelta->added_indices.size() != 3 * collisionMapDelta->added.size() ||
+     collisionMapDelta->removed_indices.size() % 3 != 0) {
+    ROS_WARN("Collision map delta %u has malformed cell indices; waiting for the next keyframe", collisionMapDelta->sequence);
+    have_delta_keyframe_ = false;
+    return;
+  }
+
+  //removals swap the last box into the freed slot so the map stays dense
+  const std::vector<int32_t> &removed = collisionMapDelta->removed_indices;
+  for(unsigned int i = 0; i < removed.size(); i += 3) {
+    CollisionMapCell cell;
+    cell.x = removed[i];
+    cell.y = removed[i + 1];
+    cell.z = removed[i + 2];
+    std::map<CollisionMapCell, unsigned int>::iterator it = delta_map_index_.find(cell);
+    if(it == delta_map_index_.end()) {
+      continue;
+    }
+    unsigned int slot = it->second;
+    delta_map_index_.erase(it);
+    unsigned int last = delta_map_.boxes.size() - 1;
+    if(slot != last) {
+      delta_map_.boxes[slot] = delta_map_.boxes[last];
+      delta_map_cells_[slot] = delta_map_cells_[last];
+      delta_map_index_[delta_map_cells_[slot]] = slot;
+    }
+    delta_map_.boxes.pop_back();
+    delta_map_cells_.pop_back();
+  }
+
+  const std::vector<int32_t> &added = collisionMapDelta->added_indices;
+  for(unsigned int i = 0; i < collisionMapDelta->added.size(); i++) {
+    CollisionMapCell cell;
+    cell.x = added[3 * i];
+    cell.y = added[3 * i + 1];
+    cell.z = added[3 * i + 2];
+    std::map<CollisionMapCell, unsigned int>::iterator it = delta_map_index_.find(cell);
+    if(it != delta_map_index_.end()) {
+      delta_map_.boxes[it->second] = collisionMapDelta->added[i];
+    } else {
+      delta_map_index_[cell] = delta_map_.boxes.size();
+      delta_map_.boxes.push_back(collisionMapDelta->added[i]);
+      delta_map_cells_.push_back(cell);
+    }
+  }
+
+  delta_map_.header = collisionMapDelta->header;
+  last_delta_sequence_ = collisionMapDelta->sequence;
+  have_delta_keyframe_ = true;
+
+  std::vector<shapes::Shape*> shapes;
+  std::vector<tf::Transform> poses;
+  //cells are in the mapper's frame, so all of them have to be re-expressed in the world frame each time
+  collisionMapAsBoxes(delta_map_, shapes, poses);
+  cm_->setCollisionMap(shapes, poses, false);
+  last_map_update_ = collisionMapDelta->header.stamp;
+  have_map_ = true;
+}
+
 void planning_environment::CollisionSpaceMonitor::collisionMapAsSpheres(const arm_navigation_msgs::CollisionMapConstPtr &collisionMap,
                                                                         std::vector<shapes::Shape*> &spheres, std::vector<tf::Transform> &poses)
 {
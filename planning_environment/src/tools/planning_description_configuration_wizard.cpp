@@ -117,6 +117,9 @@ PlanningDescriptionConfigurationWizard::PlanningDescriptionConfigurationWizard(c
   cm_ = new CollisionModels(urdf_, kmodel_, ode_collision_model_);
   ops_gen_ = new CollisionOperationsGenerator(cm_);
 
+  bool adaptive_sampling;
+  ros::NodeHandle("~").param("adaptive_sampling", adaptive_sampling, false);
+  ops_gen_->setAdaptiveSampling(adaptive_sampling);
 
   setupQtPages();
   inited_ = true;
@@ -39,20 +39,95 @@
 
 #include <planning_environment/util/collision_operations_generator.h>
 #include <yaml-cpp/yaml.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <algorithm>
+#include <cmath>
 
 using namespace planning_environment;
 
-inline double gen_rand(double min, double max)
+//samples are drawn in fixed-size chunks, each with its own seed
+static const unsigned int SAMPLE_CHUNK_SIZE = 256;
+
+inline double gen_rand(boost::mt19937& rng, double min, double max)
 {
-  int rand_num = rand()%100+1;
+  boost::uniform_int<> dist(1, 100);
+  int rand_num = dist(rng);
   double result = min + (double)((max-min)*rand_num)/101.0;
   return result;
 }
 
+//Wilson score interval for a binomial proportion
+inline void confidence_interval(unsigned int successes, unsigned int trials, double z,
+                                double& low, double& high)
+{
+  if(trials == 0) {
+    low = 0.0;
+    high = 1.0;
+    return;
+  }
+  double n = trials;
+  double p = successes/n;
+  double z2 = z*z;
+  double center = (p+z2/(2.0*n))/(1.0+z2/n);
+  double half_width = z*sqrt(p*(1.0-p)/n+z2/(4.0*n*n))/(1.0+z2/n);
+  low = center-half_width;
+  high = center+half_width;
+}
+
+//whether further samples of a pair could still change how it is classified
+//against [low_threshold, high_threshold].  Thresholds the counts settle
+//exactly are settled by them: when any collision counts, by the first one,
+//and when only pairs that always collide count, by the first miss.
+//Otherwise the frequency has to be known to be clear of each threshold.
+//With no collisions (or no misses) the rule of three bounds it by 3/n,
+//otherwise the Wilson score interval does.  Frequencies within resolution of
+//0 or 1 cannot be told apart from them, so thresholds are kept that far in
+inline bool pair_determined(unsigned int collisions, unsigned int samples, unsigned int max_samples,
+                            double low_threshold, double high_threshold, double z, double resolution)
+{
+  if(samples == 0) {
+    return false;
+  }
+  //a low threshold of 1/max_samples, allowing for rounding
+  if(low_threshold*max_samples <= 1.0+1e-9 && high_threshold >= 1.0 && collisions > 0) {
+    return true;
+  }
+  if(low_threshold >= 1.0 && collisions < samples) {
+    return true;
+  }
+  double low, high;
+  if(collisions == 0) {
+    low = 0.0;
+    high = 3.0/samples;
+  } else if(collisions == samples) {
+    low = 1.0-3.0/samples;
+    high = 1.0;
+  } else {
+    confidence_interval(collisions, samples, z, low, high);
+  }
+  double low_limit = std::min(std::max(low_threshold, resolution), 1.0-resolution);
+  if(high >= low_limit && low <= low_limit) {
+    return false;
+  }
+  //nothing is above a threshold of 1.0
+  if(high_threshold < 1.0) {
+    double high_limit = std::min(std::max(high_threshold, resolution), 1.0-resolution);
+    if(high >= high_limit && low <= high_limit) {
+      return false;
+    }
+  }
+  return true;
+}
+
 CollisionOperationsGenerator::CollisionOperationsGenerator(planning_environment::CollisionModels* cm) 
 {
   setSafety(CollisionOperationsGenerator::Normal);
   cm_ = cm;
+  random_seed_ = 1;
+  setNumThreads(0);
+  setAdaptiveSampling(false);
 
   enableAllCollisions();
 
@@ -85,7 +160,11 @@ void CollisionOperationsGenerator::accumulateAdjacentLinksRecursive(const planni
 void CollisionOperationsGenerator::generateAlwaysInCollisionPairs(std::vector<CollisionOperationsGenerator::StringPair>& always_in_collision,
                                                                   std::vector<CollisionOperationsGenerator::CollidingJointValues>& in_collision_joint_values)
 {
-  sampleAndCountCollisions(establish_always_num_);
+  if(adaptive_sampling_) {
+    sampleAndCountCollisionsAdaptive(establish_always_num_, 1.0, 1.0);
+  } else {
+    sampleAndCountCollisions(establish_always_num_);
+  }
   std::vector<double> percentages;
   std::map<std::string, std::map<std::string, double> > percentage_num;
   buildOutputStructures(establish_always_num_, 1.0, 1.0,
@@ -120,7 +199,11 @@ void CollisionOperationsGenerator::generateOftenInCollisionPairs(std::vector<Col
                                                                  std::vector<double>& percentages, 
                                                                  std::vector<CollisionOperationsGenerator::CollidingJointValues>& in_collision_joint_values)
 {
-  sampleAndCountCollisions(establish_often_num_);
+  if(adaptive_sampling_) {
+    sampleAndCountCollisionsAdaptive(establish_often_num_, establish_often_percentage_, 1.0);
+  } else {
+    sampleAndCountCollisions(establish_often_num_);
+  }
   std::map<std::string, std::map<std::string, double> > percentage_num;
   buildOutputStructures(establish_often_num_, establish_often_percentage_, 1.0,
                         often_in_collision, percentages, in_collision_joint_values, percentage_num);
@@ -137,6 +220,29 @@ void CollisionOperationsGenerator::generateOccasionallyAndNeverInCollisionPairs(
   never_in_collision_pairs.clear();
   in_collision_joint_values.clear();
 
+  if(adaptive_sampling_) {
+    //a single adaptive pass covers the samples of both fixed passes below
+    unsigned int max_num = 2*establish_occasional_num_;
+    std::map<std::string, std::map<std::string, double> > percentage_num;
+    sampleAndCountCollisionsAdaptive(max_num, 1.0/(max_num*1.0), 1.0);
+    buildOutputStructures(max_num, 1.0/(max_num*1.0), 1.0,
+                          occasionally_in_collision_pairs, collision_percentages, in_collision_joint_values, percentage_num);
+    for(std::map<std::string, std::map<std::string, double> >::iterator it = percentage_num.begin();
+        it != percentage_num.end();
+        it++) {
+      for(std::map<std::string, double>::iterator it2 = it->second.begin();
+          it2 != it->second.end();
+          it2++) {
+        if(it->first < it2->first && it2->second == 0) {
+          never_in_collision_pairs.push_back(StringPair(it->first, it2->first));
+        }
+      }
+    }
+    ROS_INFO_STREAM("Occasionally pairs num " << occasionally_in_collision_pairs.size());
+    ROS_INFO_STREAM("Never pairs num " << never_in_collision_pairs.size());
+    return;
+  }
+
   std::vector<CollisionOperationsGenerator::StringPair> first_in_collision_pairs;
   std::vector<CollisionOperationsGenerator::StringPair> second_in_collision_pairs;
 
@@ -281,38 +387,218 @@ void CollisionOperationsGenerator::generateSamplingStructures(const std::map<std
   }
 }
 
+void CollisionOperationsGenerator::setNumThreads(unsigned int num_threads) {
+  if(num_threads == 0) {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+  num_threads_ = std::max(num_threads, 1u);
+}
+
+collision_space::EnvironmentModel* CollisionOperationsGenerator::cloneCollisionSpace() const {
+  const collision_space::EnvironmentModel* source = cm_->getCollisionSpace();
+  source->lock();
+  collision_space::EnvironmentModel* env = source->clone();
+  //clones start out with the default matrix and padding
+  env->setAlteredCollisionMatrix(source->getCurrentAllowedCollisionMatrix());
+  std::map<std::string, double> current_padding = source->getCurrentLinkPaddingMap();
+  if(current_padding != source->getDefaultLinkPaddingMap()) {
+    env->setAlteredLinkPadding(current_padding);
+  }
+  source->unlock();
+  return env;
+}
+
 void CollisionOperationsGenerator::sampleAndCountCollisions(unsigned int num) {
   resetCountingMap();
-  
-  planning_models::KinematicState state(cm_->getKinematicModel());
-  
-  for(unsigned int i = 0; i < num; i++) {
-    generateRandomState(state);
-    
-    std::vector<arm_navigation_msgs::ContactInformation> contacts;
-    cm_->getAllCollisionsForState(state,
-                                  contacts);
-
-    if(i != 0 && i % 10000 == 0) {
-      ROS_INFO_STREAM("On iteration " << i);
+  runSamplingThreads(0, num, NULL, joint_bounds_map_);
+}
+
+void CollisionOperationsGenerator::sampleAndCountCollisionsAdaptive(unsigned int max_num, double low_threshold, double high_threshold) {
+  resetCountingMap();
+
+  const collision_space::EnvironmentModel::AllowedCollisionMatrix& current_acm = cm_->getCurrentAllowedCollisionMatrix();
+  const std::vector<planning_models::KinematicModel::LinkModel*>& lmv = cm_->getKinematicModel()->getLinkModelsWithCollisionGeometry();
+
+  //pairs that are already disabled are never sampled
+  std::vector<StringPair> active_pairs;
+  for(unsigned int i = 0; i < lmv.size(); i++) {
+    for(unsigned int j = i+1; j < lmv.size(); j++) {
+      bool allowed;
+      if(current_acm.getAllowedCollision(lmv[i]->getName(), lmv[j]->getName(), allowed) && allowed) {
+        continue;
+      }
+      active_pairs.push_back(StringPair(lmv[i]->getName(), lmv[j]->getName()));
+    }
+  }
+
+  std::map<std::string, std::map<std::string, unsigned int> >& counts = collision_count_map_;
+  unsigned int num_done = 0;
+  unsigned int round_size = SAMPLE_CHUNK_SIZE*num_threads_;
+  while(!active_pairs.empty() && num_done < max_num) {
+    unsigned int num = std::min(round_size, max_num-num_done);
+
+    //only undetermined pairs are checked, and only the joints that move them are sampled
+    collision_space::EnvironmentModel::AllowedCollisionMatrix acm = current_acm;
+    acm.changeEntry(true);
+    std::map<std::string, std::pair<double, double> > joint_bounds;
+    for(unsigned int i = 0; i < active_pairs.size(); i++) {
+      acm.changeEntry(active_pairs[i].first, active_pairs[i].second, false);
+      getPairJointBounds(active_pairs[i], joint_bounds);
+    }
+    runSamplingThreads(num_done, num, &acm, joint_bounds);
+    num_done += num;
+
+    std::vector<StringPair> still_active;
+    for(unsigned int i = 0; i < active_pairs.size(); i++) {
+      const StringPair& pair = active_pairs[i];
+      unsigned int& pair_num = collision_sample_count_map_[pair.first][pair.second];
+      pair_num += num;
+      collision_sample_count_map_[pair.second][pair.first] = pair_num;
+
+      if(!pair_determined(counts[pair.first][pair.second], pair_num, max_num, low_threshold, high_threshold,
+                          adaptive_confidence_z_, establish_adaptive_resolution_)) {
+        still_active.push_back(pair);
+      }
+    }
+    ROS_DEBUG_STREAM("After " << num_done << " samples " << still_active.size() << " of "
+                     << active_pairs.size() << " pairs are undetermined");
+    active_pairs.swap(still_active);
+    round_size *= 2;
+  }
+  ROS_INFO_STREAM("Adaptive sampling used " << num_done << " samples, " << active_pairs.size()
+                  << " pairs reached the limit of " << max_num);
+}
+
+void CollisionOperationsGenerator::getPairJointBounds(const StringPair& pair,
+                                                      std::map<std::string, std::pair<double, double> >& joint_bounds) const {
+  const planning_models::KinematicModel* model = cm_->getKinematicModel();
+  std::vector<const planning_models::KinematicModel::JointModel*> chains[2];
+  const planning_models::KinematicModel::LinkModel* links[2] = {model->getLinkModel(pair.first),
+                                                                model->getLinkModel(pair.second)};
+  for(unsigned int i = 0; i < 2; i++) {
+    const planning_models::KinematicModel::LinkModel* link = links[i];
+    while(link != NULL && link->getParentJointModel() != NULL) {
+      chains[i].push_back(link->getParentJointModel());
+      link = link->getParentJointModel()->getParentLinkModel();
     }
-    
-    for(unsigned int i = 0; i < contacts.size(); i++) {
-      arm_navigation_msgs::ContactInformation& contact = contacts[i];
-      if(collision_count_map_.find(contact.contact_body_1) == collision_count_map_.end()) {
-        ROS_WARN_STREAM("Problem - have no count for collision body " << contact.contact_body_1);
+  }
+  //joints shared by both chains move the pair rigidly together
+  for(unsigned int i = 0; i < 2; i++) {
+    const std::vector<const planning_models::KinematicModel::JointModel*>& other = chains[1-i];
+    for(unsigned int j = 0; j < chains[i].size(); j++) {
+      if(std::find(other.begin(), other.end(), chains[i][j]) != other.end()) {
+        continue;
       }
-      if(collision_count_map_.find(contact.contact_body_2) == collision_count_map_.end()) {
-        ROS_WARN_STREAM("Problem - have no count for collision body " << contact.contact_body_2);
+      const std::map<std::string, std::pair<double, double> >& var_bounds = chains[i][j]->getAllVariableBounds();
+      for(std::map<std::string, std::pair<double, double> >::const_iterator it = var_bounds.begin();
+          it != var_bounds.end();
+          it++) {
+        std::map<std::string, std::pair<double, double> >::const_iterator bit = joint_bounds_map_.find(it->first);
+        if(bit != joint_bounds_map_.end()) {
+          joint_bounds[it->first] = bit->second;
+        }
+      }
+    }
+  }
+}
+
+void CollisionOperationsGenerator::runSamplingThreads(unsigned int first_sample, unsigned int num,
+                                                      const collision_space::EnvironmentModel::AllowedCollisionMatrix* acm,
+                                                      const std::map<std::string, std::pair<double, double> >& joint_bounds) {
+  unsigned int num_chunks = (first_sample+num+SAMPLE_CHUNK_SIZE-1)/SAMPLE_CHUNK_SIZE-first_sample/SAMPLE_CHUNK_SIZE;
+  unsigned int num_threads = std::max(std::min(num_threads_, num_chunks), 1u);
+
+  std::vector<SampleCounts> counts(num_threads);
+  boost::thread_group threads;
+  for(unsigned int i = 0; i < num_threads; i++) {
+    threads.create_thread(boost::bind(&CollisionOperationsGenerator::sampleAndCountCollisionsThread, this,
+                                      i, num_threads, first_sample, num, acm, &joint_bounds, &counts[i]));
+  }
+  threads.join_all();
+
+  //for joint values keep the highest sample index, which is what a single
+  //sequential pass would have kept
+  std::map<std::string, std::map<std::string, unsigned int> > last_sample;
+  for(unsigned int i = 0; i < num_threads; i++) {
+    for(std::map<std::string, std::map<std::string, unsigned int> >::iterator it = counts[i].collision_count_map.begin();
+        it != counts[i].collision_count_map.end();
+        it++) {
+      if(collision_count_map_.find(it->first) == collision_count_map_.end()) {
+        ROS_WARN_STREAM("Problem - have no count for collision body " << it->first);
+      }
+      for(std::map<std::string, unsigned int>::iterator it2 = it->second.begin();
+          it2 != it->second.end();
+          it2++) {
+        collision_count_map_[it->first][it2->first] += it2->second;
+      }
+    }
+    for(std::map<std::string, std::map<std::string, std::pair<unsigned int, CollidingJointValues> > >::iterator it = counts[i].collision_joint_values.begin();
+        it != counts[i].collision_joint_values.end();
+        it++) {
+      for(std::map<std::string, std::pair<unsigned int, CollidingJointValues> >::iterator it2 = it->second.begin();
+          it2 != it->second.end();
+          it2++) {
+        std::map<std::string, unsigned int>& last_sample_row = last_sample[it->first];
+        if(last_sample_row.find(it2->first) == last_sample_row.end() ||
+           last_sample_row[it2->first] < it2->second.first) {
+          last_sample_row[it2->first] = it2->second.first;
+          collision_joint_values_[it->first][it2->first] = it2->second.second;
+        }
+      }
+    }
+  }
+}
+
+void CollisionOperationsGenerator::sampleAndCountCollisionsThread(unsigned int thread_index, unsigned int num_threads,
+                                                                  unsigned int first_sample, unsigned int num,
+                                                                  const collision_space::EnvironmentModel::AllowedCollisionMatrix* acm,
+                                                                  const std::map<std::string, std::pair<double, double> >* joint_bounds,
+                                                                  SampleCounts* counts) {
+  //each thread checks against its own copy of the environment, and deletes it
+  //itself so that the ODE data for this thread is released
+  collision_space::EnvironmentModel* env = cloneCollisionSpace();
+  if(acm != NULL) {
+    env->setAlteredCollisionMatrix(*acm);
+  }
+  planning_models::KinematicState state(cm_->getKinematicModel());
+  state.setKinematicStateToDefault();
+  std::vector<collision_space::EnvironmentModel::Contact> contacts;
+
+  //chunks are numbered by absolute sample index so that seeds do not depend on the split
+  unsigned int end_sample = first_sample+num;
+  unsigned int first_chunk = first_sample/SAMPLE_CHUNK_SIZE;
+  unsigned int end_chunk = (end_sample+SAMPLE_CHUNK_SIZE-1)/SAMPLE_CHUNK_SIZE;
+  for(unsigned int chunk = first_chunk+thread_index; chunk < end_chunk; chunk += num_threads) {
+    boost::mt19937 rng(random_seed_+chunk);
+    unsigned int chunk_begin = std::max(first_sample, chunk*SAMPLE_CHUNK_SIZE);
+    unsigned int chunk_end = std::min(end_sample, (chunk+1)*SAMPLE_CHUNK_SIZE);
+    for(unsigned int i = chunk_begin; i < chunk_end; i++) {
+      generateRandomState(state, *joint_bounds, rng);
+
+      contacts.clear();
+      env->updateRobotModel(&state);
+      env->getAllCollisionContacts(contacts, 1);
+
+      if(i != 0 && i % 10000 == 0) {
+        ROS_INFO_STREAM("On iteration " << i);
+      }
+
+      if(contacts.empty()) {
+        continue;
       }
-      collision_count_map_[contact.contact_body_1][contact.contact_body_2]++;
-      collision_count_map_[contact.contact_body_2][contact.contact_body_1]++;
       CollidingJointValues cjv;
       state.getKinematicStateValues(cjv);
-      collision_joint_values_[contact.contact_body_1][contact.contact_body_2] = cjv;
-      collision_joint_values_[contact.contact_body_2][contact.contact_body_1] = cjv;
+      for(unsigned int j = 0; j < contacts.size(); j++) {
+        const std::string& body_1 = contacts[j].body_name_1;
+        const std::string& body_2 = contacts[j].body_name_2;
+        counts->collision_count_map[body_1][body_2]++;
+        counts->collision_count_map[body_2][body_1]++;
+        counts->collision_joint_values[body_1][body_2] = std::pair<unsigned int, CollidingJointValues>(i, cjv);
+        counts->collision_joint_values[body_2][body_1] = std::pair<unsigned int, CollidingJointValues>(i, cjv);
+      }
     }
   }
+  delete env;
 }
 
 void CollisionOperationsGenerator::buildOutputStructures(unsigned int num, double low_threshold, double high_threshold, 
@@ -348,7 +634,14 @@ void CollisionOperationsGenerator::buildOutputStructures(unsigned int num, doubl
           continue;
         }
       }
-      double per = (it2->second*1.0)/(num*1.0);
+      unsigned int pair_num = num;
+      if(!collision_sample_count_map_.empty()) {
+        pair_num = collision_sample_count_map_[it->first][it2->first];
+      }
+      double per = 0.0;
+      if(pair_num != 0) {
+        per = (it2->second*1.0)/(pair_num*1.0);
+      }
       percentage_num[it->first][it2->first] = per;
       percentage_num[it2->first][it->first] = per;
       if(per >= low_threshold && per <= high_threshold) {
@@ -448,14 +741,17 @@ void CollisionOperationsGenerator::resetCountingMap() {
     collision_count_map_[lmv[i]->getName()] = all_link_zero;
   }
   collision_joint_values_.clear();
+  collision_sample_count_map_.clear();
 }
 
-void CollisionOperationsGenerator::generateRandomState(planning_models::KinematicState& state) {
+void CollisionOperationsGenerator::generateRandomState(planning_models::KinematicState& state,
+                                                       const std::map<std::string, std::pair<double, double> >& joint_bounds,
+                                                       boost::mt19937& rng) {
   std::map<std::string, double> values;
-  for(std::map<std::string, std::pair<double, double> >::iterator it = joint_bounds_map_.begin();
-      it != joint_bounds_map_.end();
+  for(std::map<std::string, std::pair<double, double> >::const_iterator it = joint_bounds.begin();
+      it != joint_bounds.end();
       it++) {
-    values[it->first] = gen_rand(it->second.first, it->second.second);
+    values[it->first] = gen_rand(rng, it->second.first, it->second.second);
     //ROS_INFO_STREAM("Value for " << it->first << " is " << values[it->first] << " bounds " << 
     //                it->second.first << " " << it->second.second);
   }
@@ -39,11 +39,14 @@
 #include <planning_models/kinematic_state.h>
 #include <ros/time.h>
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <ros/package.h>
 #include <planning_environment/models/model_utils.h>
+#include <planning_environment/util/collision_operations_generator.h>
+#include <set>
 
 static const std::string rel_path = "/test_urdf/robot.xml";
 static const double VERY_SMALL = .0001;
@@ -237,6 +240,27 @@ TEST_F(TestCollisionModels, TestModelUtils)
   //now we mess with the multi-dof, and now something's not getting set
   rs.multi_dof_joint_state.frame_ids.clear();
   ASSERT_FALSE(planning_environment::setRobotStateAndComputeTransforms(rs,state));
+
+  //the same values in a different order should produce the same state
+  planning_environment::convertKinematicStateToRobotState(state,
+                                                          ros::Time::now(),
+                                                          cm.getWorldFrameId(),
+                                                          rs);
+  for(unsigned int i = 0; i < rs.joint_state.name.size(); i++) {
+    if(rs.joint_state.name[i] == "r_shoulder_pan_joint") {
+      rs.joint_state.position[i] = -.5;
+    }
+  }
+  ASSERT_TRUE(planning_environment::setRobotStateAndComputeTransforms(rs,state));
+  tf::Transform first_pose = state.getLinkState("r_wrist_roll_link")->getGlobalLinkTransform();
+
+  state.setKinematicStateToDefault();
+  std::reverse(rs.joint_state.name.begin(), rs.joint_state.name.end());
+  std::reverse(rs.joint_state.position.begin(), rs.joint_state.position.end());
+  ASSERT_TRUE(planning_environment::setRobotStateAndComputeTransforms(rs,state));
+  EXPECT_NEAR(state.getJointState("r_shoulder_pan_joint")->getJointStateValues()[0], -.5, .00001);
+  tf::Transform second_pose = state.getLinkState("r_wrist_roll_link")->getGlobalLinkTransform();
+  EXPECT_NEAR(first_pose.getOrigin().distance(second_pose.getOrigin()), 0.0, .00001);
 }
 
 //Functional equivalent of test_collision_objects
@@ -804,6 +828,126 @@ TEST_F(TestCollisionModels, TestConversionFunctionsForConstraints)
   EXPECT_LE(fabs(goal_constraints.position_constraints[0].position.x-3.5), VERY_SMALL) ;
 }
 
+typedef planning_environment::CollisionOperationsGenerator::StringPair StringPair;
+
+static StringPair orderedPair(const StringPair& pair)
+{
+  return pair.first < pair.second ? pair : StringPair(pair.second, pair.first);
+}
+
+//runs the same steps as the wizard and collects the pairs found at either end of the scale
+static void classifyCollisionPairs(planning_environment::CollisionOperationsGenerator& gen,
+                                   bool adaptive,
+                                   std::set<StringPair>& always,
+                                   std::set<StringPair>& never,
+                                   std::map<StringPair, double>& occasionally,
+                                   std::map<StringPair, unsigned int>& occasionally_samples)
+{
+  always.clear();
+  never.clear();
+  occasionally.clear();
+  occasionally_samples.clear();
+  gen.setAdaptiveSampling(adaptive);
+  gen.enableAllCollisions();
+
+  std::vector<StringPair> pairs, never_pairs;
+  std::vector<planning_environment::CollisionOperationsGenerator::CollidingJointValues> joint_values;
+  std::vector<double> percentages;
+
+  gen.generateAdjacentInCollisionPairs(pairs);
+  gen.disablePairCollisionChecking(pairs);
+
+  gen.generateAlwaysInCollisionPairs(pairs, joint_values);
+  gen.disablePairCollisionChecking(pairs);
+  for(unsigned int i = 0; i < pairs.size(); i++) {
+    always.insert(orderedPair(pairs[i]));
+  }
+
+  gen.generateDefaultInCollisionPairs(pairs, joint_values);
+  gen.disablePairCollisionChecking(pairs);
+
+  gen.generateOftenInCollisionPairs(pairs, percentages, joint_values);
+  gen.disablePairCollisionChecking(pairs);
+
+  gen.generateOccasionallyAndNeverInCollisionPairs(pairs, never_pairs, percentages, joint_values);
+  for(unsigned int i = 0; i < pairs.size(); i++) {
+    occasionally[orderedPair(pairs[i])] = percentages[i];
+  }
+  for(unsigned int i = 0; i < never_pairs.size(); i++) {
+    never.insert(orderedPair(never_pairs[i]));
+  }
+  const std::map<std::string, std::map<std::string, unsigned int> >& counts = gen.getPairSampleCounts();
+  for(std::map<std::string, std::map<std::string, unsigned int> >::const_iterator it = counts.begin(); it != counts.end(); it++) {
+    for(std::map<std::string, unsigned int>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
+      if(it->first < it2->first) {
+        occasionally_samples[StringPair(it->first, it2->first)] = it2->second;
+      }
+    }
+  }
+}
+
+TEST_F(TestCollisionModels, TestAdaptiveSampling)
+{
+  planning_environment::CollisionModels cm("robot_description");
+  planning_environment::CollisionOperationsGenerator gen(&cm);
+  gen.setSafety(planning_environment::CollisionOperationsGenerator::Fast);
+  gen.setRandomSeed(7);
+  gen.setNumThreads(2);
+  gen.generateSamplingStructures(std::map<std::string, bool>());
+
+  std::set<StringPair> exhaustive_always, exhaustive_never;
+  std::map<StringPair, double> exhaustive_occasionally;
+  std::map<StringPair, unsigned int> exhaustive_samples;
+  classifyCollisionPairs(gen, false, exhaustive_always, exhaustive_never, exhaustive_occasionally, exhaustive_samples);
+
+  std::set<StringPair> adaptive_always, adaptive_never;
+  std::map<StringPair, double> adaptive_occasionally;
+  std::map<StringPair, unsigned int> adaptive_samples;
+  classifyCollisionPairs(gen, true, adaptive_always, adaptive_never, adaptive_occasionally, adaptive_samples);
+
+  EXPECT_GT(exhaustive_never.size(), 0);
+  EXPECT_TRUE(adaptive_always == exhaustive_always);
+
+  //adaptive sampling takes pairs it has not seen collide by the resolution
+  //to never collide, so a pair that collides more rarely than that may be
+  //found by only one of the two
+  const double rare = gen.establish_adaptive_resolution_;
+  for(std::set<StringPair>::iterator it = exhaustive_never.begin(); it != exhaustive_never.end(); it++) {
+    bool same = adaptive_never.count(*it) > 0 ||
+      (adaptive_occasionally.count(*it) > 0 && adaptive_occasionally[*it] <= rare);
+    EXPECT_TRUE(same) << it->first << " and " << it->second << " never collide with exhaustive sampling";
+  }
+  for(std::set<StringPair>::iterator it = adaptive_never.begin(); it != adaptive_never.end(); it++) {
+    bool same = exhaustive_never.count(*it) > 0 ||
+      (exhaustive_occasionally.count(*it) > 0 && exhaustive_occasionally[*it] <= rare);
+    EXPECT_TRUE(same) << it->first << " and " << it->second << " never collide with adaptive sampling";
+  }
+
+  //the occasional step settles every pair before the budget runs out: pairs
+  //that collide at their first collision, and pairs that do not once the rule
+  //of three puts them under the resolution
+  const unsigned int max_num = 2*gen.establish_occasional_num_;
+  EXPECT_TRUE(exhaustive_samples.empty());
+  EXPECT_GT(adaptive_samples.size(), 0u);
+  for(std::map<StringPair, unsigned int>::iterator it = adaptive_samples.begin(); it != adaptive_samples.end(); it++) {
+    EXPECT_GT(it->second, 0u);
+    EXPECT_LT(it->second, max_num) << it->first.first << " and " << it->first.second << " used the whole budget";
+    if(adaptive_never.count(it->first) > 0) {
+      EXPECT_LT(3.0/it->second, gen.establish_adaptive_resolution_) << it->first.first << " and " << it->first.second;
+    }
+  }
+
+  //the same seed gives the same result
+  std::set<StringPair> repeat_always, repeat_never;
+  std::map<StringPair, double> repeat_occasionally;
+  std::map<StringPair, unsigned int> repeat_samples;
+  classifyCollisionPairs(gen, true, repeat_always, repeat_never, repeat_occasionally, repeat_samples);
+  EXPECT_TRUE(repeat_always == adaptive_always);
+  EXPECT_TRUE(repeat_never == adaptive_never);
+  EXPECT_TRUE(repeat_occasionally == adaptive_occasionally);
+  EXPECT_TRUE(repeat_samples == adaptive_samples);
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
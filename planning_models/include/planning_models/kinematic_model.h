@@ -42,6 +42,8 @@
 #include <urdf/model.h>
 #include <tf/LinearMath/Transform.h>
 #include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <iostream>
 #include <vector>
@@ -66,6 +68,21 @@ public:
 
   /** \brief Forward definition of an attached body */
   class AttachedBodyModel;
+
+  /** \brief One version of the set of bodies attached to a link.
+      Versions are never modified once published; changing the
+      attached bodies publishes a new version, and the bodies in a
+      version stay alive as long as the version is referenced */
+  struct AttachedBodyModelSet
+  {
+    /** \brief The attached bodies, in attachment order */
+    std::vector<AttachedBodyModel*> models;
+
+    /** \brief Owners of the bodies in models, shared between versions */
+    std::vector<boost::shared_ptr<AttachedBodyModel> > owners;
+  };
+
+  typedef boost::shared_ptr<const AttachedBodyModelSet> AttachedBodyModelSetConstPtr;
 	
   struct MultiDofConfig
   {
@@ -368,17 +385,23 @@ public:
       return shape_;
     }
     
-    const std::vector<AttachedBodyModel*>& getAttachedBodyModels() const {
-      return attached_body_models_;
+    /** \brief Get the bodies currently attached to this link */
+    std::vector<AttachedBodyModel*> getAttachedBodyModels() const {
+      return getAttachedBodyModelSet()->models;
     }
 
+    /** \brief Get the current version of the attached bodies; the
+        bodies remain valid for as long as the returned pointer is
+        held, even if they are detached from the link meanwhile */
+    AttachedBodyModelSetConstPtr getAttachedBodyModelSet() const;
+
   private:
      
-    /** \brief Removes all attached body models from this link, requiring an exclusive lock */
+    /** \brief Removes all attached body models from this link */
     void clearAttachedBodyModels();
     
     /** \brief Removes all attached body models from this link, and replaces them with the supplied vector,
-        requiring an exclusive lock
+        taking ownership of the supplied bodies
      */
     void replaceAttachedBodyModels(std::vector<AttachedBodyModel*>& attached_body_vector);
    
@@ -386,6 +409,9 @@ public:
 
     void addAttachedBodyModel(AttachedBodyModel* attached_body_model);
 
+    /** \brief Publishes a new version of the attached bodies */
+    void setAttachedBodyModelSet(AttachedBodyModelSetConstPtr attached_body_models);
+
     /** \brief Name of the link */
     std::string name_;
     
@@ -407,8 +433,11 @@ public:
     /** \brief The geometry of the link */
     shapes::Shape *shape_;
     
-    /** \brief Attached bodies */
-    std::vector<AttachedBodyModel*> attached_body_models_;	        
+    /** \brief Current version of the attached bodies */
+    AttachedBodyModelSetConstPtr attached_body_models_;
+
+    /** \brief Only held while the attached body version pointer is read or replaced */
+    mutable boost::mutex attached_body_models_lock_;
   };
   
   /** \brief Class defining bodies that can be attached to robot
@@ -579,6 +608,13 @@ public:
   KinematicModel(const urdf::Model &model, 
                  const std::vector<GroupConfig>& group_configs,
                  const std::vector<MultiDofConfig>& multi_dof_configs);
+
+  /** \brief Construct a kinematic model from a parsed description, taking the collision shapes of the links
+      named in link_shapes from that map (the shapes are copied) instead of constructing them from the description */
+  KinematicModel(const urdf::Model &model, 
+                 const std::vector<GroupConfig>& group_configs,
+                 const std::vector<MultiDofConfig>& multi_dof_configs,
+                 const std::map<std::string, const shapes::Shape*>& link_shapes);
 	
   /** \brief Destructor. Clear all memory. */
   ~KinematicModel(void);
@@ -588,6 +624,13 @@ public:
   /** \brief General the model name **/
   const std::string& getName(void) const;
 
+  /** \brief An identifier that no other model constructed in this process has; unlike the model's
+      address it is never reused, so it can key caches of data derived from the model */
+  unsigned int getInstanceId(void) const
+  {
+    return instance_id_;
+  }
+
   /** \brief Get a link by its name */
   const LinkModel* getLinkModel(const std::string &link) const;
 
@@ -652,7 +695,10 @@ public:
   /** \brief Get the root joint */
   const JointModel* getRoot(void) const;
 	
-  /** \brief Provide interface to get an exclusive lock to change the model. Use carefully! */
+  /** \brief Provide interface to get an exclusive lock to change the model. Use carefully!
+      The kinematic tree is immutable after construction and attached
+      bodies are published as new versions, so readers do not need
+      the shared lock; the exclusive lock only serializes writers */
   void exclusiveLock(void) const;
 	
   /** \brief Provide interface to release an exclusive lock. Use carefully! */
@@ -714,6 +760,9 @@ private:
   /** \brief The name of the model */
   std::string model_name_;	
 
+  /** \brief See getInstanceId() */
+  unsigned int instance_id_;
+
   /** \brief A map from link names to their instances */
   std::map<std::string, LinkModel*> link_model_map_;
 
@@ -735,6 +784,12 @@ private:
   std::map<std::string, JointModelGroup*> joint_model_group_map_;
   std::map<std::string, GroupConfig> joint_model_group_config_map_;
 
+  /** \brief Prebuilt link shapes; only set while the model is being constructed */
+  const std::map<std::string, const shapes::Shape*>* link_shapes_;
+
+  void buildModel(const urdf::Model &model, 
+                  const std::vector<GroupConfig>& group_configs,
+                  const std::vector<MultiDofConfig>& multi_dof_configs);
   void buildGroups(const std::vector<GroupConfig>&);
   JointModel* buildRecursive(LinkModel *parent, const urdf::Link *link, 
                              const std::vector<MultiDofConfig>& multi_dof_configs);
@@ -83,6 +83,16 @@ public:
     /** \brief Sets the internal values from the transform */
     bool setJointStateValues(const tf::Transform& transform);
 
+    /** \brief Sets a single internal value, given its index in the name order, without recomputing the 
+        transform; call updateVariableTransform() once all values of the joint are set */
+    void setJointStateValue(unsigned int index, double value)
+    {
+      joint_state_values_[index] = value;
+    }
+
+    /** \brief Recomputes the variable transform from the internal values */
+    void updateVariableTransform();
+
     /** \brief Specifies whether or not all values associated with a joint are defined in the 
         supplied joint value map */
     bool allJointStateValuesAreDefined(const std::map<std::string, double>& joint_value_map) const;
@@ -230,6 +240,9 @@ public:
 
     std::vector<AttachedBodyState*> attached_body_state_vector_;
 
+    /** \brief The version of the attached bodies the attached body states refer to */
+    KinematicModel::AttachedBodyModelSetConstPtr attached_body_models_;
+
     /** \brief The global transform this link forwards (computed by forward kinematics) */
     tf::Transform global_link_transform_;
     
@@ -0,0 +1,64 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef PLANNING_MODELS_MODEL_SNAPSHOT_
+#define PLANNING_MODELS_MODEL_SNAPSHOT_
+
+#include <planning_models/kinematic_model.h>
+#include <boost/cstdint.hpp>
+
+namespace planning_models
+{
+
+/** \brief Write the collision shapes of all links in a model to a
+    binary snapshot file. The key identifies the inputs the model was
+    built from (typically a hash of the robot description) and must
+    match when the snapshot is loaded. The file is written under a
+    temporary name and renamed, so concurrent readers never see a
+    partial snapshot. */
+bool saveLinkShapeSnapshot(const std::string& filename,
+                           boost::uint64_t key,
+                           const KinematicModel& model);
+
+/** \brief Read link collision shapes from a snapshot file written by
+    saveLinkShapeSnapshot(). Returns false if the file does not exist,
+    is malformed or was written for a different key. On success the
+    caller owns the shapes in link_shapes. */
+bool loadLinkShapeSnapshot(const std::string& filename,
+                           boost::uint64_t key,
+                           std::map<std::string, const shapes::Shape*>& link_shapes);
+
+}
+
+#endif
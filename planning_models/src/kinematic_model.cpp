@@ -46,9 +46,45 @@
 
 
 /* ------------------------ KinematicModel ------------------------ */
+
+namespace {
+
+unsigned int nextInstanceId()
+{
+  static boost::mutex instance_id_lock;
+  static unsigned int next_instance_id = 0;
+  boost::mutex::scoped_lock lock(instance_id_lock);
+  return next_instance_id++;
+}
+
+}
 planning_models::KinematicModel::KinematicModel(const urdf::Model &model, 
                                                 const std::vector<GroupConfig>& group_configs,
-                                                const std::vector<MultiDofConfig>& multi_dof_configs)
+                                                const std::vector<MultiDofConfig>& multi_dof_configs) :
+  instance_id_(nextInstanceId()), link_shapes_(NULL)
+{    
+  buildModel(model, group_configs, multi_dof_configs);
+}
+
+planning_models::KinematicModel::KinematicModel(const urdf::Model &model, 
+                                                const std::vector<GroupConfig>& group_configs,
+                                                const std::vector<MultiDofConfig>& multi_dof_configs,
+                                                const std::map<std::string, const shapes::Shape*>& link_shapes) :
+  instance_id_(nextInstanceId()), link_shapes_(&link_shapes)
+{    
+  buildModel(model, group_configs, multi_dof_configs);
+  link_shapes_ = NULL;
+}
+
+planning_models::KinematicModel::KinematicModel(const KinematicModel &source) :
+  instance_id_(nextInstanceId()), link_shapes_(NULL)
+{
+  copyFrom(source);
+}
+
+void planning_models::KinematicModel::buildModel(const urdf::Model &model, 
+                                                 const std::vector<GroupConfig>& group_configs,
+                                                 const std::vector<MultiDofConfig>& multi_dof_configs)
 {    
   model_name_ = model.getName();
   if (model.getRoot())
@@ -64,11 +100,6 @@ planning_models::KinematicModel::KinematicModel(const urdf::Model &model,
   }
 }
 
-planning_models::KinematicModel::KinematicModel(const KinematicModel &source)
-{
-  copyFrom(source);
-}
-
 planning_models::KinematicModel::~KinematicModel(void)
 {
   for (std::map<std::string, JointModelGroup*>::iterator it = joint_model_group_map_.begin() ; it != joint_model_group_map_.end() ; ++it)
@@ -427,12 +458,15 @@ planning_models::KinematicModel::LinkModel* planning_models::KinematicModel::con
   LinkModel *result = new LinkModel(this);
   result->name_ = urdf_link->name;
 
+  std::map<std::string, const shapes::Shape*>::const_iterator prebuilt;
+  bool has_prebuilt = (link_shapes_ != NULL && (prebuilt = link_shapes_->find(urdf_link->name)) != link_shapes_->end());
+
   if(urdf_link->collision && urdf_link->collision->geometry) {
     result->collision_origin_transform_ = urdfPose2TFTransform(urdf_link->collision->origin);
-    result->shape_ = constructShape(urdf_link->collision->geometry.get());
+    result->shape_ = has_prebuilt ? shapes::cloneShape(prebuilt->second) : constructShape(urdf_link->collision->geometry.get());
   } else if(urdf_link->visual && urdf_link->visual->geometry){
     result->collision_origin_transform_ = urdfPose2TFTransform(urdf_link->visual->origin);
-    result->shape_ = constructShape(urdf_link->visual->geometry.get());
+    result->shape_ = has_prebuilt ? shapes::cloneShape(prebuilt->second) : constructShape(urdf_link->visual->geometry.get());
   } else {
     result->collision_origin_transform_.setIdentity();
     result->shape_ = NULL;
@@ -728,8 +762,8 @@ std::vector<const planning_models::KinematicModel::AttachedBodyModel*> planning_
 {
   std::vector<const planning_models::KinematicModel::AttachedBodyModel*> ret_vec;
   for(unsigned int i =0; i < link_model_vector_.size(); i++) {
-    ret_vec.insert(ret_vec.end(), link_model_vector_[i]->getAttachedBodyModels().begin(),
-                   link_model_vector_[i]->getAttachedBodyModels().end());
+    AttachedBodyModelSetConstPtr attached = link_model_vector_[i]->getAttachedBodyModelSet();
+    ret_vec.insert(ret_vec.end(), attached->models.begin(), attached->models.end());
   }
   return ret_vec;
 }
@@ -1107,7 +1141,8 @@ bool planning_models::KinematicModel::RevoluteJointModel::isValueWithinVariableB
 planning_models::KinematicModel::LinkModel::LinkModel(const KinematicModel* kinematic_model) : 
   kinematic_model_(kinematic_model),
   parent_joint_model_(NULL), 
-  shape_(NULL)
+  shape_(NULL),
+  attached_body_models_(new AttachedBodyModelSet())
 {
   joint_origin_transform_.setIdentity();
   collision_origin_transform_.setIdentity();
@@ -1124,19 +1159,24 @@ planning_models::KinematicModel::LinkModel::LinkModel(const LinkModel* link_mode
   } else {
     shape_ = NULL;
   }
-  for (unsigned int i = 0 ; i < link_model->attached_body_models_.size() ; ++i)
+  AttachedBodyModelSetConstPtr source_attached = link_model->getAttachedBodyModelSet();
+  AttachedBodyModelSet* attached = new AttachedBodyModelSet();
+  for (unsigned int i = 0 ; i < source_attached->models.size() ; ++i)
   {
+    const AttachedBodyModel* source_ab = source_attached->models[i];
     std::vector<shapes::Shape*> shapes;
-    for(unsigned int j = 0; j < link_model->attached_body_models_[i]->getShapes().size(); j++) {
-      shapes.push_back(shapes::cloneShape(link_model->attached_body_models_[i]->getShapes()[j]));
+    for(unsigned int j = 0; j < source_ab->getShapes().size(); j++) {
+      shapes.push_back(shapes::cloneShape(source_ab->getShapes()[j]));
     }
     AttachedBodyModel *ab = new AttachedBodyModel(this, 
-                                                  link_model->attached_body_models_[i]->getName(),
-                                                  link_model->attached_body_models_[i]->getAttachedBodyFixedTransforms(),
-                                                  link_model->attached_body_models_[i]->getTouchLinks(),
+                                                  source_ab->getName(),
+                                                  source_ab->getAttachedBodyFixedTransforms(),
+                                                  source_ab->getTouchLinks(),
                                                   shapes);
-    attached_body_models_.push_back(ab);
+    attached->models.push_back(ab);
+    attached->owners.push_back(boost::shared_ptr<AttachedBodyModel>(ab));
   }
+  attached_body_models_.reset(attached);
 }
 
 planning_models::KinematicModel::LinkModel::~LinkModel(void)
@@ -1145,36 +1185,50 @@ planning_models::KinematicModel::LinkModel::~LinkModel(void)
     delete shape_;
   for (unsigned int i = 0 ; i < child_joint_models_.size() ; ++i)
     delete child_joint_models_[i];
-  for (unsigned int i = 0 ; i < attached_body_models_.size() ; ++i)
-    delete attached_body_models_[i];
+}
+
+planning_models::KinematicModel::AttachedBodyModelSetConstPtr 
+planning_models::KinematicModel::LinkModel::getAttachedBodyModelSet() const
+{
+  boost::mutex::scoped_lock lock(attached_body_models_lock_);
+  return attached_body_models_;
+}
+
+void planning_models::KinematicModel::LinkModel::setAttachedBodyModelSet(AttachedBodyModelSetConstPtr attached_body_models)
+{
+  //the old version is released outside the lock, as that may delete bodies
+  AttachedBodyModelSetConstPtr old_version;
+  {
+    boost::mutex::scoped_lock lock(attached_body_models_lock_);
+    old_version = attached_body_models_;
+    attached_body_models_ = attached_body_models;
+  }
 }
 
 void planning_models::KinematicModel::LinkModel::clearAttachedBodyModels() 
 {
-  //assumes exclusive lock has been granted
-  for (unsigned int i = 0 ; i < attached_body_models_.size() ; ++i)
-    delete attached_body_models_[i];
-  attached_body_models_.clear();
+  //writers are serialized by the exclusive lock
+  setAttachedBodyModelSet(AttachedBodyModelSetConstPtr(new AttachedBodyModelSet()));
 }
 
 void planning_models::KinematicModel::LinkModel::replaceAttachedBodyModels(std::vector<AttachedBodyModel*>& attached_body_vector) 
 {
-  //assumes exclusive lock has been granted
-  for (unsigned int i = 0 ; i < attached_body_models_.size() ; ++i)
-    delete attached_body_models_[i];
-  attached_body_models_.clear();
-
-  attached_body_models_ = attached_body_vector;
+  AttachedBodyModelSet* attached = new AttachedBodyModelSet();
+  attached->models = attached_body_vector;
+  for (unsigned int i = 0 ; i < attached_body_vector.size() ; ++i)
+    attached->owners.push_back(boost::shared_ptr<AttachedBodyModel>(attached_body_vector[i]));
+  setAttachedBodyModelSet(AttachedBodyModelSetConstPtr(attached));
 }
 
 void planning_models::KinematicModel::LinkModel::clearLinkAttachedBodyModel(const std::string& att_name) 
 {
-  for(std::vector<AttachedBodyModel*>::iterator it = attached_body_models_.begin();
-      it != attached_body_models_.end();
-      it++) {
-    if((*it)->getName() == att_name) {
-      delete (*it);
-      attached_body_models_.erase(it);
+  AttachedBodyModelSetConstPtr current = getAttachedBodyModelSet();
+  for(unsigned int i = 0; i < current->models.size(); i++) {
+    if(current->models[i]->getName() == att_name) {
+      AttachedBodyModelSet* attached = new AttachedBodyModelSet(*current);
+      attached->models.erase(attached->models.begin()+i);
+      attached->owners.erase(attached->owners.begin()+i);
+      setAttachedBodyModelSet(AttachedBodyModelSetConstPtr(attached));
       return;
     }
   }
@@ -1182,7 +1236,10 @@ void planning_models::KinematicModel::LinkModel::clearLinkAttachedBodyModel(cons
 
 void planning_models::KinematicModel::LinkModel::addAttachedBodyModel(planning_models::KinematicModel::AttachedBodyModel* ab)
 {
-  attached_body_models_.push_back(ab);
+  AttachedBodyModelSet* attached = new AttachedBodyModelSet(*getAttachedBodyModelSet());
+  attached->models.push_back(ab);
+  attached->owners.push_back(boost::shared_ptr<AttachedBodyModel>(ab));
+  setAttachedBodyModelSet(AttachedBodyModelSetConstPtr(attached));
 }
 
 /* ------------------------ AttachedBodyModel ------------------------ */
@@ -40,8 +40,6 @@
 planning_models::KinematicState::KinematicState(const KinematicModel* kinematic_model) :
   kinematic_model_(kinematic_model), dimension_(0)
 {
-  kinematic_model_->sharedLock();
-
   const std::vector<KinematicModel::JointModel*>& joint_model_vector = kinematic_model_->getJointModels();
   joint_state_vector_.resize(joint_model_vector.size());
   //joint_index_location_.resize(joint_model_vector.size());
@@ -81,7 +79,6 @@ planning_models::KinematicState::KinematicState(const KinematicModel* kinematic_
 planning_models::KinematicState::KinematicState(const KinematicState& ks) :
   kinematic_model_(ks.getKinematicModel()), dimension_(0)
 {
-  kinematic_model_->sharedLock();
   const std::vector<JointState*>& joint_state_vector = ks.getJointStateVector();
   unsigned int vector_index_counter = 0;
   joint_state_vector_.resize(joint_state_vector.size());
@@ -124,7 +121,6 @@ planning_models::KinematicState::KinematicState(const KinematicState& ks) :
 
 planning_models::KinematicState::~KinematicState() 
 {
-  kinematic_model_->sharedUnlock();
   for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
     delete joint_state_vector_[i];
   }
@@ -401,6 +397,10 @@ bool planning_models::KinematicState::JointState::setJointStateValues(const std:
   return true;
 }
 
+void planning_models::KinematicState::JointState::updateVariableTransform() {
+  variable_transform_ = joint_model_->computeTransform(joint_state_values_);
+}
+
 bool planning_models::KinematicState::JointState::setJointStateValues(const std::map<std::string, double>& joint_value_map) {
   bool has_all = true;
   bool has_any = false;
@@ -515,7 +515,9 @@ planning_models::KinematicState::LinkState::LinkState(const planning_models::Kin
 {
   global_link_transform_.setIdentity();
   global_collision_body_transform_.setIdentity();
-  const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_body_vector = link_model_->getAttachedBodyModels();
+  //the state keeps the version of the attached bodies it was created with
+  attached_body_models_ = link_model_->getAttachedBodyModelSet();
+  const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_body_vector = attached_body_models_->models;
   attached_body_state_vector_.resize(attached_body_vector.size());
   unsigned int j = 0;
   for(std::vector<planning_models::KinematicModel::AttachedBodyModel*>::const_iterator it = attached_body_vector.begin();
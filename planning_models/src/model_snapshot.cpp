@@ -0,0 +1,326 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <planning_models/model_snapshot.h>
+#include <ros/console.h>
+
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// the snapshot stores values in host byte order; it is a local cache, not an exchange format
+static const char SNAPSHOT_MAGIC[8] = {'P','M','S','N','A','P','\0','\0'};
+static const boost::uint32_t SNAPSHOT_VERSION = 1;
+
+namespace
+{
+
+template<typename T>
+void writeValue(std::ofstream& out, const T& value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+void writeArray(std::ofstream& out, const T* values, unsigned int count)
+{
+  if(count > 0) {
+    out.write(reinterpret_cast<const char*>(values), sizeof(T)*count);
+  }
+}
+
+void writeShape(std::ofstream& out, const shapes::Shape* shape)
+{
+  writeValue<boost::uint32_t>(out, shape->type);
+  switch(shape->type) {
+  case shapes::SPHERE:
+    writeValue<double>(out, static_cast<const shapes::Sphere*>(shape)->radius);
+    break;
+  case shapes::CYLINDER:
+    writeValue<double>(out, static_cast<const shapes::Cylinder*>(shape)->radius);
+    writeValue<double>(out, static_cast<const shapes::Cylinder*>(shape)->length);
+    break;
+  case shapes::BOX:
+    writeArray<double>(out, static_cast<const shapes::Box*>(shape)->size, 3);
+    break;
+  case shapes::MESH:
+    {
+      const shapes::Mesh* mesh = static_cast<const shapes::Mesh*>(shape);
+      writeValue<boost::uint32_t>(out, mesh->vertexCount);
+      writeValue<boost::uint32_t>(out, mesh->triangleCount);
+      writeValue<boost::uint8_t>(out, mesh->normals != NULL);
+      writeArray<double>(out, mesh->vertices, mesh->vertexCount*3);
+      writeArray<unsigned int>(out, mesh->triangles, mesh->triangleCount*3);
+      if(mesh->normals != NULL) {
+        writeArray<double>(out, mesh->normals, mesh->triangleCount*3);
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+//bounds-checked cursor over the mapped file
+class SnapshotReader
+{
+public:
+  SnapshotReader(const char* data, size_t size) : data_(data), size_(size), pos_(0) {}
+
+  template<typename T>
+  bool read(T& value)
+  {
+    return readArray(&value, 1);
+  }
+
+  template<typename T>
+  bool readArray(T* values, size_t count)
+  {
+    if(count > (size_ - pos_)/sizeof(T)) {
+      return false;
+    }
+    memcpy(values, data_+pos_, sizeof(T)*count);
+    pos_ += sizeof(T)*count;
+    return true;
+  }
+
+  size_t remaining() const
+  {
+    return size_ - pos_;
+  }
+
+  bool readString(std::string& str, boost::uint32_t length)
+  {
+    if(length > size_ - pos_) {
+      return false;
+    }
+    str.assign(data_+pos_, length);
+    pos_ += length;
+    return true;
+  }
+
+private:
+  const char* data_;
+  size_t size_;
+  size_t pos_;
+};
+
+shapes::Shape* readShape(SnapshotReader& reader)
+{
+  boost::uint32_t type;
+  if(!reader.read(type)) {
+    return NULL;
+  }
+  switch(type) {
+  case shapes::SPHERE:
+    {
+      shapes::Sphere* sphere = new shapes::Sphere();
+      if(reader.read(sphere->radius)) {
+        return sphere;
+      }
+      delete sphere;
+    }
+    break;
+  case shapes::CYLINDER:
+    {
+      shapes::Cylinder* cylinder = new shapes::Cylinder();
+      if(reader.read(cylinder->radius) && reader.read(cylinder->length)) {
+        return cylinder;
+      }
+      delete cylinder;
+    }
+    break;
+  case shapes::BOX:
+    {
+      shapes::Box* box = new shapes::Box();
+      if(reader.readArray(box->size, 3)) {
+        return box;
+      }
+      delete box;
+    }
+    break;
+  case shapes::MESH:
+    {
+      boost::uint32_t vertex_count, triangle_count;
+      boost::uint8_t has_normals;
+      if(!reader.read(vertex_count) || !reader.read(triangle_count) || !reader.read(has_normals)) {
+        return NULL;
+      }
+      //don't allocate for counts the file can't possibly hold
+      boost::uint64_t needed = (boost::uint64_t) vertex_count*3*sizeof(double) + (boost::uint64_t) triangle_count*3*sizeof(unsigned int);
+      if(needed > reader.remaining()) {
+        return NULL;
+      }
+      shapes::Mesh* mesh = new shapes::Mesh(vertex_count, triangle_count);
+      if(!has_normals) {
+        delete[] mesh->normals;
+        mesh->normals = NULL;
+      }
+      if(reader.readArray(mesh->vertices, vertex_count*3) &&
+         reader.readArray(mesh->triangles, triangle_count*3) &&
+         (!has_normals || reader.readArray(mesh->normals, triangle_count*3))) {
+        return mesh;
+      }
+      delete mesh;
+    }
+    break;
+  default:
+    break;
+  }
+  return NULL;
+}
+
+}
+
+bool planning_models::saveLinkShapeSnapshot(const std::string& filename,
+                                            boost::uint64_t key,
+                                            const KinematicModel& model)
+{
+  std::vector<const KinematicModel::LinkModel*> links;
+  const std::vector<KinematicModel::LinkModel*>& link_models = model.getLinkModels();
+  for(unsigned int i = 0; i < link_models.size(); i++) {
+    const shapes::Shape* shape = link_models[i]->getLinkShape();
+    if(shape != NULL && shape->type != shapes::UNKNOWN_SHAPE) {
+      links.push_back(link_models[i]);
+    }
+  }
+
+  // a unique temporary name, so processes saving the same snapshot never write to one file
+  std::vector<char> tmp_template(filename.begin(), filename.end());
+  const char suffix[] = ".XXXXXX";
+  tmp_template.insert(tmp_template.end(), suffix, suffix + sizeof(suffix));
+  int fd = mkstemp(&tmp_template[0]);
+  if(fd < 0) {
+    ROS_WARN_STREAM("Unable to create a temporary file for model snapshot " << filename);
+    return false;
+  }
+  // mkstemp creates the file readable by its owner only
+  fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  close(fd);
+  std::string tmp_filename(&tmp_template[0]);
+  std::ofstream out(tmp_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if(!out.good()) {
+    ROS_WARN_STREAM("Unable to open model snapshot " << tmp_filename << " for writing");
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  writeValue<boost::uint32_t>(out, SNAPSHOT_VERSION);
+  writeValue<boost::uint64_t>(out, key);
+  writeValue<boost::uint32_t>(out, links.size());
+  for(unsigned int i = 0; i < links.size(); i++) {
+    const std::string& name = links[i]->getName();
+    writeValue<boost::uint32_t>(out, name.size());
+    out.write(name.data(), name.size());
+    writeShape(out, links[i]->getLinkShape());
+  }
+  out.close();
+  if(out.fail()) {
+    ROS_WARN_STREAM("Failed writing model snapshot " << tmp_filename);
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  if(std::rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+    ROS_WARN_STREAM("Unable to move model snapshot into place at " << filename);
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool planning_models::loadLinkShapeSnapshot(const std::string& filename,
+                                            boost::uint64_t key,
+                                            std::map<std::string, const shapes::Shape*>& link_shapes)
+{
+  link_shapes.clear();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(SNAPSHOT_MAGIC)) {
+    close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) {
+    ROS_WARN_STREAM("Unable to map model snapshot " << filename);
+    return false;
+  }
+
+  SnapshotReader reader(static_cast<const char*>(data), size);
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  boost::uint32_t version, num_links;
+  boost::uint64_t file_key;
+  bool ok = (reader.readArray(magic, sizeof(magic)) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0 &&
+             reader.read(version) && version == SNAPSHOT_VERSION &&
+             reader.read(file_key) && file_key == key &&
+             reader.read(num_links));
+  for(boost::uint32_t i = 0; ok && i < num_links; i++) {
+    boost::uint32_t name_length;
+    std::string name;
+    if(!reader.read(name_length) || !reader.readString(name, name_length)) {
+      ok = false;
+      break;
+    }
+    shapes::Shape* shape = readShape(reader);
+    if(shape == NULL) {
+      ok = false;
+      break;
+    }
+    if(link_shapes.find(name) != link_shapes.end()) {
+      delete link_shapes[name];
+    }
+    link_shapes[name] = shape;
+  }
+  munmap(data, size);
+
+  if(!ok) {
+    for(std::map<std::string, const shapes::Shape*>::iterator it = link_shapes.begin();
+        it != link_shapes.end();
+        it++) {
+      delete it->second;
+    }
+    link_shapes.clear();
+  }
+  return ok;
+}
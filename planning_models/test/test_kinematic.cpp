@@ -36,9 +36,11 @@
 
 #include <planning_models/kinematic_model.h>
 #include <planning_models/kinematic_state.h>
+#include <planning_models/model_snapshot.h>
 #include <gtest/gtest.h>
 #include <sstream>
 #include <ctype.h>
+#include <cstdio>
 #include <geometric_shapes/shape_operations.h>
 
 static bool sameStringIgnoringWS(const std::string &s1, const std::string &s2)
@@ -122,6 +124,109 @@ TEST(Loading, SimpleRobot)
   delete model;
 }
 
+TEST(Loading, Snapshot)
+{
+  static const std::string MODEL0 = 
+    "<?xml version=\"1.0\" ?>" 
+    "<robot name=\"myrobot\">" 
+    "  <link name=\"base_link\">"
+    "    <collision name=\"base_collision\">"
+    "    <origin rpy=\"0 0 0\" xyz=\"0 0 0.165\"/>"
+    "    <geometry name=\"base_collision_geom\">"
+    "      <box size=\"0.65 0.65 0.23\"/>"
+    "    </geometry>"
+    "    </collision>"
+    "   </link>"
+    "</robot>";
+
+  std::vector<planning_models::KinematicModel::MultiDofConfig> multi_dof_configs;
+  planning_models::KinematicModel::MultiDofConfig config("base_joint");
+  config.type = "Floating";
+  config.parent_frame_id = "odom_combined";
+  config.child_frame_id = "base_link";
+  multi_dof_configs.push_back(config);
+
+  urdf::Model urdfModel;
+  urdfModel.initString(MODEL0);
+    
+  std::vector<planning_models::KinematicModel::GroupConfig> gcs;
+  planning_models::KinematicModel model(urdfModel,gcs,multi_dof_configs);
+
+  std::string filename = std::string(P_tmpdir) + "/test_kinematic_snapshot";
+  ASSERT_TRUE(planning_models::saveLinkShapeSnapshot(filename, 42, model));
+
+  std::map<std::string, const shapes::Shape*> link_shapes;
+  EXPECT_FALSE(planning_models::loadLinkShapeSnapshot(filename, 43, link_shapes));
+  EXPECT_TRUE(link_shapes.empty());
+  ASSERT_TRUE(planning_models::loadLinkShapeSnapshot(filename, 42, link_shapes));
+  std::remove(filename.c_str());
+  ASSERT_EQ((unsigned int)1, link_shapes.size());
+
+  planning_models::KinematicModel restored(urdfModel,gcs,multi_dof_configs,link_shapes);
+  delete link_shapes["base_link"];
+
+  const shapes::Shape* shape = restored.getLinkModel("base_link")->getLinkShape();
+  ASSERT_TRUE(shape != NULL);
+  ASSERT_EQ(shapes::BOX, shape->type);
+  EXPECT_EQ(0.65, static_cast<const shapes::Box*>(shape)->size[0]);
+  EXPECT_EQ(0.23, static_cast<const shapes::Box*>(shape)->size[2]);
+}
+
+TEST(Loading, AttachedBodyVersions)
+{
+  static const std::string MODEL0 = 
+    "<?xml version=\"1.0\" ?>" 
+    "<robot name=\"myrobot\">" 
+    "  <link name=\"base_link\">"
+    "    <collision name=\"base_collision\">"
+    "    <origin rpy=\"0 0 0\" xyz=\"0 0 0.165\"/>"
+    "    <geometry name=\"base_collision_geom\">"
+    "      <box size=\"0.65 0.65 0.23\"/>"
+    "    </geometry>"
+    "    </collision>"
+    "   </link>"
+    "</robot>";
+
+  std::vector<planning_models::KinematicModel::MultiDofConfig> multi_dof_configs;
+  planning_models::KinematicModel::MultiDofConfig config("base_joint");
+  config.type = "Floating";
+  config.parent_frame_id = "odom_combined";
+  config.child_frame_id = "base_link";
+  multi_dof_configs.push_back(config);
+
+  urdf::Model urdfModel;
+  urdfModel.initString(MODEL0);
+    
+  std::vector<planning_models::KinematicModel::GroupConfig> gcs;
+  planning_models::KinematicModel model(urdfModel,gcs,multi_dof_configs);
+
+  //a live state must not keep the model from changing its attached bodies
+  planning_models::KinematicState old_state(&model);
+  EXPECT_EQ((unsigned int)0, old_state.getAttachedBodyStateVector().size());
+
+  std::vector<shapes::Shape*> shape_vector;
+  shape_vector.push_back(new shapes::Sphere(.1));
+  std::vector<tf::Transform> poses(1, tf::Transform::getIdentity());
+  std::vector<std::string> touch_links;
+  planning_models::KinematicModel::AttachedBodyModel* ab = 
+    new planning_models::KinematicModel::AttachedBodyModel(model.getLinkModel("base_link"), "ball",
+                                                           poses, touch_links, shape_vector);
+  model.addAttachedBodyModel("base_link", ab);
+  EXPECT_EQ((unsigned int)1, model.getAttachedBodyModels().size());
+  EXPECT_EQ((unsigned int)0, old_state.getAttachedBodyStateVector().size());
+
+  {
+    planning_models::KinematicState new_state(&model);
+    ASSERT_EQ((unsigned int)1, new_state.getAttachedBodyStateVector().size());
+
+    //the body stays valid for the state that refers to it after it is detached
+    model.clearLinkAttachedBodyModel("base_link", "ball");
+    EXPECT_EQ((unsigned int)0, model.getAttachedBodyModels().size());
+    new_state.setKinematicStateToDefault();
+    EXPECT_EQ(std::string("ball"), new_state.getAttachedBodyStateVector()[0]->getName());
+  }
+}
+
 TEST(LoadingAndFK, SimpleRobot)
 {   
   static const std::string MODEL1 = 